@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include <wchar.h>
+
+// Public API of PrivateProfileRedirector for the other plugins. The functions are exported by name, resolve them
+// with 'GetProcAddress' and check 'PPR_GetAPIVersion' first, older versions of the plugin don't export all of them:
+//
+//	HMODULE module = ::GetModuleHandleW(L"PrivateProfileRedirector.dll");
+//	auto getAPIVersion = reinterpret_cast<PPR_GetAPIVersion_t>(::GetProcAddress(module, "PPR_GetAPIVersion"));
+//	if (getAPIVersion && getAPIVersion() >= PPR_API_VERSION)
+//	{
+//		auto queryValues = reinterpret_cast<PPR_QueryValuesW_t>(::GetProcAddress(module, "PPR_QueryValuesW"));
+//	}
+//
+// The file names and paths are interpreted the same way 'GetPrivateProfileString' does, the 'A' functions
+// use the 'CodePage' option of the plugin to convert the strings.
+
+// Version 1: 'PPR_GetAPIVersion', 'PPR_QueryValuesA', 'PPR_QueryValuesW'
+// Version 2: 'PPR_GetFloatA', 'PPR_GetFloatW', 'PPR_GetBoolA', 'PPR_GetBoolW', 'PPR_GetInt64A', 'PPR_GetInt64W'
+// Version 3: 'PPR_SubscribeA', 'PPR_SubscribeW', 'PPR_Unsubscribe'
+#define PPR_API_VERSION 3
+#define PPR_CALL __stdcall
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	// One key of 'PPR_QueryValues'. The value is copied into the buffer and always null-terminated, it's truncated
+	// if it doesn't fit. 'Length' receives the full length of the value in characters, without the terminator,
+	// so the value is truncated if 'Length' is greater than or equal to 'BufferSize'.
+	typedef struct PPR_QueryResultA
+	{
+		char* Buffer; // [in] Can be null to only query the length
+		uint32_t BufferSize; // [in] In characters, including the terminator
+		uint32_t Length; // [out]
+		int32_t Found; // [out] Zero if the key doesn't exist, the buffer receives an empty string then
+	} PPR_QueryResultA;
+
+	typedef struct PPR_QueryResultW
+	{
+		wchar_t* Buffer;
+		uint32_t BufferSize;
+		uint32_t Length;
+		int32_t Found;
+	} PPR_QueryResultW;
+
+	uint32_t PPR_CALL PPR_GetAPIVersion(void);
+
+	// Reads 'count' keys of one section at once, the file is looked up and locked once for all of them.
+	// Null keys are reported as not found. Returns the number of keys found.
+	uint32_t PPR_CALL PPR_QueryValuesA(const char* fileName, const char* section, const char* const* keys, uint32_t count, PPR_QueryResultA* results);
+	uint32_t PPR_CALL PPR_QueryValuesW(const wchar_t* fileName, const wchar_t* section, const wchar_t* const* keys, uint32_t count, PPR_QueryResultW* results);
+
+	// Typed reads parsing the value the way the game engine parses its own settings: 'PPR_GetFloat' like the 'f' settings
+	// ('atof'), 'PPR_GetBool' like the 'b' ones ("true", "false" or a number) and 'PPR_GetInt64' like the 'i' ones
+	// ('atoi') if the key name starts with 'i', like the 'u' ones ('strtoul') if it starts with 'u' and as a 64-bit
+	// integer otherwise. The default value is returned only if the key doesn't exist. Parsed values are cached
+	// until the value is written again, so these are cheap enough to be called every frame.
+	float PPR_CALL PPR_GetFloatA(const char* fileName, const char* section, const char* key, float defaultValue);
+	float PPR_CALL PPR_GetFloatW(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, float defaultValue);
+	int32_t PPR_CALL PPR_GetBoolA(const char* fileName, const char* section, const char* key, int32_t defaultValue);
+	int32_t PPR_CALL PPR_GetBoolW(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, int32_t defaultValue);
+	int64_t PPR_CALL PPR_GetInt64A(const char* fileName, const char* section, const char* key, int64_t defaultValue);
+	int64_t PPR_CALL PPR_GetInt64W(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, int64_t defaultValue);
+
+	// Called when the watched value has changed, including the key being added or removed. The changes are collected
+	// until they're flushed (the game is saved, the files are saved on write or on idle, or reloaded by 'RefreshINI'),
+	// so a value written many times in between is reported once, and not at all if it ends up unchanged. The callback
+	// is called without any of the plugin locks held and can use the whole API, read the new value with it.
+	// It's called on the thread which flushed the changes: the game thread for the game saves and 'RefreshINI',
+	// the writing thread for the save on write, a thread pool thread for the delayed flush and the idle save thread
+	// for 'SaveOnIdle'. Nothing is delivered once the plugin is shutting down or the process is terminating.
+	typedef void (PPR_CALL* PPR_ChangeCallback)(uint64_t subscription, void* userData);
+
+	// Returns the subscription identifier or zero on failure. After 'PPR_Unsubscribe' returns the callback
+	// isn't called anymore, unless 'PPR_Unsubscribe' is called from a callback, it doesn't wait for the other threads then.
+	uint64_t PPR_CALL PPR_SubscribeA(const char* fileName, const char* section, const char* key, PPR_ChangeCallback callback, void* userData);
+	uint64_t PPR_CALL PPR_SubscribeW(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, PPR_ChangeCallback callback, void* userData);
+	int32_t PPR_CALL PPR_Unsubscribe(uint64_t subscription);
+
+	typedef uint32_t (PPR_CALL* PPR_GetAPIVersion_t)(void);
+	typedef uint32_t (PPR_CALL* PPR_QueryValuesA_t)(const char* fileName, const char* section, const char* const* keys, uint32_t count, PPR_QueryResultA* results);
+	typedef uint32_t (PPR_CALL* PPR_QueryValuesW_t)(const wchar_t* fileName, const wchar_t* section, const wchar_t* const* keys, uint32_t count, PPR_QueryResultW* results);
+	typedef float (PPR_CALL* PPR_GetFloatA_t)(const char* fileName, const char* section, const char* key, float defaultValue);
+	typedef float (PPR_CALL* PPR_GetFloatW_t)(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, float defaultValue);
+	typedef int32_t (PPR_CALL* PPR_GetBoolA_t)(const char* fileName, const char* section, const char* key, int32_t defaultValue);
+	typedef int32_t (PPR_CALL* PPR_GetBoolW_t)(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, int32_t defaultValue);
+	typedef int64_t (PPR_CALL* PPR_GetInt64A_t)(const char* fileName, const char* section, const char* key, int64_t defaultValue);
+	typedef int64_t (PPR_CALL* PPR_GetInt64W_t)(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, int64_t defaultValue);
+	typedef uint64_t (PPR_CALL* PPR_SubscribeA_t)(const char* fileName, const char* section, const char* key, PPR_ChangeCallback callback, void* userData);
+	typedef uint64_t (PPR_CALL* PPR_SubscribeW_t)(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, PPR_ChangeCallback callback, void* userData);
+	typedef int32_t (PPR_CALL* PPR_Unsubscribe_t)(uint64_t subscription);
+
+#ifdef __cplusplus
+}
+#endif
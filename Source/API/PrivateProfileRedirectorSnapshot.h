@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+
+// Layout of the shared snapshot published by PrivateProfileRedirector when the 'SharedSnapshot' option is enabled.
+// External tools can read the current in-memory content of every loaded INI file from it, including the changes
+// that haven't been saved to the disk yet. The region is read-only for the readers and doesn't need any IPC.
+//
+// The region is a named file mapping 'Local\PrivateProfileRedirector.Snapshot.<pid>' where '<pid>' is the decimal
+// identifier of the game process. It starts with 'PPR_SnapshotHeader', the data follows at 'HeaderSize'.
+// All the integers are little-endian and all the strings are UTF-16LE without terminators, so the layout
+// doesn't depend on the language or the platform of the reader.
+//
+// The data is protected by a sequence lock. A reader loads 'Sequence', retries if it's odd, copies 'DataSize',
+// 'FileCount', 'Flags', 'Generation' and the data, then loads 'Sequence' again and retries if it has changed:
+//
+//	uint64_t sequence = atomic_load_acquire(&header->Sequence);
+//	if ((sequence & 1) == 0)
+//	{
+//		uint32_t dataSize = header->DataSize;
+//		memcpy(copy, (const char*)header + header->HeaderSize, dataSize);
+//		atomic_thread_fence_acquire();
+//		if (atomic_load_relaxed(&header->Sequence) == sequence) { /* 'copy' is consistent */ }
+//	}
+//
+// The data is a sequence of records, each one is 'PPR_SnapshotRecord' followed by 'Length' UTF-16 code units and
+// padded to a multiple of 4 bytes. Every file record is followed by its sections and every section by its keys,
+// every key by its value:
+//
+//	File, Section, Key, Value, Key, Value, ..., Section, ..., File, ...
+//
+// File paths are the canonical absolute paths, section and key names are upper-cased as the lookups are case-insensitive
+// (the non-ASCII characters with the invariant locale). Files that don't fit into the region are left out
+// and 'PPR_SNAPSHOT_FLAG_TRUNCATED' is set. Files evicted from memory ('MemoryLimit' option) are left out as well,
+// they're unchanged since they were last read from the disk.
+// See 'Tools/SnapshotReader' for a complete reader.
+
+#define PPR_SNAPSHOT_MAGIC 0x53525050u // 'PPRS'
+#define PPR_SNAPSHOT_LAYOUT_VERSION 1
+#define PPR_SNAPSHOT_NAME_PREFIX "PrivateProfileRedirector.Snapshot."
+#define PPR_SNAPSHOT_FLAG_TRUNCATED 0x1u
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef enum PPR_SnapshotRecordType
+	{
+		PPR_SNAPSHOT_RECORD_FILE = 1,
+		PPR_SNAPSHOT_RECORD_SECTION = 2,
+		PPR_SNAPSHOT_RECORD_KEY = 3,
+		PPR_SNAPSHOT_RECORD_VALUE = 4
+	} PPR_SnapshotRecordType;
+
+	// 64 bytes. The first four fields are set once when the region is created, everything starting
+	// from 'Flags' is only valid if it was read between two equal even loads of 'Sequence'.
+	typedef struct PPR_SnapshotHeader
+	{
+		uint32_t Magic;
+		uint16_t LayoutVersion;
+		uint16_t HeaderSize; // Offset of the data from the start of the region
+		uint32_t RegionSize; // Size of the whole region, including the header
+		uint32_t Flags;
+		uint64_t Sequence; // Odd while the snapshot is being written
+		uint64_t Generation; // Number of snapshots published so far
+		uint32_t DataSize; // In bytes
+		uint32_t FileCount;
+		uint64_t Reserved[3];
+	} PPR_SnapshotHeader;
+
+	typedef struct PPR_SnapshotRecord
+	{
+		uint16_t Type; // 'PPR_SnapshotRecordType'
+		uint16_t Reserved;
+		uint32_t Length; // In UTF-16 code units
+	} PPR_SnapshotRecord;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+#include "stdafx.h"
+#include "CallerStatistics.h"
+#include "TraceRecorder.h"
+
+namespace PPR
+{
+	// Records the span of the exported function and attributes the call to the module the return address belongs to
+	// when the trace events or the caller statistics are enabled. The file path is only requested when the statistics
+	// are on, with both of them off this is a pair of null checks. The string functions return the number of characters
+	// copied which is accounted as the returned bytes.
+	template<class TPathFunc, class TFunc>
+	auto TrackCall(CallerStatistics* statistics, TraceRecorder* traceRecorder, const char* name, const void* returnAddress, TPathFunc&& getFilePath, TFunc&& func)
+	{
+		if (!statistics && !traceRecorder)
+		{
+			return std::invoke(func);
+		}
+
+		const int64_t startTime = CallerStatistics::GetTimestamp();
+		auto result = std::invoke(func);
+		const int64_t endTime = CallerStatistics::GetTimestamp();
+
+		const DWORD lastError = ::GetLastError();
+		if (traceRecorder)
+		{
+			traceRecorder->Record(name, startTime, endTime);
+		}
+		if (statistics)
+		{
+			const auto filePath = std::invoke(getFilePath);
+			using TChar = std::remove_cvref_t<decltype(*filePath)>;
+
+			size_t bytes = 0;
+			if constexpr(std::is_same_v<decltype(result), DWORD>)
+			{
+				bytes = result * sizeof(TChar);
+			}
+			statistics->Record(returnAddress, filePath, endTime - startTime, bytes);
+		}
+		::SetLastError(lastError);
+
+		return result;
+	}
+}
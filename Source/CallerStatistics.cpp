@@ -0,0 +1,159 @@
+#include "stdafx.h"
+#include "CallerStatistics.h"
+#include "ReaderBiasedLock.h"
+
+namespace
+{
+	size_t GetImageSize(HMODULE module) noexcept
+	{
+		auto base = reinterpret_cast<const uint8_t*>(module);
+		auto dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+		if (dosHeader->e_magic == IMAGE_DOS_SIGNATURE)
+		{
+			auto ntHeaders = reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dosHeader->e_lfanew);
+			if (ntHeaders->Signature == IMAGE_NT_SIGNATURE)
+			{
+				return ntHeaders->OptionalHeader.SizeOfImage;
+			}
+		}
+		return 0;
+	}
+}
+
+namespace PPR
+{
+	CallerStatistics::CallerStatistics(kxf::IEncodingConverter& encodingConverter)
+		:m_EncodingConverter(encodingConverter)
+	{
+		LARGE_INTEGER frequency = {};
+		if (::QueryPerformanceFrequency(&frequency) && frequency.QuadPart != 0)
+		{
+			m_Frequency = frequency.QuadPart;
+		}
+	}
+
+	std::vector<kxf::String> CallerStatistics::GetReport(size_t maxModules, bool withFiles) const
+	{
+		struct ModuleRange final
+		{
+			uintptr_t Base = 0;
+			uintptr_t End = 0;
+			size_t Index = 0;
+		};
+		struct ModuleStatistics final
+		{
+			kxf::String Name;
+			Counters Total;
+			kxf::Utility::UnorderedMapNoCase<kxf::String, Counters> Files;
+		};
+		std::vector<ModuleRange> ranges;
+		std::vector<ModuleStatistics> modules;
+
+		auto ResolveModule = [&](uintptr_t address) -> size_t
+		{
+			// Ranges are sorted by the base address, find the last one starting at or before the address
+			auto it = std::upper_bound(ranges.begin(), ranges.end(), address, [](uintptr_t address, const ModuleRange& range)
+			{
+				return address < range.Base;
+			});
+			if (it != ranges.begin() && address < std::prev(it)->End)
+			{
+				return std::prev(it)->Index;
+			}
+
+			// Not seen yet, ask the loader. The code not belonging to any module (generated code, trampolines) is grouped together.
+			HMODULE module = nullptr;
+			if (::GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS|GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, reinterpret_cast<LPCWSTR>(address), &module) && module)
+			{
+				wchar_t path[MAX_PATH] = {};
+				::GetModuleFileNameW(module, path, std::size(path));
+
+				ModuleStatistics& statistics = modules.emplace_back();
+				statistics.Name = kxf::FSPath(path).GetName();
+
+				const uintptr_t base = reinterpret_cast<uintptr_t>(module);
+				const size_t imageSize = GetImageSize(module);
+				ranges.insert(it, ModuleRange{base, base + (imageSize != 0 ? imageSize : 1), modules.size() - 1});
+
+				return modules.size() - 1;
+			}
+			else
+			{
+				auto unknown = std::find_if(modules.begin(), modules.end(), [](const ModuleStatistics& item)
+				{
+					return item.Name.IsEmpty();
+				});
+				if (unknown != modules.end())
+				{
+					return unknown - modules.begin();
+				}
+
+				modules.emplace_back();
+				return modules.size() - 1;
+			}
+		};
+
+		// The stripe locks are only tried at the process termination, a stripe held by a terminated thread is left out
+		const bool isTerminating = ReaderBiasedLock::IsProcessTerminating();
+		for (const Stripe& stripe: m_Stripes)
+		{
+			SRWLOCK* lock = &stripe.Lock;
+			if (isTerminating)
+			{
+				if (!::TryAcquireSRWLockShared(lock))
+				{
+					continue;
+				}
+			}
+			else
+			{
+				::AcquireSRWLockShared(lock);
+			}
+			kxf::Utility::ScopeGuard unlock = [&]()
+			{
+				::ReleaseSRWLockShared(lock);
+			};
+
+			for (const auto& [callSite, callSiteStatistics]: stripe.CallSites)
+			{
+				ModuleStatistics& statistics = modules[ResolveModule(callSite.ReturnAddress)];
+				statistics.Total.Add(callSiteStatistics.Total);
+				statistics.Files[callSiteStatistics.FilePath].Add(callSiteStatistics.Total);
+			}
+		}
+
+		std::vector<const ModuleStatistics*> sortedModules;
+		for (const ModuleStatistics& statistics: modules)
+		{
+			sortedModules.push_back(&statistics);
+		}
+		std::sort(sortedModules.begin(), sortedModules.end(), [](const ModuleStatistics* left, const ModuleStatistics* right)
+		{
+			return left->Total.Ticks > right->Total.Ticks;
+		});
+		if (maxModules != 0 && sortedModules.size() > maxModules)
+		{
+			sortedModules.resize(maxModules);
+		}
+
+		std::vector<kxf::String> lines;
+		for (const ModuleStatistics* statistics: sortedModules)
+		{
+			lines.emplace_back(kxf::Format("'{}': calls: {}, time: {:.1f} us, bytes returned: {}",
+										   !statistics->Name.IsEmpty() ? statistics->Name : "<unknown>",
+										   statistics->Total.Calls,
+										   ToMicroseconds(statistics->Total.Ticks),
+										   statistics->Total.Bytes)
+			);
+
+			if (withFiles)
+			{
+				for (const auto& [path, counters]: statistics->Files)
+				{
+					lines.emplace_back(kxf::Format("    '{}': calls: {}, time: {:.1f} us, bytes returned: {}", path, counters.Calls, ToMicroseconds(counters.Ticks), counters.Bytes));
+				}
+			}
+		}
+		return lines;
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include "stdafx.h"
+#include <kxf/Core/IEncodingConverter.h>
+#include <kxf/Utility/String.h>
+#include <unordered_map>
+#include <array>
+
+namespace PPR
+{
+	// Accumulates the calls of the redirected functions per calling module and per file. The caller is identified
+	// by the return address of the exported function. The calls are counted per return address and file path
+	// in one of the stripes picked by the calling thread, so the threads rarely share a lock and nothing is
+	// allocated after the first call from a given place. Modules and file names are resolved only for the report.
+	class CallerStatistics final
+	{
+		public:
+			struct Counters final
+			{
+				size_t Calls = 0;
+				int64_t Ticks = 0;
+				size_t Bytes = 0;
+
+				void Add(int64_t ticks, size_t bytes) noexcept
+				{
+					Calls++;
+					Ticks += ticks;
+					Bytes += bytes;
+				}
+				void Add(const Counters& other) noexcept
+				{
+					Calls += other.Calls;
+					Ticks += other.Ticks;
+					Bytes += other.Bytes;
+				}
+			};
+
+			static int64_t GetTimestamp() noexcept
+			{
+				LARGE_INTEGER value = {};
+				::QueryPerformanceCounter(&value);
+
+				return value.QuadPart;
+			}
+
+		private:
+			static constexpr size_t StripeCount = 16;
+
+			struct CallSite final
+			{
+				uintptr_t ReturnAddress = 0;
+				uint64_t PathHash = 0;
+
+				bool operator==(const CallSite&) const noexcept = default;
+			};
+			struct CallSiteHash final
+			{
+				size_t operator()(const CallSite& callSite) const noexcept
+				{
+					return static_cast<size_t>((static_cast<uint64_t>(callSite.ReturnAddress) * 0x9E3779B97F4A7C15ull) ^ callSite.PathHash);
+				}
+			};
+			struct CallSiteStatistics final
+			{
+				kxf::String FilePath;
+				Counters Total;
+			};
+			struct alignas(64) Stripe final
+			{
+				mutable SRWLOCK Lock = SRWLOCK_INIT;
+				std::unordered_map<CallSite, CallSiteStatistics, CallSiteHash> CallSites;
+			};
+
+			// Case-insensitive for ASCII, the spellings which differ otherwise are merged by the report
+			template<class TChar>
+			static uint64_t HashPath(const TChar* path) noexcept
+			{
+				uint64_t hash = 14695981039346656037ull;
+				for (; path && *path; path++)
+				{
+					auto c = static_cast<std::make_unsigned_t<TChar>>(*path);
+					if (c >= 'a' && c <= 'z')
+					{
+						c -= 'a' - 'A';
+					}
+					hash = (hash ^ c) * 1099511628211ull;
+				}
+				return hash;
+			}
+
+		private:
+			kxf::IEncodingConverter& m_EncodingConverter;
+			std::array<Stripe, StripeCount> m_Stripes;
+			int64_t m_Frequency = 1;
+
+		private:
+			double ToMicroseconds(int64_t ticks) const noexcept
+			{
+				return static_cast<double>(ticks) * 1000000.0 / static_cast<double>(m_Frequency);
+			}
+
+			template<class TChar>
+			kxf::String ToString(const TChar* filePath) const
+			{
+				if (!filePath)
+				{
+					return {};
+				}
+				else if constexpr(std::is_same_v<TChar, char>)
+				{
+					return m_EncodingConverter.ToWideChar(filePath);
+				}
+				else
+				{
+					return filePath;
+				}
+			}
+
+		public:
+			CallerStatistics(kxf::IEncodingConverter& encodingConverter);
+			CallerStatistics(const CallerStatistics&) = delete;
+
+		public:
+			template<class TChar>
+			void Record(const void* returnAddress, const TChar* filePath, int64_t ticks, size_t bytes)
+			{
+				Stripe& stripe = m_Stripes[::GetCurrentThreadId() % m_Stripes.size()];
+				const CallSite callSite{reinterpret_cast<uintptr_t>(returnAddress), HashPath(filePath)};
+
+				::AcquireSRWLockExclusive(&stripe.Lock);
+				kxf::Utility::ScopeGuard unlock = [&]()
+				{
+					::ReleaseSRWLockExclusive(&stripe.Lock);
+				};
+
+				auto [it, inserted] = stripe.CallSites.try_emplace(callSite);
+				if (inserted)
+				{
+					it->second.FilePath = ToString(filePath);
+				}
+				it->second.Total.Add(ticks, bytes);
+			}
+
+			// Modules sorted by the time spent in the redirected functions, zero means all of them
+			std::vector<kxf::String> GetReport(size_t maxModules = 0, bool withFiles = true) const;
+
+		public:
+			CallerStatistics& operator=(const CallerStatistics&) = delete;
+	};
+}
@@ -9,6 +9,13 @@
 #undef GetPrivateProfileString
 #undef GetPrivateProfileInt
 #undef WritePrivateProfileString
+#undef WritePrivateProfileSection
+#undef GetPrivateProfileStruct
+#undef WritePrivateProfileStruct
+#undef GetProfileString
+#undef GetProfileInt
+#undef GetProfileSection
+#undef WriteProfileString
 
 #include <kxf/pch.hpp>
 #include <kxf/System/UndefWindows.h>
@@ -8,6 +8,13 @@ namespace PPR
 	bool ConfigObject::LoadFile()
 	{
 		Redirector& instance = Redirector::GetInstance();
+		TraceSpan traceSpan(instance.GetTraceRecorder(), "LoadFile");
+
+		// Deferred native writes have to reach the disk before the file is read again
+		if (!m_NativeWrites.IsEmpty())
+		{
+			ReplayNativeWrites();
+		}
 
 		// Set loading options
 		kxf::FlagSet<kxf::INIDocumentOption> options;
@@ -15,11 +22,32 @@ namespace PPR
 		options.Add(kxf::INIDocumentOption::IgnoreCase);
 		options.Mod(kxf::INIDocumentOption::InlineComments, instance.IsOptionEnabled(RedirectorOption::ProcessInlineComments));
 
+		kxf::Utility::ScopeGuard atExit = [&]()
+		{
+			if (m_SubscriberCount != 0)
+			{
+				m_HasSubscribedChanges = true;
+			}
+			if (auto publisher = instance.GetSnapshotPublisher())
+			{
+				publisher->Schedule();
+			}
+
+			const size_t memoryUsage = GetStubMemoryUsage() + m_INI.GetMemoryUsage();
+			instance.OnFileLoad(m_MemoryUsage.exchange(memoryUsage), memoryUsage);
+			OnAccess();
+		};
+
 		if (m_INI.Load(m_Path, options))
 		{
 			m_ChangesCount = 0;
 			m_ExistOnDisk = true;
 
+			if (auto builder = instance.GetPerfectHashBuilder())
+			{
+				builder->Schedule(*this);
+			}
+
 			return true;
 		}
 		else
@@ -34,6 +62,7 @@ namespace PPR
 	bool ConfigObject::SaveFile()
 	{
 		Redirector& instance = Redirector::GetInstance();
+		TraceSpan traceSpan(instance.GetTraceRecorder(), "SaveFile");
 		if (instance.IsOptionEnabled(RedirectorOption::WriteProtected))
 		{
 			kxf::Log::TraceCategory("WriteProtected", "Attempt to write data to '{}'", m_Path.GetFullPath());
@@ -43,13 +72,22 @@ namespace PPR
 		}
 		else if (instance.IsOptionEnabled(RedirectorOption::NativeWrite))
 		{
-			kxf::Log::TraceCategory("NativeWrite", "NativeWrite enabled, ignoring this write operation for '{}'", m_Path.GetFullPath());
-
 			m_ChangesCount = 0;
+			if (instance.IsOptionEnabled(RedirectorOption::NativeWriteDeferred))
+			{
+				ReplayNativeWrites();
+				return true;
+			}
+
+			kxf::Log::TraceCategory("NativeWrite", "NativeWrite enabled, ignoring this write operation for '{}'", m_Path.GetFullPath());
 			return false;
 		}
 
-		if (m_INI.Save(m_Path))
+		m_IsSaving = true;
+		const bool isSaved = m_INI.Save(m_Path);
+		m_IsSaving = false;
+
+		if (isSaved)
 		{
 			m_ChangesCount = 0;
 			m_ExistOnDisk = true;
@@ -66,17 +104,136 @@ namespace PPR
 		}
 	}
 
+	size_t ConfigObject::ReplayNativeWrites()
+	{
+		Redirector& instance = Redirector::GetInstance();
+
+		size_t count = m_NativeWrites.Replay(instance.GetFunctionTable().PrivateProfile, std::wstring(kxf::StringViewOf(m_Path.GetFullPath())));
+		kxf::Log::InfoCategory("NativeWrite", "Replayed {} deferred native writes to '{}'", count, m_Path.GetFullPath());
+
+		return count;
+	}
+
+	bool ConfigObject::BuildPerfectHash()
+	{
+		TraceSpan traceSpan(Redirector::GetInstance().GetTraceRecorder(), "BuildPerfectHash");
+
+		// Only one section is locked at a time while the pairs are copied, so the writers of the other ones aren't blocked
+		size_t indexVersion = 0;
+		std::unique_ptr<PerfectHashIndex> perfectHash;
+		{
+			ReaderBiasedLock::ReadGuard lock(m_Lock);
+			if (m_IsEvicted)
+			{
+				return false;
+			}
+			indexVersion = m_INI.GetIndexVersion();
+			perfectHash = m_INI.CreatePerfectHash([&](size_t sectionHash)
+			{
+				return ReaderBiasedLock::ReadGuard(GetSectionLock(sectionHash));
+			});
+		}
+
+		if (!perfectHash->Build())
+		{
+			kxf::Log::WarningCategory("PerfectHashIndex", "Failed to build the perfect hash for '{}'", m_Path.GetFullPath());
+			return false;
+		}
+
+		// If anything was written in the meantime the writer has already scheduled another build,
+		// the eviction changes the index version as well.
+		ReaderBiasedLock::WriteGuard lock(m_Lock);
+		if (m_INI.SetPerfectHash(std::move(perfectHash), indexVersion))
+		{
+			kxf::Log::TraceCategory("PerfectHashIndex", "Built the perfect hash for '{}', {} entries", m_Path.GetFullPath(), m_INI.GetPerfectHash()->GetSize());
+			return true;
+		}
+		return false;
+	}
+
+	bool ConfigObject::WriteSnapshot(SnapshotWriter& writer)
+	{
+		// Evicted files are the same as on the disk, they're left out instead of being loaded again
+		ReaderBiasedLock::ReadGuard lock(m_Lock);
+		if (m_IsEvicted)
+		{
+			return false;
+		}
+
+		writer.BeginFile(kxf::StringViewOf(m_Path.GetFullPath()));
+		m_INI.EnumerateIndex([&](size_t sectionHash)
+		{
+			return ReaderBiasedLock::ReadGuard(GetSectionLock(sectionHash));
+		}, [&](kxf::StringView section)
+		{
+			writer.AddSection(section);
+		}, [&](kxf::StringView key, const IndexValue& value)
+		{
+			writer.AddValue(key, value);
+		});
+		return true;
+	}
+
+	bool ConfigObject::Evict()
+	{
+		// Only the files which are the same as on the disk can be dropped, the caller holds the exclusive lock
+		if (m_IsEvicted || HasChanges() || m_IsDirtyListed || m_SaveRequested || !m_NativeWrites.IsEmpty())
+		{
+			return false;
+		}
+
+		// This also frees the optimistic value cache, its readers only hold the file lock in shared mode
+		m_INI.Unload();
+		m_IsEvicted = true;
+
+		kxf::Log::TraceCategory("MemoryLimit", "Evicted '{}'", m_Path.GetFullPath());
+		return true;
+	}
+	void ConfigObject::LoadEvicted()
+	{
+		kxf::Log::TraceCategory("MemoryLimit", "Reloading evicted '{}'", m_Path.GetFullPath());
+
+		LoadFile();
+		m_IsEvicted = false;
+		Redirector::GetInstance().OnFileReload();
+	}
+	void ConfigObject::Reload()
+	{
+		ReaderBiasedLock::WriteGuard lock(m_Lock);
+		if (m_IsEvicted)
+		{
+			LoadEvicted();
+		}
+	}
+
 	void ConfigObject::OnWrite()
 	{
-		m_ChangesCount++;
+		const size_t changesCount = ++m_ChangesCount;
+		if (m_SubscriberCount != 0)
+		{
+			m_HasSubscribedChanges = true;
+		}
 
 		Redirector& instance = Redirector::GetInstance();
+		if (!m_IsDirtyListed.exchange(true))
+		{
+			instance.PushDirtyFile(*this);
+		}
+		if (auto scheduler = instance.GetIdleSaveScheduler())
+		{
+			scheduler->Schedule(*this);
+		}
+		if (auto publisher = instance.GetSnapshotPublisher())
+		{
+			publisher->Schedule();
+		}
+
 		kxf::Utility::ScopeGuard atExit = [&]()
 		{
 			instance.OnFileWrite(*this);
 		};
 		
-		if (instance.IsOptionEnabled(RedirectorOption::NativeWrite))
+		if (instance.IsOptionEnabled(RedirectorOption::NativeWrite) && !instance.IsOptionEnabled(RedirectorOption::NativeWriteDeferred))
 		{
 			kxf::Log::TraceCategory("NativeWrite", "NativeWrite enabled, ignoring this write operation for '{}'", m_Path.GetFullPath());
 			return;
@@ -86,13 +243,14 @@ namespace PPR
 		{
 			if (auto bufferSize = instance.GetSaveOnWriteBuffer())
 			{
-				if (m_ChangesCount >= *bufferSize)
+				if (changesCount >= *bufferSize)
 				{
 					kxf::Log::InfoCategory("SaveOnWrite", "Changes count for '{}' reached buffer capacity ({}), flushing changes. Is empty file: {}", m_Path.GetFullPath(), *bufferSize, m_INI.IsEmpty());
+					instance.OnFileBufferFlush();
 				}
 				else
 				{
-					kxf::Log::TraceCategory("SaveOnWrite", "Accumulated {} changes (out of {}) for '{}'", m_ChangesCount, *bufferSize, m_Path.GetFullPath());
+					kxf::Log::TraceCategory("SaveOnWrite", "Accumulated {} changes (out of {}) for '{}'", changesCount, *bufferSize, m_Path.GetFullPath());
 					return;
 				}
 			}
@@ -100,7 +258,36 @@ namespace PPR
 			{
 				kxf::Log::InfoCategory("SaveOnWrite", "Saving file on write: '{}', is empty file: {}", m_Path.GetFullPath(), m_INI.IsEmpty());
 			}
-			SaveFile();
+
+			// Only the section is locked at this point, saving needs the whole file
+			m_SaveRequested = true;
+		}
+	}
+	void ConfigObject::OnWriteFinished()
+	{
+		if (auto builder = Redirector::GetInstance().GetPerfectHashBuilder(); builder && m_INI.IsPerfectHashNeeded())
+		{
+			builder->Schedule(*this);
+		}
+
+		const bool saveRequested = m_SaveRequested.exchange(false);
+		if (saveRequested || m_INI.IsCompactionNeeded())
+		{
+			{
+				auto lock = LockExclusive();
+				m_INI.CompactIndexIfNeeded();
+
+				if (saveRequested && HasChanges())
+				{
+					SaveFile();
+				}
+			}
+
+			// The subscribers are notified once the changes are flushed and the lock is released
+			if (saveRequested)
+			{
+				Redirector::GetInstance().GetSubscriptions().Deliver();
+			}
 		}
 	}
 }
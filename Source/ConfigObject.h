@@ -1,14 +1,22 @@
 #pragma once
 #include "stdafx.h"
-#include <kxf/Threading/ReadWriteLock.h>
-#include <kxf/Threading/LockGuard.h>
 #include "INIWrapper.h"
+#include "NativeWriteQueue.h"
+#include "ReaderBiasedLock.h"
+
+namespace PPR
+{
+	class SnapshotWriter;
+}
 
 namespace PPR
 {
 	class ConfigObject
 	{
 		friend class Redirector;
+		friend class IdleSaveScheduler;
+		friend class PerfectHashBuilder;
+		friend class SnapshotPublisher;
 
 		public:
 			using Options = INIWrapper::Options;
@@ -17,14 +25,58 @@ namespace PPR
 		private:
 			INIWrapper m_INI;
 			kxf::FSPath m_Path;
-			size_t m_ChangesCount = 0;
+			std::atomic<size_t> m_ChangesCount = 0;
+			std::atomic<bool> m_SaveRequested = false;
 			bool m_ExistOnDisk = false;
 
-			kxf::ReadWriteLock m_Lock;
+			// Stays set if the process is terminated in the middle of writing the file, see 'Redirector::SaveOnShutdown'
+			std::atomic<bool> m_IsSaving = false;
+
+			// Intrusive link for the redirector's dirty list. The file is listed by the first writer that sets the flag
+			// and unlisted under the exclusive lock.
+			ConfigObject* m_NextDirty = nullptr;
+			std::atomic<bool> m_IsDirtyListed = false;
+
+			// Native writes waiting to be replayed to the disk, used only in the deferred 'NativeWrite' mode
+			NativeWriteQueue m_NativeWrites;
+
+			// Change subscriptions, see 'SubscriptionManager'. Files without subscribers don't track anything.
+			std::atomic<size_t> m_SubscriberCount = 0;
+			std::atomic<bool> m_HasSubscribedChanges = false;
+
+			// Memory cap, see 'Redirector::EvictColdFiles'. An evicted file keeps its object and only drops its content,
+			// so the references to it stay valid, and it's loaded again by the first 'Lock*' call.
+			std::atomic<bool> m_IsEvicted = false;
+			std::atomic<uint64_t> m_LastAccess = 0;
+			std::atomic<size_t> m_MemoryUsage = 0;
+
+			// Value reads and writes take the file lock in shared mode and the lock of their section, so the writers
+			// of one section don't block the readers and writers of the other ones. Operations on the whole file
+			// (loading, saving, adding and removing sections) take the file lock in exclusive mode.
+			ReaderBiasedLock m_Lock;
+			std::array<ReaderBiasedLock, 64> m_SectionLocks;
 
 		private:
 			bool LoadFile();
 			bool SaveFile();
+			size_t ReplayNativeWrites();
+			bool BuildPerfectHash();
+			bool WriteSnapshot(SnapshotWriter& writer);
+			bool Evict();
+			void LoadEvicted();
+			void Reload();
+
+		public:
+			struct SharedSectionLock final
+			{
+				ReaderBiasedLock::ReadGuard File;
+				ReaderBiasedLock::ReadGuard Section;
+			};
+			struct ExclusiveSectionLock final
+			{
+				ReaderBiasedLock::ReadGuard File;
+				ReaderBiasedLock::WriteGuard Section;
+			};
 
 		public:
 			ConfigObject(kxf::FSPath filePath)
@@ -41,6 +93,14 @@ namespace PPR
 			{
 				return m_INI;
 			}
+			const NativeWriteQueue& GetNativeWriteQueue() const noexcept
+			{
+				return m_NativeWrites;
+			}
+			NativeWriteQueue& GetNativeWriteQueue() noexcept
+			{
+				return m_NativeWrites;
+			}
 			kxf::FSPath GetFilePath() const
 			{
 				return m_Path;
@@ -58,19 +118,122 @@ namespace PPR
 			{
 				return m_INI.IsEmpty();
 			}
+			bool IsEvicted() const noexcept
+			{
+				return m_IsEvicted;
+			}
+
+			// What an evicted file still takes: the object with its locks and the path
+			size_t GetStubMemoryUsage() const
+			{
+				return sizeof(ConfigObject) + m_Path.GetFullPath().length() * sizeof(wchar_t);
+			}
+			void OnAccess() noexcept
+			{
+				// Millisecond resolution is enough for the LRU order, and it's written at most once per millisecond
+				const uint64_t now = ::GetTickCount64();
+				if (m_LastAccess.load(std::memory_order_relaxed) != now)
+				{
+					m_LastAccess.store(now, std::memory_order_relaxed);
+				}
+			}
 			void OnWrite();
+			void OnWriteFinished();
 
-			kxf::ReadWriteLock& GetLock() noexcept
+			void AddSubscriber() noexcept
+			{
+				m_SubscriberCount++;
+			}
+			void RemoveSubscriber() noexcept
+			{
+				m_SubscriberCount--;
+			}
+			bool TakeSubscribedChanges() noexcept
+			{
+				return m_HasSubscribedChanges.exchange(false);
+			}
+
+			ReaderBiasedLock& GetLock() noexcept
 			{
 				return m_Lock;
 			}
-			auto LockShared() noexcept
+			ReaderBiasedLock& GetSectionLock(size_t sectionHash) noexcept
+			{
+				return m_SectionLocks[sectionHash % m_SectionLocks.size()];
+			}
+			ReaderBiasedLock& GetSectionLock(const FoldedName& section) noexcept
+			{
+				return GetSectionLock(INIWrapper::GetSectionHash(section));
+			}
+
+			// Called under the exclusive file lock, which keeps the section writers out. Once the process is terminating, a section
+			// lock that can't be taken was left by a terminated thread, which could've been a writer cut short in its write.
+			bool HasAbandonedSectionLock() noexcept
+			{
+				return std::ranges::any_of(m_SectionLocks, [](ReaderBiasedLock& sectionLock)
+				{
+					return ReaderBiasedLock::WriteGuard(sectionLock).IsAbandoned();
+				});
+			}
+
+			// Only the file lock is taken and it's released before returning, a miss goes through 'LockSectionShared'.
+			// An evicted file has no cache, so the miss reloads it.
+			template<class... Args>
+			bool FindCachedValue(const FoldedName& section, const FoldedName& key, Args&&... args) noexcept
+			{
+				ReaderBiasedLock::ReadGuard lock(m_Lock);
+				return m_INI.FindCachedValue(section, key, std::forward<Args>(args)...);
+			}
+			ReaderBiasedLock::ReadGuard LockShared()
+			{
+				for (;;)
+				{
+					{
+						ReaderBiasedLock::ReadGuard lock(m_Lock);
+						if (!m_IsEvicted)
+						{
+							return lock;
+						}
+					}
+					Reload();
+				}
+			}
+			ReaderBiasedLock::WriteGuard LockExclusive()
+			{
+				ReaderBiasedLock::WriteGuard lock(m_Lock);
+				if (m_IsEvicted)
+				{
+					LoadEvicted();
+				}
+				return lock;
+			}
+			SharedSectionLock LockSectionShared(const FoldedName& section)
 			{
-				return kxf::ReadLockGuard(m_Lock);
+				for (;;)
+				{
+					{
+						ReaderBiasedLock::ReadGuard lock(m_Lock);
+						if (!m_IsEvicted)
+						{
+							return {std::move(lock), ReaderBiasedLock::ReadGuard(GetSectionLock(section))};
+						}
+					}
+					Reload();
+				}
 			}
-			auto LockExclusive()
+			ExclusiveSectionLock LockSectionExclusive(const FoldedName& section)
 			{
-				return kxf::WriteLockGuard(m_Lock);
+				for (;;)
+				{
+					{
+						ReaderBiasedLock::ReadGuard lock(m_Lock);
+						if (!m_IsEvicted)
+						{
+							return {std::move(lock), ReaderBiasedLock::WriteGuard(GetSectionLock(section))};
+						}
+					}
+					Reload();
+				}
 			}
 	};
 }
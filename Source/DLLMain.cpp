@@ -3,7 +3,7 @@
 
 BOOL APIENTRY DllMain(HMODULE module, DWORD event, LPVOID lpReserved)
 {
-	return PPR::Redirector::DllMain(module, event);
+	return PPR::Redirector::DllMain(module, event, lpReserved);
 }
 void DummyFunction()
 {
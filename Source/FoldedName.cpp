@@ -0,0 +1,93 @@
+#include "stdafx.h"
+#include "FoldedName.h"
+#include <emmintrin.h>
+
+namespace
+{
+	// Upper-cases the rest of the name the moment any non-ASCII character is found. The invariant locale maps every
+	// code unit to exactly one code unit, so the folded name keeps its length and the surrogate pairs stay together.
+	void FoldNonASCII(const wchar_t* source, wchar_t* destination, size_t length) noexcept
+	{
+		if (::LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_UPPERCASE, source, static_cast<int>(length), destination, static_cast<int>(length), nullptr, nullptr, 0) != static_cast<int>(length))
+		{
+			std::copy_n(source, length, destination);
+		}
+	}
+}
+
+namespace PPR
+{
+	void FoldedName::Fold(const wchar_t* source, wchar_t* destination, size_t length) noexcept
+	{
+		static_assert(sizeof(wchar_t) == sizeof(uint16_t));
+
+		const __m128i nonASCIIMask = _mm_set1_epi16(static_cast<short>(0xFF80));
+		const __m128i lowerFirst = _mm_set1_epi16('a' - 1);
+		const __m128i lowerLast = _mm_set1_epi16('z' + 1);
+		const __m128i caseBit = _mm_set1_epi16(0x20);
+
+		size_t i = 0;
+		for (; i + 8 <= length; i += 8)
+		{
+			const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chars, nonASCIIMask), _mm_setzero_si128())) != 0xFFFF)
+			{
+				FoldNonASCII(source + i, destination + i, length - i);
+				return;
+			}
+
+			// Signed comparisons are fine here as all the characters are below 0x80
+			const __m128i isLower = _mm_and_si128(_mm_cmpgt_epi16(chars, lowerFirst), _mm_cmplt_epi16(chars, lowerLast));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_sub_epi16(chars, _mm_and_si128(isLower, caseBit)));
+		}
+
+		for (; i < length; i++)
+		{
+			const wchar_t c = source[i];
+			if (c < 0x80)
+			{
+				destination[i] = c >= L'a' && c <= L'z' ? c - 0x20 : c;
+			}
+			else
+			{
+				FoldNonASCII(source + i, destination + i, length - i);
+				return;
+			}
+		}
+	}
+	size_t FoldedName::GetHash(kxf::StringView folded) noexcept
+	{
+		// FNV-1a, with the parameters matching the width of 'size_t'
+		#if _WIN64
+		constexpr size_t offsetBasis = 14695981039346656037ull;
+		constexpr size_t prime = 1099511628211ull;
+		#else
+		constexpr size_t offsetBasis = 2166136261u;
+		constexpr size_t prime = 16777619u;
+		#endif
+
+		size_t hash = offsetBasis;
+		for (wchar_t c: folded)
+		{
+			hash ^= static_cast<size_t>(c);
+			hash *= prime;
+		}
+		return hash;
+	}
+
+	FoldedName::FoldedName(kxf::StringView name)
+		:m_Original(name)
+	{
+		wchar_t* buffer = m_InlineBuffer;
+		if (name.length() > std::size(m_InlineBuffer))
+		{
+			m_HeapBuffer = std::make_unique<wchar_t[]>(name.length());
+			buffer = m_HeapBuffer.get();
+		}
+
+		Fold(name.data(), buffer, name.length());
+		m_Folded = {buffer, name.length()};
+		m_Hash = GetHash(m_Folded);
+	}
+}
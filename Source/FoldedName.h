@@ -0,0 +1,88 @@
+#pragma once
+#include "stdafx.h"
+
+namespace PPR
+{
+	// Section or key name upper-cased and hashed once, so the index lookups, the section lock selection and the value
+	// cache don't have to fold the name again. Comparing two folded names is a length check and a 'memcmp'.
+	// The original name isn't copied, it has to outlive the object.
+	class FoldedName final
+	{
+		public:
+			static constexpr size_t InlineCapacity = 64;
+
+			// Transparent hash and comparison for the containers keyed by the already folded strings
+			struct Hash final
+			{
+				using is_transparent = void;
+
+				size_t operator()(kxf::StringView folded) const noexcept
+				{
+					return GetHash(folded);
+				}
+				size_t operator()(const FoldedName& name) const noexcept
+				{
+					return name.GetHash();
+				}
+			};
+			struct Equal final
+			{
+				using is_transparent = void;
+
+				bool operator()(kxf::StringView left, kxf::StringView right) const noexcept
+				{
+					return IsSame(left, right);
+				}
+				bool operator()(const FoldedName& left, kxf::StringView right) const noexcept
+				{
+					return IsSame(left.GetFolded(), right);
+				}
+				bool operator()(kxf::StringView left, const FoldedName& right) const noexcept
+				{
+					return IsSame(left, right.GetFolded());
+				}
+			};
+
+			// Upper-cases ASCII characters eight at a time, the names with other characters go through 'LCMapStringEx' with the invariant locale
+			static void Fold(const wchar_t* source, wchar_t* destination, size_t length) noexcept;
+			static size_t GetHash(kxf::StringView folded) noexcept;
+
+			static bool IsSame(kxf::StringView left, kxf::StringView right) noexcept
+			{
+				return left.length() == right.length() && std::memcmp(left.data(), right.data(), left.length() * sizeof(wchar_t)) == 0;
+			}
+
+		private:
+			kxf::StringView m_Original;
+			kxf::StringView m_Folded;
+			size_t m_Hash = 0;
+
+			std::unique_ptr<wchar_t[]> m_HeapBuffer;
+			wchar_t m_InlineBuffer[InlineCapacity];
+
+		public:
+			FoldedName(kxf::StringView name);
+			FoldedName(const kxf::String& name)
+				:FoldedName(kxf::StringViewOf(name))
+			{
+			}
+			FoldedName(const FoldedName&) = delete;
+
+		public:
+			kxf::StringView GetOriginal() const noexcept
+			{
+				return m_Original;
+			}
+			kxf::StringView GetFolded() const noexcept
+			{
+				return m_Folded;
+			}
+			size_t GetHash() const noexcept
+			{
+				return m_Hash;
+			}
+
+		public:
+			FoldedName& operator=(const FoldedName&) = delete;
+	};
+}
@@ -19,6 +19,28 @@ namespace PPR::Internal
 
 		DWORD(WINAPI* GetSectionA)(LPCSTR, LPSTR, DWORD, LPCSTR) = nullptr;
 		DWORD(WINAPI* GetSectionW)(LPCWSTR, LPWSTR, DWORD, LPCWSTR) = nullptr;
+
+		BOOL(WINAPI* WriteSectionA)(LPCSTR, LPCSTR, LPCSTR) = nullptr;
+		BOOL(WINAPI* WriteSectionW)(LPCWSTR, LPCWSTR, LPCWSTR) = nullptr;
+
+		BOOL(WINAPI* GetStructA)(LPCSTR, LPCSTR, LPVOID, UINT, LPCSTR) = nullptr;
+		BOOL(WINAPI* GetStructW)(LPCWSTR, LPCWSTR, LPVOID, UINT, LPCWSTR) = nullptr;
+
+		BOOL(WINAPI* WriteStructA)(LPCSTR, LPCSTR, LPVOID, UINT, LPCSTR) = nullptr;
+		BOOL(WINAPI* WriteStructW)(LPCWSTR, LPCWSTR, LPVOID, UINT, LPCWSTR) = nullptr;
+
+		// Non-private (win.ini) variants
+		DWORD(WINAPI* GetProfileStringA)(LPCSTR, LPCSTR, LPCSTR, LPSTR, DWORD) = nullptr;
+		DWORD(WINAPI* GetProfileStringW)(LPCWSTR, LPCWSTR, LPCWSTR, LPWSTR, DWORD) = nullptr;
+
+		UINT(WINAPI* GetProfileIntA)(LPCSTR, LPCSTR, INT) = nullptr;
+		UINT(WINAPI* GetProfileIntW)(LPCWSTR, LPCWSTR, INT) = nullptr;
+
+		DWORD(WINAPI* GetProfileSectionA)(LPCSTR, LPSTR, DWORD) = nullptr;
+		DWORD(WINAPI* GetProfileSectionW)(LPCWSTR, LPWSTR, DWORD) = nullptr;
+
+		BOOL(WINAPI* WriteProfileStringA)(LPCSTR, LPCSTR, LPCSTR) = nullptr;
+		BOOL(WINAPI* WriteProfileStringW)(LPCWSTR, LPCWSTR, LPCWSTR) = nullptr;
 	};
 }
 
@@ -1,47 +1,168 @@
 #include "stdafx.h"
 #include "INIWrapper.h"
+#include "Transcoder.h"
 #include <kxf/FileSystem/NativeFileSystem.h>
 #include <kxf/System/Win32Error.h>
 #include <kxf/IO/MemoryStream.h>
-#include <kxf/IO/StreamReaderWriter.h>
 #include <kxf/IO/NativeFileStream.h>
 #include <kxf/Utility/Callback.h>
 
 namespace
 {
+	using PPR::INIWrapper;
+	using PPR::Transcoder;
+
 	constexpr uint8_t BOM_UTF8[] = {0xEF, 0xBB, 0xBF};
 	constexpr uint8_t BOM_UTF16_LE[] = {0xFF, 0xFE};
 	constexpr uint8_t BOM_UTF16_BE[] = {0xFE, 0xFF};
 	constexpr uint8_t BOM_UTF32_LE[] = {0xFF, 0xFE, 0x00, 0x00};
 	constexpr uint8_t BOM_UTF32_BE[] = {0x00, 0x00, 0xFE, 0xFF};
 
-	template<class T>
-	bool TestBOM(const kxf::MemoryStreamBuffer& buffer, const T& bom) noexcept
+	struct EncodingInfo final
+	{
+		INIWrapper::Encoding Encoding;
+		Transcoder::Format Format;
+		std::span<const uint8_t> BOM;
+		const char* Name;
+	};
+
+	// In the order the BOMs are tested in, the UTF-32LE one starts with the UTF-16LE one
+	constexpr EncodingInfo Encodings[] =
+	{
+		{INIWrapper::Encoding::UTF8, Transcoder::Format::UTF8, BOM_UTF8, "UTF-8"},
+		{INIWrapper::Encoding::UTF32LE, Transcoder::Format::UTF32LE, BOM_UTF32_LE, "UTF-32LE"},
+		{INIWrapper::Encoding::UTF32BE, Transcoder::Format::UTF32BE, BOM_UTF32_BE, "UTF-32BE"},
+		{INIWrapper::Encoding::UTF16LE, Transcoder::Format::UTF16LE, BOM_UTF16_LE, "UTF-16LE"},
+		{INIWrapper::Encoding::UTF16BE, Transcoder::Format::UTF16BE, BOM_UTF16_BE, "UTF-16BE"}
+	};
+
+	const EncodingInfo& GetEncodingInfo(INIWrapper::Encoding encoding) noexcept
 	{
-		if (buffer.GetBufferSize() >= std::size(bom))
+		for (const EncodingInfo& info: Encodings)
 		{
-			return std::memcmp(buffer.GetBufferStart(), bom, std::size(bom)) == 0;
+			if (info.Encoding == encoding)
+			{
+				return info;
+			}
 		}
-		return false;
+
+		// 'None' and 'Auto'
+		return Encodings[0];
 	}
 
-	template<class T>
-	bool TestAndSkipBOM(kxf::MemoryStreamBuffer& buffer, const T& bom) noexcept
+	const EncodingInfo* TestAndSkipBOM(kxf::MemoryStreamBuffer& buffer) noexcept
 	{
-		if (TestBOM(buffer, bom))
+		for (const EncodingInfo& info: Encodings)
 		{
-			buffer.Seek(std::size(bom), kxf::IOStreamSeek::FromStart);
-			return true;
+			if (buffer.GetBufferSize() >= info.BOM.size() && std::memcmp(buffer.GetBufferStart(), info.BOM.data(), info.BOM.size()) == 0)
+			{
+				buffer.Seek(info.BOM.size(), kxf::IOStreamSeek::FromStart);
+				return &info;
+			}
 		}
-		return false;
+		return nullptr;
 	}
 }
 
 namespace PPR
 {
-	std::optional<kxf::String> INIWrapper::ExtractValue(kxf::String value) const
+	void INIWrapper::ResetIndex(size_t sizeHint)
+	{
+		// Release the old arena before allocating the new one
+		m_Index = nullptr;
+		m_Index = std::make_unique<IndexStorage>(sizeHint, &m_IndexMemory);
+		m_IndexOverwrites = 0;
+		m_InternedBytes = 0;
+		m_IndexVersion++;
+		m_ValueCache.InvalidateAll();
+		DiscardPerfectHash();
+	}
+	void INIWrapper::BuildIndex(size_t sizeHint)
 	{
-		return std::move(value);
+		ResetIndex(sizeHint);
+
+		SectionMap& sections = m_Index->Sections;
+		for (const kxf::String& sectionName: GetSectionNames())
+		{
+			ValueMap& values = sections.emplace(std::piecewise_construct, std::forward_as_tuple(FoldedName(sectionName)), std::forward_as_tuple()).first->second;
+			for (const kxf::String& keyName: GetKeyNames(sectionName))
+			{
+				if (auto value = m_INI.IniQueryValue(sectionName, keyName))
+				{
+					values.emplace(std::piecewise_construct, std::forward_as_tuple(FoldedName(keyName)), std::forward_as_tuple(StoreValue(*m_Index, kxf::StringViewOf(*value), true)));
+				}
+			}
+		}
+	}
+	void INIWrapper::CompactIndex()
+	{
+		KX_SCOPEDLOG_ARGS(m_IndexOverwrites.load(), m_IndexMemory.GetStats().AllocatedBytes);
+
+		// Names are re-created inside the new arena by the copy, values have to be stored again as they're only views
+		auto storage = std::make_unique<IndexStorage>(m_IndexMemory.GetStats().AllocatedBytes / 2, &m_IndexMemory);
+		m_InternedBytes = 0;
+		for (const auto& [sectionName, values]: m_Index->Sections)
+		{
+			ValueMap& newValues = storage->Sections.emplace(std::piecewise_construct, std::forward_as_tuple(sectionName), std::forward_as_tuple()).first->second;
+			for (const auto& [keyName, value]: values)
+			{
+				newValues.emplace(keyName, StoreValue(*storage, value, false));
+			}
+		}
+
+		m_Index = std::move(storage);
+		m_IndexOverwrites = 0;
+		m_IndexCompactions++;
+		m_IndexVersion++;
+
+		// The values in the table are views into the old arena
+		DiscardPerfectHash();
+
+		KX_SCOPEDLOG.Info().Format("Index compacted, allocated bytes: {}", m_IndexMemory.GetStats().AllocatedBytes);
+		KX_SCOPEDLOG.SetSuccess();
+	}
+
+	IndexValue INIWrapper::StoreValue(IndexStorage& storage, const IndexValue& value, bool addToPool)
+	{
+		// Wide values containing only ASCII characters are narrowed first
+		const bool isASCII = value.IsASCII() || IndexValue::IsASCII(value.GetWide());
+
+		// Only the loaded values are added to the pool, the written ones just reuse the existing entries.
+		// Values written at runtime are often unique (timestamps, positions) and the pool never shrinks.
+		if (isASCII)
+		{
+			auto pooled = value.IsASCII() ? ValuePool::GetInstance().Intern(value.GetASCII(), addToPool) : ValuePool::GetInstance().Intern(value.GetWide(), addToPool);
+			if (pooled)
+			{
+				m_InternedBytes += ValuePool::GetStorageSize(*pooled);
+				return *pooled;
+			}
+
+			auto data = static_cast<char*>(storage.SynchronizedArena.allocate(value.GetLength() + 1, alignof(char)));
+			if (value.IsASCII())
+			{
+				std::copy_n(value.GetASCII().data(), value.GetLength(), data);
+			}
+			else
+			{
+				kxf::StringView wide = value.GetWide();
+				std::transform(wide.begin(), wide.end(), data, [](wchar_t c)
+				{
+					return static_cast<char>(c);
+				});
+			}
+			data[value.GetLength()] = 0;
+
+			return std::string_view(data, value.GetLength());
+		}
+		else
+		{
+			auto data = static_cast<wchar_t*>(storage.SynchronizedArena.allocate((value.GetLength() + 1) * sizeof(wchar_t), alignof(wchar_t)));
+			std::copy_n(value.GetWide().data(), value.GetLength(), data);
+			data[value.GetLength()] = 0;
+
+			return kxf::StringView(data, value.GetLength());
+		}
 	}
 
 	bool INIWrapper::Load(const kxf::FSPath& path, kxf::FlagSet<kxf::INIDocumentOption> options)
@@ -50,6 +171,8 @@ namespace PPR
 
 		m_INI.ClearNode();
 		m_INI.SetOptions(options);
+		m_DocumentSize = 0;
+		ResetIndex();
 
 		kxf::NativeFileStream fileStream;
 		if (fileStream.Open(path, kxf::IOStreamAccess::Read, kxf::IOStreamDisposition::OpenExisting, kxf::IOStreamShare::Read))
@@ -62,84 +185,47 @@ namespace PPR
 
 				auto& buffer = memoryStream.GetStreamBuffer();
 				buffer.Rewind();
+				m_DocumentSize = buffer.GetBufferSize() * sizeof(wchar_t);
 
-				auto LoadUTF8 = [&]()
-				{
-					m_Encoding = Encoding::UTF8;
-					return m_INI.Load(std::span{reinterpret_cast<const char8_t*>(buffer.GetBufferCurrent()), buffer.GetBytesLeft()});
-				};
-				auto LoadUTF16LE = [&]()
-				{
-					m_Encoding = Encoding::UTF16LE;
-					return m_INI.Load(kxf::String(reinterpret_cast<const wchar_t*>(buffer.GetBufferCurrent()), buffer.GetBytesLeft() / sizeof(wchar_t)));
-				};
-				auto LoadUTF32LE = [&]()
-				{
-					kxf::MemoryInputStream stream(buffer.GetBufferCurrent(), buffer.GetBytesLeft());
-					kxf::IO::InputStreamReader reader(stream);
+				m_Options.Remove(Options::WithBOM);
 
-					m_Encoding = Encoding::UTF32LE;
-					return m_INI.Load(reader.ReadStringUTF32(buffer.GetBytesLeft() / sizeof(uint32_t)));
-				};
-
-				if (TestAndSkipBOM(buffer, BOM_UTF8))
+				const EncodingInfo* encoding = TestAndSkipBOM(buffer);
+				if (encoding)
 				{
-					KX_SCOPEDLOG.Info() << "UTF-8 BOM detected";
-
+					KX_SCOPEDLOG.Info().Format("{} BOM detected", encoding->Name);
 					m_Options.Add(Options::WithBOM);
-					if (LoadUTF8())
-					{
-						KX_SCOPEDLOG.LogReturn(true);
-						return true;
-					}
 				}
-				else if (TestAndSkipBOM(buffer, BOM_UTF32_LE))
+				else
 				{
-					KX_SCOPEDLOG.Info() << "UTF-32LE BOM detected";
-
-					m_Options.Add(Options::WithBOM);
-					if (LoadUTF32LE())
-					{
-						KX_SCOPEDLOG.LogReturn(true);
-						return true;
-					}
+					KX_SCOPEDLOG.Info() << "No known BOM detected, trying to load as UTF-8";
+					encoding = &GetEncodingInfo(Encoding::UTF8);
 				}
-				else if (TestAndSkipBOM(buffer, BOM_UTF32_BE))
-				{
-					KX_SCOPEDLOG.Info() << "UTF-32BE BOM detected";
-
-					m_Options.Add(Options::WithBOM);
-					m_Encoding = Encoding::UTF32BE;
+				m_Encoding = encoding->Encoding;
 
-					KX_SCOPEDLOG.Error() << "Unsupported encoding";
-				}
-				else if (TestAndSkipBOM(buffer, BOM_UTF16_LE))
+				bool isLoaded = false;
+				std::wstring text;
+				const std::span data(reinterpret_cast<const uint8_t*>(buffer.GetBufferCurrent()), buffer.GetBytesLeft());
+				if (Transcoder::Decode(data, encoding->Format, text))
 				{
-					KX_SCOPEDLOG.Info() << "UTF-16LE BOM detected";
-
-					if (LoadUTF16LE())
-					{
-						KX_SCOPEDLOG.LogReturn(true);
-						return true;
-					}
+					isLoaded = m_INI.Load(kxf::String(std::move(text)));
 				}
-				else if (TestAndSkipBOM(buffer, BOM_UTF16_BE))
+				else if (m_Encoding == Encoding::UTF8)
 				{
-					KX_SCOPEDLOG.Info() << "UTF-16BE BOM detected";
-
-					m_Options.Add(Options::WithBOM);
-					m_Encoding = Encoding::UTF16BE;
-
-					KX_SCOPEDLOG.Error() << "Unsupported encoding";
+					// Most likely an ANSI file, let the document handle it as it always did
+					KX_SCOPEDLOG.Warning() << "Invalid UTF-8 text, loading the file as is";
+					isLoaded = m_INI.Load(std::span{reinterpret_cast<const char8_t*>(data.data()), data.size()});
 				}
 				else
 				{
-					KX_SCOPEDLOG.Info() << "No known BOM detected, trying to load as UTF-8";
-					if (LoadUTF8())
-					{
-						KX_SCOPEDLOG.LogReturn(true);
-						return true;
-					}
+					KX_SCOPEDLOG.Error().Format("Malformed {} text", encoding->Name);
+				}
+
+				if (isLoaded)
+				{
+					BuildIndex(buffer.GetBufferSize() * 4);
+
+					KX_SCOPEDLOG.LogReturn(true);
+					return true;
 				}
 			}
 		}
@@ -148,10 +234,18 @@ namespace PPR
 			KX_SCOPEDLOG.Error().Format("Can't open file to read: {}", kxf::Win32Error::GetLastError());
 		}
 
+		m_DocumentSize = 0;
 		KX_SCOPEDLOG.LogReturn(false);
 		KX_SCOPEDLOG.SetFail();
 		return false;
 	}
+	void INIWrapper::Unload()
+	{
+		m_INI.ClearNode();
+		m_DocumentSize = 0;
+		ResetIndex();
+		m_ValueCache.Free();
+	}
 	bool INIWrapper::Save(const kxf::FSPath& path, Encoding encoding)
 	{
 		KX_SCOPEDLOG_ARGS(path.GetFullPath(), encoding);
@@ -171,76 +265,163 @@ namespace PPR
 			encoding = m_Encoding;
 		}
 
-		const bool addSignature = m_Options.Contains(Options::WithBOM);
-		switch (encoding)
+		const EncodingInfo& info = GetEncodingInfo(encoding);
+		KX_SCOPEDLOG.Info().Format("Saving as {}", info.Name);
+
+		// The text is encoded into a small buffer which is written whenever it fills up, instead of encoding the whole document at once
+		constexpr size_t chunkLength = 16 * 1024;
+		std::vector<uint8_t> chunk;
+		chunk.reserve(info.BOM.size() + chunkLength * sizeof(uint32_t));
+
+		auto Flush = [&]()
 		{
-			case Encoding::None:
-			case Encoding::Auto:
-			case Encoding::UTF8:
-			{
-				KX_SCOPEDLOG.Info() << "Saving as UTF-8";
+			const bool isWritten = chunk.empty() || fileStream.Write(chunk.data(), chunk.size()).LastWrite() == chunk.size();
+			chunk.clear();
+			return isWritten;
+		};
 
-				if (addSignature)
-				{
-					KX_SCOPEDLOG.Info() << "Writing BOM";
-					fileStream.Write(BOM_UTF8, std::size(BOM_UTF8));
-				}
-				
-				if (m_INI.Save(fileStream))
-				{
-					KX_SCOPEDLOG.LogReturn(true);
-					return true;
-				}
-				break;
+		if (m_Options.Contains(Options::WithBOM))
+		{
+			KX_SCOPEDLOG.Info() << "Writing BOM";
+			chunk.assign(info.BOM.begin(), info.BOM.end());
+		}
+
+		const kxf::String document = m_INI.Save();
+		kxf::StringView text = kxf::StringViewOf(document);
+		bool isWritten = true;
+		do
+		{
+			const size_t length = Transcoder::GetChunkLength(text, chunkLength);
+			Transcoder::Encode(text.substr(0, length), info.Format, chunk);
+			text.remove_prefix(length);
+
+			isWritten = Flush();
+		}
+		while (isWritten && !text.empty());
+
+		if (isWritten)
+		{
+			KX_SCOPEDLOG.LogReturn(true);
+			return true;
+		}
+
+		KX_SCOPEDLOG.LogReturn(false);
+		KX_SCOPEDLOG.SetFail();
+		return false;
+	}
+
+	bool INIWrapper::SetValue(const FoldedName& section, const FoldedName& key, const kxf::String& value, bool* sameData)
+	{
+		// Single probe into the index, the returned slot is reused both for the comparison and for the assignment
+		SectionMap& sections = m_Index->Sections;
+		auto sectionIt = sections.find(section);
+
+		ValueMap* values = sectionIt != sections.end() ? &sectionIt->second : nullptr;
+		ValueMap::iterator it;
+		if (values)
+		{
+			it = values->find(key);
+			if (it != values->end() && it->second.IsSameAs(kxf::StringViewOf(value)))
+			{
+				kxf::Utility::SetIfNotNull(sameData, true);
+				return true;
 			}
-			case Encoding::UTF16LE:
+		}
+
+		kxf::Utility::SetIfNotNull(sameData, false);
+		if (kxf::WriteLockGuard lock(m_DocumentLock); m_INI.IniSetValue(kxf::String(section.GetOriginal()), kxf::String(key.GetOriginal()), value))
+		{
+			// The index gets the new section only once the document has it as well
+			if (!values)
 			{
-				KX_SCOPEDLOG.Info() << "Saving as UTF-16LE";
+				values = &sections.emplace(std::piecewise_construct, std::forward_as_tuple(section), std::forward_as_tuple()).first->second;
+				it = values->end();
+			}
 
-				auto content = m_INI.Save();
-				if (addSignature)
+			if (it != values->end())
+			{
+				// The index only holds read-only views, so the new value is always stored again. The old one becomes a dead string
+				// if it was in our own arena, the pooled values are shared and stay where they are.
+				const IndexValue oldValue = it->second;
+				it->second = StoreValue(*m_Index, kxf::StringViewOf(value), false);
+				if (!OnValueReleased(oldValue))
 				{
-					KX_SCOPEDLOG.Info() << "Writing BOM";
-					fileStream.Write(BOM_UTF16_LE, std::size(BOM_UTF16_LE));
+					OnIndexOverwrite();
 				}
 
-				kxf::IO::OutputStreamWriter writer(fileStream);
-				if (writer.WriteStringUTF16(content))
+				if (m_PerfectHash)
 				{
-					KX_SCOPEDLOG.LogReturn(true);
-					return true;
+					m_PerfectHash->Update(section, key, it->second);
 				}
-				break;
 			}
-			case Encoding::UTF32LE:
+			else
 			{
-				KX_SCOPEDLOG.Info() << "Saving as UTF-32LE";
+				it = values->emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(StoreValue(*m_Index, kxf::StringViewOf(value), false))).first;
 
-				auto content = m_INI.Save();
-				if (addSignature)
+				// New keys aren't in the table, including the removed ones written again
+				OnStructuralWrite();
+			}
+			m_IndexVersion++;
+			m_ValueCache.Store(GetValueCacheHash(section, key), section.GetFolded(), key.GetFolded(), kxf::StringViewOf(value), true);
+
+			return true;
+		}
+		return false;
+	}
+	bool INIWrapper::DeleteSection(const FoldedName& section)
+	{
+		if (kxf::WriteLockGuard lock(m_DocumentLock); m_INI.RemoveSection(kxf::String(section.GetOriginal())))
+		{
+			if (auto it = m_Index->Sections.find(section); it != m_Index->Sections.end())
+			{
+				for (const auto& [keyName, value]: it->second)
 				{
-					KX_SCOPEDLOG.Info() << "Writing BOM";
-					fileStream.Write(BOM_UTF32_LE, std::size(BOM_UTF32_LE));
+					OnValueReleased(value);
 				}
+				m_Index->Sections.erase(it);
+				OnIndexOverwrite();
+			}
+			m_IndexVersion++;
+			m_ValueCache.InvalidateAll();
+			DiscardPerfectHash();
 
-				kxf::IO::OutputStreamWriter writer(fileStream);
-				if (writer.WriteStringUTF16(content))
+			return true;
+		}
+		return false;
+	}
+	bool INIWrapper::DeleteKey(const FoldedName& section, const FoldedName& key)
+	{
+		if (kxf::WriteLockGuard lock(m_DocumentLock); m_INI.RemoveValue(kxf::String(section.GetOriginal()), kxf::String(key.GetOriginal())))
+		{
+			if (auto sectionIt = m_Index->Sections.find(section); sectionIt != m_Index->Sections.end())
+			{
+				ValueMap& values = sectionIt->second;
+				if (auto it = values.find(key); it != values.end())
 				{
-					KX_SCOPEDLOG.LogReturn(true);
-					return true;
+					// The table views the name of the key, it has to be removed from there first
+					if (m_PerfectHash)
+					{
+						m_PerfectHash->Remove(section, key);
+					}
+
+					OnValueReleased(it->second);
+					values.erase(it);
+					OnIndexOverwrite();
 				}
-				break;
 			}
-		};
+			OnStructuralWrite();
+			m_IndexVersion++;
+			m_ValueCache.Invalidate(GetValueCacheHash(section, key));
 
-		KX_SCOPEDLOG.LogReturn(false);
-		KX_SCOPEDLOG.SetFail();
+			return true;
+		}
 		return false;
 	}
 
 	std::vector<kxf::String> INIWrapper::GetSectionNames() const
 	{
 		std::vector<kxf::String> items;
+		kxf::ReadLockGuard lock(m_DocumentLock);
 		m_INI.EnumSectionNames(kxf::Utility::MoveToVectorCallback(items));
 
 		return items;
@@ -248,6 +429,7 @@ namespace PPR
 	std::vector<kxf::String> INIWrapper::GetKeyNames(const kxf::String& section) const
 	{
 		std::vector<kxf::String> items;
+		kxf::ReadLockGuard lock(m_DocumentLock);
 		m_INI.EnumKeyNames(section, kxf::Utility::MoveToVectorCallback(items));
 
 		return items;
@@ -1,7 +1,16 @@
 #pragma once
 #include "stdafx.h"
+#include "MemoryResource.h"
+#include "OptimisticValueCache.h"
+#include "ValuePool.h"
+#include "IndexValue.h"
+#include "FoldedName.h"
+#include "PerfectHashIndex.h"
 #include <kxf/Serialization/INI.h>
 #include <kxf/Core/IEncodingConverter.h>
+#include <kxf/Threading/ReadWriteLock.h>
+#include <kxf/Threading/LockGuard.h>
+#include <unordered_map>
 
 namespace PPR
 {
@@ -27,14 +36,20 @@ namespace PPR
 
 			template<class TChar>
 			static auto EncodingFrom(const kxf::String& str, kxf::IEncodingConverter& converter)
+			{
+				return EncodingFrom<TChar>(kxf::StringViewOf(str), converter);
+			}
+
+			template<class TChar>
+			static auto EncodingFrom(kxf::StringView str, kxf::IEncodingConverter& converter)
 			{
 				if constexpr(std::is_same_v<TChar, char>)
 				{
-					return converter.ToMultiByte(kxf::StringViewOf(str));
+					return converter.ToMultiByte(str);
 				}
 				else if constexpr(std::is_same_v<TChar, wchar_t>)
 				{
-					return str.wc_view();
+					return str;
 				}
 				else
 				{
@@ -142,15 +157,161 @@ namespace PPR
 			}
 
 		private:
+			// Names are stored already folded along with their hash, see 'FoldedName'
+			using IndexString = std::pmr::wstring;
+			struct IndexName final
+			{
+				using allocator_type = std::pmr::polymorphic_allocator<wchar_t>;
+
+				IndexString Folded;
+				size_t Hash = 0;
+
+				IndexName(const FoldedName& name, const allocator_type& allocator)
+					:Folded(name.GetFolded(), allocator), Hash(name.GetHash())
+				{
+				}
+				IndexName(const IndexName& other, const allocator_type& allocator)
+					:Folded(other.Folded, allocator), Hash(other.Hash)
+				{
+				}
+			};
+			struct NameHash final
+			{
+				using is_transparent = void;
+
+				size_t operator()(const IndexName& name) const noexcept
+				{
+					return name.Hash;
+				}
+				size_t operator()(const FoldedName& name) const noexcept
+				{
+					return name.GetHash();
+				}
+			};
+			struct NameEqual final
+			{
+				using is_transparent = void;
+
+				bool operator()(const IndexName& left, const IndexName& right) const noexcept
+				{
+					return left.Hash == right.Hash && FoldedName::IsSame(left.Folded, right.Folded);
+				}
+				bool operator()(const FoldedName& left, const IndexName& right) const noexcept
+				{
+					return left.GetHash() == right.Hash && FoldedName::IsSame(left.GetFolded(), right.Folded);
+				}
+				bool operator()(const IndexName& left, const FoldedName& right) const noexcept
+				{
+					return operator()(right, left);
+				}
+			};
+
+			// Section -> (key -> value) lookup index mirroring the document content. All value queries are served from here
+			// and the document itself is only used for enumeration, loading and saving. Values are views either into
+			// the shared 'ValuePool' or into a null-terminated copy allocated from the arena, see 'StoreValue'.
+			// ASCII-only values take one byte per character, see 'IndexValue'.
+			using ValueMap = std::pmr::unordered_map<IndexName, IndexValue, NameHash, NameEqual>;
+			using SectionMap = std::pmr::unordered_map<IndexName, ValueMap, NameHash, NameEqual>;
+
+			// The index lives entirely inside a monotonic arena, so building and releasing it costs a handful of large blocks
+			// instead of one heap node per section, key and value. This is on top of the document, which still allocates its
+			// own nodes. The arena is declared first to outlive the maps. Writers of different sections can allocate
+			// at the same time, hence the synchronized front.
+			struct IndexStorage final
+			{
+				std::pmr::monotonic_buffer_resource Arena;
+				SynchronizedMemoryResource SynchronizedArena;
+				SectionMap Sections;
+
+				IndexStorage(size_t sizeHint, std::pmr::memory_resource* upstream)
+					:Arena(std::max<size_t>(sizeHint, 4096), upstream), SynchronizedArena(&Arena), Sections(&SynchronizedArena)
+				{
+				}
+			};
+
+			// Number of overwrites (replaced values of the arena and deletions)
+			// after which the index is rebuilt into a fresh arena to get rid of the dead strings.
+			static constexpr size_t CompactionThreshold = 1024;
+
+			// Number of keys added or removed since the perfect hash was built after which it's rebuilt,
+			// the added keys aren't in the table and cost a second lookup.
+			static constexpr size_t PerfectHashRebuildThreshold = 64;
+
+		private:
+			// The document isn't thread-safe, its lock is taken around every access that can happen under a section lock
 			kxf::INIDocument m_INI;
+			mutable kxf::ReadWriteLock m_DocumentLock;
+
+			CountingMemoryResource m_IndexMemory;
+			std::unique_ptr<IndexStorage> m_Index;
+			std::atomic<size_t> m_IndexOverwrites = 0;
+			std::atomic<size_t> m_InternedBytes = 0;
+			size_t m_IndexCompactions = 0;
+
+			// Allocated by the first cached read, see 'OptimisticValueCache'
+			mutable OptimisticValueCache m_ValueCache;
+
+			// Optional perfect hash over the index, see 'PerfectHashIndex'. It's replaced only under the exclusive file lock,
+			// so the readers can use it with just their section locked. The version is bumped by every index change
+			// to detect writes made while a new table was being built.
+			std::unique_ptr<PerfectHashIndex> m_PerfectHash;
+			std::atomic<size_t> m_IndexVersion = 0;
+			std::atomic<size_t> m_StructuralWrites = 0;
+			std::atomic<bool> m_IsPerfectHashStale = true;
+
 			kxf::FlagSet<Options> m_Options;
 			Encoding m_Encoding = Encoding::None;
+			size_t m_DocumentSize = 0;
 
 		private:
-			std::optional<kxf::String> ExtractValue(kxf::String value) const;
+			void ResetIndex(size_t sizeHint = 0);
+			void BuildIndex(size_t sizeHint);
+			void CompactIndex();
+			IndexValue StoreValue(IndexStorage& storage, const IndexValue& value, bool addToPool);
+			void OnIndexOverwrite() noexcept
+			{
+				m_IndexOverwrites++;
+			}
+
+			// Returns true if the value was pooled, it no longer counts towards the interned bytes then
+			bool OnValueReleased(const IndexValue& value) noexcept
+			{
+				if (ValuePool::GetInstance().Contains(value))
+				{
+					m_InternedBytes -= ValuePool::GetStorageSize(value);
+					return true;
+				}
+				return false;
+			}
+			void OnStructuralWrite() noexcept
+			{
+				if (++m_StructuralWrites >= PerfectHashRebuildThreshold)
+				{
+					m_IsPerfectHashStale = true;
+				}
+			}
+			void DiscardPerfectHash() noexcept
+			{
+				m_PerfectHash = nullptr;
+				m_IsPerfectHashStale = true;
+			}
+
+			static size_t GetValueCacheHash(const FoldedName& section, const FoldedName& key) noexcept
+			{
+				return section.GetHash() * 31 + key.GetHash();
+			}
 
 		public:
-			INIWrapper() = default;
+			static size_t GetSectionHash(const FoldedName& section) noexcept
+			{
+				return section.GetHash();
+			}
+
+		public:
+			INIWrapper()
+			{
+				ResetIndex();
+			}
 
 		public:
 			bool IsEmpty() const noexcept
@@ -168,51 +329,179 @@ namespace PPR
 
 			bool Load(const kxf::FSPath& path, kxf::FlagSet<kxf::INIDocumentOption> options);
 			bool Save(const kxf::FSPath& path, Encoding encoding = Encoding::None);
+			void Unload();
 
-			std::optional<kxf::String> QueryValue(const kxf::String& section, const kxf::String& key) const
+			// Can be called with the section lock held, as well as 'SetValue' and 'DeleteKey'
+			// if the section already exists. Everything else requires the whole file to be locked.
+			bool HasSection(const FoldedName& section) const noexcept
 			{
-				if (auto value = m_INI.IniQueryValue(section, key))
+				return m_Index->Sections.contains(section);
+			}
+			std::optional<IndexValue> FindValue(const FoldedName& section, const FoldedName& key) const noexcept
+			{
+				if (m_PerfectHash)
 				{
-					return ExtractValue(std::move(*value));
+					if (auto value = m_PerfectHash->Find(section, key))
+					{
+						return value;
+					}
+
+					// Nothing was added since the table was built, so it has every key and a miss doesn't need the second lookup
+					if (m_StructuralWrites == 0)
+					{
+						return {};
+					}
+				}
+
+				const SectionMap& sections = m_Index->Sections;
+				if (auto sectionIt = sections.find(section); sectionIt != sections.end())
+				{
+					if (auto it = sectionIt->second.find(key); it != sectionIt->second.end())
+					{
+						return it->second;
+					}
 				}
 				return {};
 			}
-			kxf::String GetValue(const kxf::String& section, const kxf::String& key, kxf::String defaultValue = {}) const
+			std::optional<kxf::String> QueryValue(const FoldedName& section, const FoldedName& key) const
 			{
-				auto value = QueryValue(section, key);
-				return value ? std::move(*value) : std::move(defaultValue);
+				if (auto value = FindValue(section, key))
+				{
+					return value->ToString();
+				}
+				return {};
 			}
-			bool SetValue(const kxf::String& section, const kxf::String& key, const kxf::String& value, bool* sameData = nullptr)
+			kxf::String GetValue(const FoldedName& section, const FoldedName& key, kxf::String defaultValue = {}) const
 			{
-				if (sameData)
+				auto value = FindValue(section, key);
+				return value ? value->ToString() : std::move(defaultValue);
+			}
+			bool SetValue(const FoldedName& section, const FoldedName& key, const kxf::String& value, bool* sameData = nullptr);
+
+			// Lookup of the short values without the section lock, see 'OptimisticValueCache'. The file lock has to be held
+			// in shared mode, see 'ConfigObject::FindCachedValue'. A miss doesn't mean the value doesn't exist, the caller
+			// should take the section lock and use 'FindValue', then 'CacheValue' to make the next lookup succeed.
+			bool FindCachedValue(const FoldedName& section, const FoldedName& key, OptimisticValueCache::Value& value) const noexcept
+			{
+				return m_ValueCache.Load(GetValueCacheHash(section, key), section.GetFolded(), key.GetFolded(), value);
+			}
+			bool FindCachedValue(const FoldedName& section, const FoldedName& key, OptimisticValueCache::ParsedKind kind, uint64_t& parsed) const noexcept
+			{
+				return m_ValueCache.Load(GetValueCacheHash(section, key), section.GetFolded(), key.GetFolded(), kind, parsed);
+			}
+			void CacheValue(const FoldedName& section, const FoldedName& key, const IndexValue& value, OptimisticValueCache::ParsedKind kind = OptimisticValueCache::ParsedKind::None, uint64_t parsed = 0) const noexcept
+			{
+				// The cache keeps wide characters, ASCII values are widened here if they can fit into a slot at all
+				wchar_t buffer[OptimisticValueCache::SlotCapacity] = {};
+				kxf::StringView wideValue;
+				if (value.IsASCII())
 				{
-					auto oldValue = QueryValue(section, key);
-					if (!oldValue || *oldValue != value)
-					{
-						*sameData = false;
-						return m_INI.IniSetValue(section, key, value);
-					}
-					else
+					if (value.GetLength() > std::size(buffer))
 					{
-						*sameData = true;
-						return true;
+						return;
 					}
+
+					std::string_view ascii = value.GetASCII();
+					std::copy(ascii.begin(), ascii.end(), buffer);
+					wideValue = {buffer, ascii.length()};
 				}
 				else
 				{
-					return m_INI.IniSetValue(section, key, value);
+					wideValue = value.GetWide();
 				}
+				m_ValueCache.Store(GetValueCacheHash(section, key), section.GetFolded(), key.GetFolded(), wideValue, false, kind, parsed);
 			}
 
 			std::vector<kxf::String> GetSectionNames() const;
 			std::vector<kxf::String> GetKeyNames(const kxf::String& section) const;
-			bool DeleteSection(const kxf::String& section)
+			bool DeleteSection(const FoldedName& section);
+			bool DeleteKey(const FoldedName& section, const FoldedName& key);
+
+			// Dead strings are collected only when the whole file is locked, the writers of a single section just count them
+			bool IsCompactionNeeded() const noexcept
+			{
+				return m_IndexOverwrites >= CompactionThreshold;
+			}
+			void CompactIndexIfNeeded()
 			{
-				return m_INI.RemoveSection(section);
+				if (IsCompactionNeeded())
+				{
+					CompactIndex();
+				}
 			}
-			bool DeleteKey(const kxf::String& section, const kxf::String& key)
+
+			// The pairs are collected with the file locked in shared mode, every section is locked by the callback
+			// while its pairs are copied. The table is built after that without any locks and 'SetPerfectHash'
+			// installs it under the exclusive lock unless the index has changed since 'GetIndexVersion'.
+			bool IsPerfectHashNeeded() const noexcept
 			{
-				return m_INI.RemoveValue(section, key);
+				return m_IsPerfectHashStale;
+			}
+			size_t GetIndexVersion() const noexcept
+			{
+				return m_IndexVersion;
+			}
+			const PerfectHashIndex* GetPerfectHash() const noexcept
+			{
+				return m_PerfectHash.get();
+			}
+
+			template<class TFunc>
+			std::unique_ptr<PerfectHashIndex> CreatePerfectHash(TFunc&& lockSection) const
+			{
+				auto perfectHash = std::make_unique<PerfectHashIndex>();
+				for (const auto& [sectionName, values]: m_Index->Sections)
+				{
+					auto lock = std::invoke(lockSection, sectionName.Hash);
+					for (const auto& [keyName, value]: values)
+					{
+						perfectHash->Add(sectionName.Folded, sectionName.Hash, keyName.Folded, keyName.Hash, value);
+					}
+				}
+				return perfectHash;
+			}
+			bool SetPerfectHash(std::unique_ptr<PerfectHashIndex> perfectHash, size_t indexVersion) noexcept
+			{
+				if (m_IndexVersion == indexVersion)
+				{
+					m_PerfectHash = std::move(perfectHash);
+					m_StructuralWrites = 0;
+					m_IsPerfectHashStale = false;
+
+					return true;
+				}
+				return false;
+			}
+
+			// Same locking as 'CreatePerfectHash', every section is passed to 'onSection' before its keys are passed to 'onValue'
+			template<class TLockFunc, class TSectionFunc, class TValueFunc>
+			void EnumerateIndex(TLockFunc&& lockSection, TSectionFunc&& onSection, TValueFunc&& onValue) const
+			{
+				for (const auto& [sectionName, values]: m_Index->Sections)
+				{
+					auto lock = std::invoke(lockSection, sectionName.Hash);
+
+					std::invoke(onSection, kxf::StringView(sectionName.Folded));
+					for (const auto& [keyName, value]: values)
+					{
+						std::invoke(onValue, kxf::StringView(keyName.Folded), value);
+					}
+				}
+			}
+
+			// The document doesn't report its memory, it's estimated as the loaded text widened to 'wchar_t'
+			size_t GetMemoryUsage() const noexcept
+			{
+				return m_IndexMemory.GetStats().AllocatedBytes + (m_PerfectHash ? m_PerfectHash->GetMemorySize() : 0) + m_ValueCache.GetMemoryUsage() + m_DocumentSize;
+			}
+			MemoryStats GetMemoryStats() const noexcept
+			{
+				MemoryStats stats = m_IndexMemory.GetStats();
+				stats.IndexAllocations = m_Index ? m_Index->SynchronizedArena.GetAllocationCount() : 0;
+				stats.Compactions = m_IndexCompactions;
+				stats.InternedBytes = m_InternedBytes;
+
+				return stats;
 			}
 
 		public:
@@ -0,0 +1,127 @@
+#include "stdafx.h"
+#include "IdleSaveScheduler.h"
+#include "ConfigObject.h"
+#include "PrivateProfileRedirector.h"
+
+namespace PPR
+{
+	void IdleSaveScheduler::StartThread()
+	{
+		std::lock_guard lock(m_Mutex);
+		if (!m_Stop)
+		{
+			m_Thread = std::thread(&IdleSaveScheduler::RunThread, this);
+		}
+	}
+	void IdleSaveScheduler::RunThread()
+	{
+		std::unique_lock lock(m_Mutex);
+		while (!m_Stop)
+		{
+			if (m_PendingFiles.empty())
+			{
+				m_Condition.wait(lock);
+				continue;
+			}
+
+			// Find the files which deadlines have passed and the nearest deadline of the others
+			std::vector<ConfigObject*> dueFiles;
+			auto nextDeadline = Clock::time_point::max();
+			const auto now = Clock::now();
+
+			for (auto it = m_PendingFiles.begin(); it != m_PendingFiles.end();)
+			{
+				const auto deadline = GetDeadline(it->second);
+				if (deadline <= now)
+				{
+					dueFiles.push_back(it->first);
+					it = m_PendingFiles.erase(it);
+				}
+				else
+				{
+					nextDeadline = std::min(nextDeadline, deadline);
+					++it;
+				}
+			}
+
+			if (!dueFiles.empty())
+			{
+				// The writers take the file lock first and the scheduler lock second, so the scheduler lock
+				// has to be released before saving anything.
+				lock.unlock();
+				for (ConfigObject* configObject: dueFiles)
+				{
+					// Don't bring back a file that was saved and evicted in the meantime
+					ReaderBiasedLock::WriteGuard fileLock(configObject->m_Lock);
+					if (configObject->HasChanges())
+					{
+						kxf::Log::InfoCategory("SaveOnIdle", "Saving file on idle: '{}'", configObject->GetFilePath().GetFullPath());
+						if (configObject->SaveFile())
+						{
+							m_SaveCount++;
+						}
+					}
+				}
+				Redirector::GetInstance().GetSubscriptions().Deliver();
+				lock.lock();
+			}
+			else
+			{
+				m_Condition.wait_until(lock, nextDeadline);
+			}
+		}
+	}
+
+	IdleSaveScheduler::IdleSaveScheduler(std::chrono::milliseconds delay, std::chrono::milliseconds maxLatency)
+		:m_Delay(delay), m_MaxLatency(maxLatency)
+	{
+	}
+	IdleSaveScheduler::~IdleSaveScheduler()
+	{
+		Stop();
+	}
+
+	void IdleSaveScheduler::Schedule(ConfigObject& configObject)
+	{
+		// Don't start the thread from 'DllMain', do it with the first write instead
+		std::call_once(m_ThreadStarted, &IdleSaveScheduler::StartThread, this);
+
+		const auto now = Clock::now();
+		{
+			std::lock_guard lock(m_Mutex);
+			if (m_Stop)
+			{
+				return;
+			}
+
+			auto [it, inserted] = m_PendingFiles.try_emplace(&configObject, PendingFile{now, now});
+			it->second.LastWrite = now;
+		}
+		m_Condition.notify_one();
+	}
+	void IdleSaveScheduler::Stop()
+	{
+		// The thread has been terminated along with the rest of the process and it could've been holding the mutex,
+		// only its handle is left to release.
+		if (ReaderBiasedLock::IsProcessTerminating())
+		{
+			if (m_Thread.joinable())
+			{
+				m_Thread.detach();
+			}
+			return;
+		}
+
+		{
+			std::lock_guard lock(m_Mutex);
+			m_Stop = true;
+			m_PendingFiles.clear();
+		}
+		m_Condition.notify_one();
+
+		if (m_Thread.joinable())
+		{
+			m_Thread.join();
+		}
+	}
+}
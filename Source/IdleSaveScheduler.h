@@ -0,0 +1,84 @@
+#pragma once
+#include "stdafx.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace PPR
+{
+	class ConfigObject;
+}
+
+namespace PPR
+{
+	// Saves a file after it hasn't been written to for a given time ('SaveOnIdle'), or after its oldest unsaved change
+	// reaches the latency cap ('SaveOnIdleMaxLatency') if the writes keep coming. One timer thread serves all the files.
+	class IdleSaveScheduler final
+	{
+		public:
+			using Clock = std::chrono::steady_clock;
+
+		private:
+			struct PendingFile final
+			{
+				Clock::time_point FirstWrite;
+				Clock::time_point LastWrite;
+			};
+
+		private:
+			std::mutex m_Mutex;
+			std::condition_variable m_Condition;
+			std::unordered_map<ConfigObject*, PendingFile> m_PendingFiles;
+			bool m_Stop = false;
+
+			const std::chrono::milliseconds m_Delay;
+			const std::chrono::milliseconds m_MaxLatency;
+			std::atomic<size_t> m_SaveCount = 0;
+
+			// Started by the first write and joined by 'Stop', the scheduler has to be stopped before the files are destroyed
+			std::thread m_Thread;
+			std::once_flag m_ThreadStarted;
+
+		private:
+			Clock::time_point GetDeadline(const PendingFile& pendingFile) const noexcept
+			{
+				auto deadline = pendingFile.LastWrite + m_Delay;
+				if (m_MaxLatency.count() > 0)
+				{
+					deadline = std::min(deadline, pendingFile.FirstWrite + m_MaxLatency);
+				}
+				return deadline;
+			}
+			void RunThread();
+
+			void StartThread();
+
+		public:
+			IdleSaveScheduler(std::chrono::milliseconds delay, std::chrono::milliseconds maxLatency);
+			IdleSaveScheduler(const IdleSaveScheduler&) = delete;
+			~IdleSaveScheduler();
+
+		public:
+			void Schedule(ConfigObject& configObject);
+
+			// Drops the pending files and waits for the thread to finish the save it's in the middle of,
+			// the files which weren't saved yet are left to the caller.
+			void Stop();
+
+			std::chrono::milliseconds GetDelay() const noexcept
+			{
+				return m_Delay;
+			}
+			std::chrono::milliseconds GetMaxLatency() const noexcept
+			{
+				return m_MaxLatency;
+			}
+			size_t GetSaveCount() const noexcept
+			{
+				return m_SaveCount;
+			}
+
+		public:
+			IdleSaveScheduler& operator=(const IdleSaveScheduler&) = delete;
+	};
+}
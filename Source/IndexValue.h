@@ -0,0 +1,158 @@
+#pragma once
+#include "stdafx.h"
+#include <kxf/Core/IEncodingConverter.h>
+
+namespace PPR
+{
+	// View of a value stored in the index. ASCII-only values are stored one byte per character, as they're the same
+	// in UTF-8 and in every ANSI code page they can be copied to the 'A' callers as is. Everything else is stored
+	// as wide characters. The view doesn't own the storage, it's either the 'ValuePool' or the index arena.
+	class IndexValue final
+	{
+		public:
+			static bool IsASCII(kxf::StringView value) noexcept
+			{
+				for (wchar_t c: value)
+				{
+					if (c > 0x7F)
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+
+		private:
+			const void* m_Data = nullptr;
+			uint32_t m_Length = 0;
+			bool m_IsASCII = true;
+
+		public:
+			IndexValue() noexcept = default;
+			IndexValue(std::string_view value) noexcept
+				:m_Data(value.data()), m_Length(static_cast<uint32_t>(value.length())), m_IsASCII(true)
+			{
+			}
+			IndexValue(kxf::StringView value) noexcept
+				:m_Data(value.data()), m_Length(static_cast<uint32_t>(value.length())), m_IsASCII(false)
+			{
+			}
+
+		public:
+			size_t GetLength() const noexcept
+			{
+				return m_Length;
+			}
+			bool IsASCII() const noexcept
+			{
+				return m_IsASCII;
+			}
+			const void* GetData() const noexcept
+			{
+				return m_Data;
+			}
+
+			// Only valid for the respective storage kind
+			std::string_view GetASCII() const noexcept
+			{
+				return {static_cast<const char*>(m_Data), m_Length};
+			}
+			kxf::StringView GetWide() const noexcept
+			{
+				return {static_cast<const wchar_t*>(m_Data), m_Length};
+			}
+
+			// Returns the value in the requested encoding, the buffer is only used if the value has to be converted
+			kxf::StringView GetView(std::wstring& buffer) const
+			{
+				if (m_IsASCII)
+				{
+					std::string_view ascii = GetASCII();
+					buffer.assign(ascii.begin(), ascii.end());
+
+					return buffer;
+				}
+				return GetWide();
+			}
+			std::string_view GetView(std::string& buffer, kxf::IEncodingConverter& converter) const
+			{
+				if (m_IsASCII)
+				{
+					return GetASCII();
+				}
+
+				kxf::StringView wide = GetWide();
+				if (IsASCII(wide))
+				{
+					buffer.resize(wide.length());
+					std::transform(wide.begin(), wide.end(), buffer.begin(), [](wchar_t c)
+					{
+						return static_cast<char>(c);
+					});
+				}
+				else
+				{
+					buffer = converter.ToMultiByte(wide);
+				}
+				return buffer;
+			}
+
+			template<class TChar>
+			auto GetView(std::basic_string<TChar>& buffer, kxf::IEncodingConverter& converter) const
+			{
+				if constexpr(std::is_same_v<TChar, char>)
+				{
+					return GetView(buffer, converter);
+				}
+				else if constexpr(std::is_same_v<TChar, wchar_t>)
+				{
+					return GetView(buffer);
+				}
+				else
+				{
+					static_assert(sizeof(TChar*) == 0, "invalid type");
+				}
+			}
+
+			// Appends the value without an intermediate copy, except for the non-ASCII values requested as 'char'
+			template<class TChar>
+			void AppendTo(std::basic_string<TChar>& buffer, kxf::IEncodingConverter& converter) const
+			{
+				if (m_IsASCII)
+				{
+					std::string_view ascii = GetASCII();
+					buffer.append(ascii.begin(), ascii.end());
+				}
+				else if constexpr(std::is_same_v<TChar, wchar_t>)
+				{
+					buffer.append(GetWide());
+				}
+				else
+				{
+					std::string narrow;
+					buffer.append(GetView(narrow, converter));
+				}
+			}
+
+			kxf::String ToString() const
+			{
+				std::wstring buffer;
+				return kxf::String(GetView(buffer));
+			}
+			bool IsSameAs(kxf::StringView value) const noexcept
+			{
+				if (value.length() != m_Length)
+				{
+					return false;
+				}
+				if (m_IsASCII)
+				{
+					return std::equal(value.begin(), value.end(), GetASCII().begin(), [](wchar_t left, char right)
+					{
+						return left == static_cast<wchar_t>(right);
+					});
+				}
+				return value == GetWide();
+			}
+	};
+}
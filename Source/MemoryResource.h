@@ -0,0 +1,145 @@
+#pragma once
+#include "stdafx.h"
+#include <memory_resource>
+#include <mutex>
+
+namespace PPR
+{
+	struct MemoryStats final
+	{
+		// Blocks the arenas hold and have requested over their lifetime
+		size_t Allocations = 0;
+		size_t AllocatedBytes = 0;
+		size_t TotalAllocations = 0;
+		size_t TotalAllocatedBytes = 0;
+
+		// Nodes and strings of the index served from the current arena, each of them would be a heap allocation without it
+		size_t IndexAllocations = 0;
+		size_t Compactions = 0;
+		size_t InternedBytes = 0;
+
+		MemoryStats& operator+=(const MemoryStats& other) noexcept
+		{
+			Allocations += other.Allocations;
+			AllocatedBytes += other.AllocatedBytes;
+			TotalAllocations += other.TotalAllocations;
+			TotalAllocatedBytes += other.TotalAllocatedBytes;
+			IndexAllocations += other.IndexAllocations;
+			Compactions += other.Compactions;
+			InternedBytes += other.InternedBytes;
+
+			return *this;
+		}
+	};
+}
+
+namespace PPR
+{
+	// Pass-through resource counting the blocks requested by the arenas built on top of it. It only sees the blocks
+	// of the index, not the nodes the document allocates by itself. The counters are read without the arena lock.
+	class CountingMemoryResource final: public std::pmr::memory_resource
+	{
+		private:
+			std::pmr::memory_resource* m_Upstream = nullptr;
+
+			std::atomic<size_t> m_Allocations = 0;
+			std::atomic<size_t> m_AllocatedBytes = 0;
+			std::atomic<size_t> m_TotalAllocations = 0;
+			std::atomic<size_t> m_TotalAllocatedBytes = 0;
+
+		protected:
+			// std::pmr::memory_resource
+			void* do_allocate(size_t bytes, size_t alignment) override
+			{
+				void* ptr = m_Upstream->allocate(bytes, alignment);
+
+				m_Allocations++;
+				m_AllocatedBytes += bytes;
+				m_TotalAllocations++;
+				m_TotalAllocatedBytes += bytes;
+
+				return ptr;
+			}
+			void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+			{
+				m_Upstream->deallocate(ptr, bytes, alignment);
+
+				m_Allocations--;
+				m_AllocatedBytes -= bytes;
+			}
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+			{
+				return this == &other;
+			}
+
+		public:
+			CountingMemoryResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource()) noexcept
+				:m_Upstream(upstream)
+			{
+			}
+			CountingMemoryResource(const CountingMemoryResource&) = delete;
+
+		public:
+			MemoryStats GetStats() const noexcept
+			{
+				MemoryStats stats;
+				stats.Allocations = m_Allocations;
+				stats.AllocatedBytes = m_AllocatedBytes;
+				stats.TotalAllocations = m_TotalAllocations;
+				stats.TotalAllocatedBytes = m_TotalAllocatedBytes;
+
+				return stats;
+			}
+
+		public:
+			CountingMemoryResource& operator=(const CountingMemoryResource&) = delete;
+	};
+}
+
+namespace PPR
+{
+	// Serializes the access to a resource which isn't thread-safe by itself, such as the monotonic arena,
+	// and counts the allocations passed to it.
+	class SynchronizedMemoryResource final: public std::pmr::memory_resource
+	{
+		private:
+			std::pmr::memory_resource* m_Upstream = nullptr;
+			std::mutex m_Lock;
+			std::atomic<size_t> m_Allocations = 0;
+
+		protected:
+			// std::pmr::memory_resource
+			void* do_allocate(size_t bytes, size_t alignment) override
+			{
+				std::lock_guard lock(m_Lock);
+				m_Allocations.fetch_add(1, std::memory_order_relaxed);
+
+				return m_Upstream->allocate(bytes, alignment);
+			}
+			void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+			{
+				std::lock_guard lock(m_Lock);
+				m_Upstream->deallocate(ptr, bytes, alignment);
+			}
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+			{
+				return this == &other;
+			}
+
+		public:
+			SynchronizedMemoryResource(std::pmr::memory_resource* upstream) noexcept
+				:m_Upstream(upstream)
+			{
+			}
+			SynchronizedMemoryResource(const SynchronizedMemoryResource&) = delete;
+
+		public:
+			size_t GetAllocationCount() const noexcept
+			{
+				return m_Allocations.load(std::memory_order_relaxed);
+			}
+
+		public:
+			SynchronizedMemoryResource& operator=(const SynchronizedMemoryResource&) = delete;
+	};
+}
@@ -0,0 +1,122 @@
+#include "stdafx.h"
+#include "NativeWriteQueue.h"
+#include "ReaderBiasedLock.h"
+
+namespace PPR
+{
+	std::unique_lock<std::mutex> NativeWriteQueue::Lock() const
+	{
+		// A terminated thread could've been holding it, see 'ReaderBiasedLock::SetProcessTerminating'
+		if (ReaderBiasedLock::IsProcessTerminating())
+		{
+			return std::unique_lock(m_Lock, std::try_to_lock);
+		}
+		return std::unique_lock(m_Lock);
+	}
+
+	void NativeWriteQueue::PushKeyOperation(Operation operation, std::wstring section, std::wstring key, std::wstring value)
+	{
+		std::lock_guard lock(m_Lock);
+
+		auto& keys = m_KeyIndex[section];
+		if (auto it = keys.find(key); it != keys.end())
+		{
+			// The last write wins, keep the position of the first one
+			Entry& entry = m_Entries[it->second];
+			entry.Type = operation;
+			entry.Value = std::move(value);
+
+			m_CollapsedCount++;
+		}
+		else
+		{
+			keys.emplace(key, m_Entries.size());
+			m_Entries.emplace_back(Entry{operation, std::move(section), std::move(key), std::move(value)});
+		}
+	}
+	void NativeWriteQueue::PushSectionOperation(Operation operation, std::wstring section, std::wstring value)
+	{
+		std::lock_guard lock(m_Lock);
+
+		// Everything written to this section before is going to be deleted or replaced anyway
+		if (auto it = m_KeyIndex.find(section); it != m_KeyIndex.end())
+		{
+			for (const auto& [key, index]: it->second)
+			{
+				m_Entries[index].IsDropped = true;
+				m_CollapsedCount++;
+			}
+			m_KeyIndex.erase(it);
+		}
+		for (Entry& entry: m_Entries)
+		{
+			const bool isSectionOperation = entry.Type == Operation::DeleteSection || entry.Type == Operation::ReplaceSection;
+			if (!entry.IsDropped && isSectionOperation && ::CompareStringOrdinal(entry.Section.c_str(), -1, section.c_str(), -1, TRUE) == CSTR_EQUAL)
+			{
+				entry.IsDropped = true;
+				m_CollapsedCount++;
+			}
+		}
+
+		m_Entries.emplace_back(Entry{operation, std::move(section), {}, std::move(value)});
+	}
+
+	size_t NativeWriteQueue::Replay(const Internal::PrivateProfileFunctionTable& functions, const std::wstring& filePath)
+	{
+		// Replaying the same writes twice gives the same result, so only an interrupted change of the queue is a problem
+		auto lock = Lock();
+		if (!lock.owns_lock() && !m_IsReplaying)
+		{
+			kxf::Log::WarningCategory("NativeWrite", "Deferred native writes to '{}' were being queued when the process terminated, they're dropped", filePath);
+			return 0;
+		}
+		m_IsReplaying = true;
+
+		size_t count = 0;
+		for (const Entry& entry: m_Entries)
+		{
+			if (entry.IsDropped)
+			{
+				continue;
+			}
+
+			BOOL result = FALSE;
+			switch (entry.Type)
+			{
+				case Operation::SetValue:
+				{
+					result = functions.WriteStringW(entry.Section.c_str(), entry.Key.c_str(), entry.Value.c_str(), filePath.c_str());
+					break;
+				}
+				case Operation::DeleteKey:
+				{
+					result = functions.WriteStringW(entry.Section.c_str(), entry.Key.c_str(), nullptr, filePath.c_str());
+					break;
+				}
+				case Operation::DeleteSection:
+				{
+					result = functions.WriteStringW(entry.Section.c_str(), nullptr, nullptr, filePath.c_str());
+					break;
+				}
+				case Operation::ReplaceSection:
+				{
+					result = functions.WriteSectionW(entry.Section.c_str(), entry.Value.c_str(), filePath.c_str());
+					break;
+				}
+			};
+
+			if (!result)
+			{
+				kxf::Log::WarningCategory("NativeWrite", "Deferred native write to section '{}', key '{}' of '{}' failed", entry.Section, entry.Key, filePath);
+			}
+			count++;
+		}
+
+		m_Entries.clear();
+		m_KeyIndex.clear();
+		m_ReplayedCount += count;
+		m_IsReplaying = false;
+
+		return count;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "stdafx.h"
+#include "FunctionTable.h"
+#include <kxf/Utility/String.h>
+#include <mutex>
+
+namespace PPR
+{
+	// Pending native write operations for a single file used by the deferred 'NativeWrite' mode. Repeated writes
+	// to the same key are collapsed into one and writes to a section which is then deleted or replaced are dropped,
+	// the rest is replayed in the original order through the native functions when the file is saved.
+	class NativeWriteQueue final
+	{
+		public:
+			enum class Operation
+			{
+				SetValue,
+				DeleteKey,
+				DeleteSection,
+				ReplaceSection
+			};
+
+		private:
+			struct Entry final
+			{
+				Operation Type = Operation::SetValue;
+				std::wstring Section;
+				std::wstring Key;
+				std::wstring Value;
+				bool IsDropped = false;
+			};
+
+		private:
+			// Writers of different sections of the same file can queue their operations at the same time
+			mutable std::mutex m_Lock;
+			std::atomic<bool> m_IsReplaying = false;
+
+			std::vector<Entry> m_Entries;
+			kxf::Utility::UnorderedMapNoCase<kxf::String, kxf::Utility::UnorderedMapNoCase<kxf::String, size_t>> m_KeyIndex;
+			size_t m_ReplayedCount = 0;
+			size_t m_CollapsedCount = 0;
+
+		private:
+			std::unique_lock<std::mutex> Lock() const;
+
+			void PushKeyOperation(Operation operation, std::wstring section, std::wstring key, std::wstring value);
+			void PushSectionOperation(Operation operation, std::wstring section, std::wstring value);
+
+		public:
+			NativeWriteQueue() = default;
+			NativeWriteQueue(const NativeWriteQueue&) = delete;
+
+		public:
+			bool IsEmpty() const
+			{
+				auto lock = Lock();
+				return m_Entries.empty();
+			}
+			size_t GetReplayedCount() const noexcept
+			{
+				return m_ReplayedCount;
+			}
+			size_t GetCollapsedCount() const noexcept
+			{
+				return m_CollapsedCount;
+			}
+
+			void SetValue(std::wstring section, std::wstring key, std::wstring value)
+			{
+				PushKeyOperation(Operation::SetValue, std::move(section), std::move(key), std::move(value));
+			}
+			void DeleteKey(std::wstring section, std::wstring key)
+			{
+				PushKeyOperation(Operation::DeleteKey, std::move(section), std::move(key), {});
+			}
+			void DeleteSection(std::wstring section)
+			{
+				PushSectionOperation(Operation::DeleteSection, std::move(section), {});
+			}
+			void ReplaceSection(std::wstring section, std::wstring keyValuePairs)
+			{
+				PushSectionOperation(Operation::ReplaceSection, std::move(section), std::move(keyValuePairs));
+			}
+
+			// Once the process is terminating the queue is replayed even if its lock was left held by an interrupted replay,
+			// but not if it was held by a terminated writer.
+			size_t Replay(const Internal::PrivateProfileFunctionTable& functions, const std::wstring& filePath);
+
+		public:
+			NativeWriteQueue& operator=(const NativeWriteQueue&) = delete;
+	};
+}
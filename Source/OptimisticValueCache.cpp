@@ -0,0 +1,233 @@
+#include "stdafx.h"
+#include "OptimisticValueCache.h"
+
+namespace PPR
+{
+	bool OptimisticValueCache::AcquireSlot(Slot& slot, uint32_t& sequence, bool wait) noexcept
+	{
+		sequence = slot.Sequence.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			if ((sequence & 1) == 0 && slot.Sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				// The odd counter must become visible before any of the data changes
+				std::atomic_thread_fence(std::memory_order_release);
+				return true;
+			}
+			if (!wait)
+			{
+				return false;
+			}
+
+			::YieldProcessor();
+			sequence = slot.Sequence.load(std::memory_order_relaxed);
+		}
+	}
+	void OptimisticValueCache::ReleaseSlot(Slot& slot, uint32_t sequence) noexcept
+	{
+		slot.Sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	auto OptimisticValueCache::AllocateSlots() noexcept -> Slot*
+	{
+		// The fillers of different sections can get here at the same time, only one of the arrays is kept
+		Slot* slots = new(std::nothrow) Slot[SlotCount];
+		Slot* expected = nullptr;
+		if (slots && !m_Slots.compare_exchange_strong(expected, slots, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			delete[] slots;
+			return expected;
+		}
+		return slots;
+	}
+
+	OptimisticValueCache::~OptimisticValueCache()
+	{
+		delete[] m_Slots.load(std::memory_order_relaxed);
+	}
+	void OptimisticValueCache::Free() noexcept
+	{
+		delete[] m_Slots.exchange(nullptr, std::memory_order_acq_rel);
+	}
+
+	bool OptimisticValueCache::ReadSlot(size_t hash, kxf::StringView section, kxf::StringView key, uint32_t& layout, wchar_t* text, uint64_t& parsed) const noexcept
+	{
+		if (section.length() + key.length() > SlotCapacity)
+		{
+			return false;
+		}
+
+		const Slot* slots = GetSlots();
+		if (!slots)
+		{
+			return false;
+		}
+
+		const Slot& slot = slots[hash % SlotCount];
+		for (size_t attempt = 0; attempt < MaxReadAttempts; attempt++)
+		{
+			const uint32_t sequence = slot.Sequence.load(std::memory_order_acquire);
+			if (sequence & 1)
+			{
+				::YieldProcessor();
+				continue;
+			}
+
+			// Copy the slot and make sure no writer touched it while we were reading
+			layout = slot.Layout.load(std::memory_order_relaxed);
+			parsed = slot.Parsed.load(std::memory_order_relaxed);
+			const size_t sectionLength = layout & 0xFF;
+			const size_t keyLength = (layout >> 8) & 0xFF;
+			const size_t valueLength = (layout >> 16) & 0xFF;
+			const size_t totalLength = std::min(sectionLength + keyLength + valueLength, SlotCapacity);
+
+			uint64_t words[WordCount];
+			const size_t wordCount = (totalLength + CharsPerWord - 1) / CharsPerWord;
+			for (size_t i = 0; i < wordCount; i++)
+			{
+				words[i] = slot.Data[i].load(std::memory_order_relaxed);
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.Sequence.load(std::memory_order_relaxed) != sequence)
+			{
+				continue;
+			}
+
+			// We have a consistent copy now, see if it's the value we're looking for
+			if ((layout & LayoutValid) == 0 || sectionLength != section.length() || keyLength != key.length())
+			{
+				return false;
+			}
+			std::memcpy(text, words, wordCount * sizeof(uint64_t));
+
+			// Names are folded by the caller, see 'FoldedName'
+			if (std::memcmp(text, section.data(), sectionLength * sizeof(wchar_t)) != 0 || std::memcmp(text + sectionLength, key.data(), keyLength * sizeof(wchar_t)) != 0)
+			{
+				return false;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	bool OptimisticValueCache::Load(size_t hash, kxf::StringView section, kxf::StringView key, Value& value) const noexcept
+	{
+		uint32_t layout = 0;
+		uint64_t parsed = 0;
+		wchar_t text[WordCount * CharsPerWord];
+		if (ReadSlot(hash, section, key, layout, text, parsed))
+		{
+			const size_t valueLength = (layout >> 16) & 0xFF;
+			std::memcpy(value.Data, text + section.length() + key.length(), valueLength * sizeof(wchar_t));
+			value.Length = valueLength;
+			return true;
+		}
+		return false;
+	}
+	bool OptimisticValueCache::Load(size_t hash, kxf::StringView section, kxf::StringView key, ParsedKind kind, uint64_t& parsed) const noexcept
+	{
+		uint32_t layout = 0;
+		wchar_t text[WordCount * CharsPerWord];
+		if (ReadSlot(hash, section, key, layout, text, parsed))
+		{
+			return ((layout >> 24) & 0x7) == static_cast<uint32_t>(kind) && kind != ParsedKind::None;
+		}
+		return false;
+	}
+	bool OptimisticValueCache::Store(size_t hash, kxf::StringView section, kxf::StringView key, kxf::StringView value, bool wait, ParsedKind kind, uint64_t parsed) noexcept
+	{
+		if (section.length() + key.length() + value.length() > SlotCapacity)
+		{
+			// The slot may still hold the previous value of this key
+			if (wait)
+			{
+				Invalidate(hash);
+			}
+			return false;
+		}
+
+		// Nothing can be outdated in a cache that was never filled, so only the readers allocate it
+		Slot* slots = GetSlots();
+		if (!slots && (wait || !(slots = AllocateSlots())))
+		{
+			return false;
+		}
+
+		Slot& slot = slots[hash % SlotCount];
+		uint32_t sequence = 0;
+		if (!AcquireSlot(slot, sequence, wait))
+		{
+			return false;
+		}
+
+		wchar_t text[WordCount * CharsPerWord] = {};
+		std::copy(section.begin(), section.end(), text);
+		std::copy(key.begin(), key.end(), text + section.length());
+		std::copy(value.begin(), value.end(), text + section.length() + key.length());
+
+		uint64_t words[WordCount];
+		std::memcpy(words, text, sizeof(words));
+		const uint32_t lengths = static_cast<uint32_t>(section.length())|static_cast<uint32_t>(key.length() << 8)|static_cast<uint32_t>(value.length() << 16);
+
+		// A plain string fill of the text the slot already has keeps the parsed value, the slot is ours so it can be read directly
+		const uint32_t oldLayout = slot.Layout.load(std::memory_order_relaxed);
+		bool isSameText = (oldLayout & LayoutValid) && (oldLayout & 0xFFFFFF) == lengths;
+		for (size_t i = 0; i < WordCount && isSameText; i++)
+		{
+			isSameText = slot.Data[i].load(std::memory_order_relaxed) == words[i];
+		}
+
+		if (!isSameText)
+		{
+			for (size_t i = 0; i < WordCount; i++)
+			{
+				slot.Data[i].store(words[i], std::memory_order_relaxed);
+			}
+		}
+		if (isSameText && kind == ParsedKind::None)
+		{
+			kind = static_cast<ParsedKind>((oldLayout >> 24) & 0x7);
+		}
+		else
+		{
+			slot.Parsed.store(parsed, std::memory_order_relaxed);
+		}
+		slot.Layout.store(LayoutValid|lengths|(static_cast<uint32_t>(kind) << 24), std::memory_order_relaxed);
+
+		ReleaseSlot(slot, sequence);
+		return true;
+	}
+	void OptimisticValueCache::Invalidate(size_t hash) noexcept
+	{
+		Slot* slots = GetSlots();
+		if (!slots)
+		{
+			return;
+		}
+		Slot& slot = slots[hash % SlotCount];
+
+		uint32_t sequence = 0;
+		AcquireSlot(slot, sequence, true);
+		slot.Layout.store(0, std::memory_order_relaxed);
+		ReleaseSlot(slot, sequence);
+	}
+	void OptimisticValueCache::InvalidateAll() noexcept
+	{
+		Slot* slots = GetSlots();
+		if (!slots)
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < SlotCount; i++)
+		{
+			Slot& slot = slots[i];
+
+			uint32_t sequence = 0;
+			AcquireSlot(slot, sequence, true);
+			slot.Layout.store(0, std::memory_order_relaxed);
+			ReleaseSlot(slot, sequence);
+		}
+	}
+}
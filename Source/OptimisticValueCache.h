@@ -0,0 +1,106 @@
+#pragma once
+#include "stdafx.h"
+
+namespace PPR
+{
+	// Direct-mapped cache of short values readable without taking the section locks. Each slot is guarded by a sequence
+	// counter: a writer makes it odd while it changes the slot and even again when it's done, a reader copies
+	// the slot and accepts the copy only if the counter was even and didn't change in the meantime. Readers
+	// never write to the slots, so concurrent readers of the same file don't contend on anything. They only hold
+	// the file lock in shared mode, which keeps the slots alive, see 'Free'.
+	//
+	// Slots are written only by the threads holding the owning file lock, by the writers when they change a value
+	// and by the readers which had to go the locked path to fill the slot. Values that don't fit are never cached.
+	// A slot can also keep the value parsed as a number, see 'ParsedKind'. A store of different text drops it,
+	// a store of the same text without a parsed value keeps it.
+	//
+	// The slots are allocated by the first fill from a reader, most files are never read through the cache
+	// and a writer has nothing to update before that.
+	class OptimisticValueCache final
+	{
+		public:
+			// Combined length of the section name, key name and value that fits into a slot, it's limited by the slot taking two cache lines
+			static constexpr size_t SlotCapacity = 56;
+			static constexpr size_t SlotCount = 128;
+
+			enum class ParsedKind: uint32_t
+			{
+				None = 0,
+				Float,
+				Bool,
+				Integer
+			};
+
+			struct Value final
+			{
+				wchar_t Data[SlotCapacity] = {};
+				size_t Length = 0;
+
+				kxf::StringView GetView() const noexcept
+				{
+					return {Data, Length};
+				}
+			};
+
+		private:
+			static constexpr size_t CharsPerWord = sizeof(uint64_t) / sizeof(wchar_t);
+			static constexpr size_t WordCount = (SlotCapacity + CharsPerWord - 1) / CharsPerWord;
+			static constexpr uint32_t LayoutValid = 1u << 31;
+			static constexpr size_t MaxReadAttempts = 4;
+
+			struct alignas(64) Slot final
+			{
+				std::atomic<uint32_t> Sequence = 0;
+
+				// Section, key and value lengths in the bits [0, 8), [8, 16), [16, 24), parsed kind in [24, 27) and a validity flag
+				std::atomic<uint32_t> Layout = 0;
+				std::atomic<uint64_t> Parsed = 0;
+
+				// Section, key and value characters stored one after another
+				std::atomic<uint64_t> Data[WordCount] = {};
+			};
+			static_assert(sizeof(Slot) == 128);
+
+		private:
+			std::atomic<Slot*> m_Slots = nullptr;
+
+		private:
+			Slot* GetSlots() const noexcept
+			{
+				return m_Slots.load(std::memory_order_acquire);
+			}
+			Slot* AllocateSlots() noexcept;
+
+			bool AcquireSlot(Slot& slot, uint32_t& sequence, bool wait) noexcept;
+			void ReleaseSlot(Slot& slot, uint32_t sequence) noexcept;
+			bool ReadSlot(size_t hash, kxf::StringView section, kxf::StringView key, uint32_t& layout, wchar_t* text, uint64_t& parsed) const noexcept;
+
+		public:
+			OptimisticValueCache() noexcept = default;
+			OptimisticValueCache(const OptimisticValueCache&) = delete;
+			~OptimisticValueCache();
+
+		public:
+			size_t GetMemoryUsage() const noexcept
+			{
+				return GetSlots() ? SlotCount * sizeof(Slot) : 0;
+			}
+
+			// Lock-free lookup, the section and key names are expected to be already folded and 'hash' to be computed from them
+			bool Load(size_t hash, kxf::StringView section, kxf::StringView key, Value& value) const noexcept;
+			bool Load(size_t hash, kxf::StringView section, kxf::StringView key, ParsedKind kind, uint64_t& parsed) const noexcept;
+
+			// These have to be called with the file lock held. 'wait' means waiting for a concurrent filler of the same slot,
+			// the writers need that to not leave an outdated value behind, the readers can just skip the fill.
+			bool Store(size_t hash, kxf::StringView section, kxf::StringView key, kxf::StringView value, bool wait, ParsedKind kind = ParsedKind::None, uint64_t parsed = 0) noexcept;
+			void Invalidate(size_t hash) noexcept;
+			void InvalidateAll() noexcept;
+
+			// Releases the slots of an evicted file, the next reader fill allocates them again. Has to be called
+			// with the file lock held in exclusive mode, so there are no readers.
+			void Free() noexcept;
+
+		public:
+			OptimisticValueCache& operator=(const OptimisticValueCache&) = delete;
+	};
+}
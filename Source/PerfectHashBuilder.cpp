@@ -0,0 +1,115 @@
+#include "stdafx.h"
+#include "PerfectHashBuilder.h"
+#include "ConfigObject.h"
+#include "ReaderBiasedLock.h"
+
+namespace PPR
+{
+	void PerfectHashBuilder::StartThread()
+	{
+		std::lock_guard lock(m_Mutex);
+		if (!m_Stop)
+		{
+			m_Thread = std::thread(&PerfectHashBuilder::RunThread, this);
+		}
+	}
+	void PerfectHashBuilder::RunThread()
+	{
+		std::unique_lock lock(m_Mutex);
+		while (!m_Stop)
+		{
+			if (m_PendingFiles.empty())
+			{
+				m_Condition.wait(lock);
+				continue;
+			}
+
+			std::vector<ConfigObject*> dueFiles;
+			auto nextDeadline = Clock::time_point::max();
+			const auto now = Clock::now();
+
+			for (auto it = m_PendingFiles.begin(); it != m_PendingFiles.end();)
+			{
+				if (it->second <= now)
+				{
+					dueFiles.push_back(it->first);
+					it = m_PendingFiles.erase(it);
+				}
+				else
+				{
+					nextDeadline = std::min(nextDeadline, it->second);
+					++it;
+				}
+			}
+
+			if (!dueFiles.empty())
+			{
+				// Writers schedule the files after releasing the file lock, but the builder still
+				// shouldn't hold its own lock while taking the file locks.
+				lock.unlock();
+				for (ConfigObject* configObject: dueFiles)
+				{
+					if (configObject->BuildPerfectHash())
+					{
+						m_BuildCount++;
+					}
+					else
+					{
+						m_DiscardCount++;
+					}
+				}
+				lock.lock();
+			}
+			else
+			{
+				m_Condition.wait_until(lock, nextDeadline);
+			}
+		}
+	}
+
+	PerfectHashBuilder::PerfectHashBuilder() = default;
+	PerfectHashBuilder::~PerfectHashBuilder()
+	{
+		Stop();
+	}
+
+	void PerfectHashBuilder::Schedule(ConfigObject& configObject)
+	{
+		// Don't start the thread from 'DllMain', do it with the first loaded file instead
+		std::call_once(m_ThreadStarted, &PerfectHashBuilder::StartThread, this);
+
+		{
+			std::lock_guard lock(m_Mutex);
+			if (m_Stop)
+			{
+				return;
+			}
+			m_PendingFiles.insert_or_assign(&configObject, Clock::now() + Delay);
+		}
+		m_Condition.notify_one();
+	}
+	void PerfectHashBuilder::Stop()
+	{
+		// Same as 'IdleSaveScheduler::Stop', a terminated thread could've been holding the mutex
+		if (ReaderBiasedLock::IsProcessTerminating())
+		{
+			if (m_Thread.joinable())
+			{
+				m_Thread.detach();
+			}
+			return;
+		}
+
+		{
+			std::lock_guard lock(m_Mutex);
+			m_Stop = true;
+			m_PendingFiles.clear();
+		}
+		m_Condition.notify_one();
+
+		if (m_Thread.joinable())
+		{
+			m_Thread.join();
+		}
+	}
+}
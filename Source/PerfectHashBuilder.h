@@ -0,0 +1,66 @@
+#pragma once
+#include "stdafx.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace PPR
+{
+	class ConfigObject;
+}
+
+namespace PPR
+{
+	// Builds the perfect hashes of the files in the background ('PerfectHashIndex' option). A file is built
+	// once it hasn't been written to for 'Delay', so the files that are mostly read get their table soon after
+	// being loaded and the ones that keep being written to don't waste time on tables that would be outdated
+	// right away. One thread serves all the files.
+	class PerfectHashBuilder final
+	{
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			static constexpr std::chrono::milliseconds Delay = std::chrono::milliseconds(1000);
+
+		private:
+			std::mutex m_Mutex;
+			std::condition_variable m_Condition;
+			std::unordered_map<ConfigObject*, Clock::time_point> m_PendingFiles;
+			bool m_Stop = false;
+
+			std::atomic<size_t> m_BuildCount = 0;
+			std::atomic<size_t> m_DiscardCount = 0;
+
+			// Started by the first loaded file and joined by 'Stop', the builder has to be stopped before the files are destroyed
+			std::thread m_Thread;
+			std::once_flag m_ThreadStarted;
+
+		private:
+			void RunThread();
+
+			void StartThread();
+
+		public:
+			PerfectHashBuilder();
+			PerfectHashBuilder(const PerfectHashBuilder&) = delete;
+			~PerfectHashBuilder();
+
+		public:
+			void Schedule(ConfigObject& configObject);
+
+			// Drops the pending files and waits for the thread to finish the table it's building
+			void Stop();
+
+			size_t GetBuildCount() const noexcept
+			{
+				return m_BuildCount;
+			}
+			size_t GetDiscardCount() const noexcept
+			{
+				return m_DiscardCount;
+			}
+
+		public:
+			PerfectHashBuilder& operator=(const PerfectHashBuilder&) = delete;
+	};
+}
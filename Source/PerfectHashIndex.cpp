@@ -0,0 +1,133 @@
+#include "stdafx.h"
+#include "PerfectHashIndex.h"
+#include <numeric>
+
+namespace PPR
+{
+	auto PerfectHashIndex::FindSlot(const FoldedName& section, const FoldedName& key) const noexcept -> const Slot*
+	{
+		if (m_Slots.empty())
+		{
+			return nullptr;
+		}
+
+		const uint64_t hash = GetKeyHash(section.GetHash(), key.GetHash());
+		const Slot& slot = m_Slots[GetSlot(hash, m_Seeds[GetBucket(hash)])];
+		if (slot.Hash == hash && !slot.IsDeleted && slot.SectionLength == section.GetFolded().length() && slot.KeyLength == key.GetFolded().length())
+		{
+			if (FoldedName::IsSame({slot.Section, slot.SectionLength}, section.GetFolded()) && FoldedName::IsSame({slot.Key, slot.KeyLength}, key.GetFolded()))
+			{
+				return &slot;
+			}
+		}
+		return nullptr;
+	}
+
+	void PerfectHashIndex::Add(kxf::StringView section, size_t sectionHash, kxf::StringView key, size_t keyHash, const IndexValue& value)
+	{
+		Slot& slot = m_Slots.emplace_back();
+		slot.Hash = GetKeyHash(sectionHash, keyHash);
+		slot.Section = section.data();
+		slot.Key = key.data();
+		slot.SectionLength = static_cast<uint32_t>(section.length());
+		slot.KeyLength = static_cast<uint32_t>(key.length());
+		slot.Value = value;
+	}
+	bool PerfectHashIndex::Build()
+	{
+		const size_t count = m_Slots.size();
+		m_Seeds.assign((count + BucketSize - 1) / BucketSize, 0);
+		if (count == 0)
+		{
+			return true;
+		}
+
+		// Group the pairs by bucket, largest buckets are placed first while most of the slots are still free
+		std::vector<uint32_t> bucketStart(m_Seeds.size() + 1, 0);
+		for (const Slot& slot: m_Slots)
+		{
+			bucketStart[GetBucket(slot.Hash) + 1]++;
+		}
+		for (size_t i = 1; i < bucketStart.size(); i++)
+		{
+			bucketStart[i] += bucketStart[i - 1];
+		}
+
+		std::vector<uint32_t> bucketItems(count);
+		{
+			std::vector<uint32_t> bucketFill(bucketStart.begin(), bucketStart.end() - 1);
+			for (size_t i = 0; i < count; i++)
+			{
+				bucketItems[bucketFill[GetBucket(m_Slots[i].Hash)]++] = static_cast<uint32_t>(i);
+			}
+		}
+
+		std::vector<uint32_t> bucketOrder(m_Seeds.size());
+		std::iota(bucketOrder.begin(), bucketOrder.end(), 0);
+		std::stable_sort(bucketOrder.begin(), bucketOrder.end(), [&](uint32_t left, uint32_t right)
+		{
+			return bucketStart[left + 1] - bucketStart[left] > bucketStart[right + 1] - bucketStart[right];
+		});
+
+		// Find a seed for every bucket. With one slot per pair the last single-pair buckets have to find the last
+		// free slots, so the search range grows with the table size.
+		const uint32_t maxSeed = static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(count * 16, 1 << 16), std::numeric_limits<uint32_t>::max()));
+		std::vector<bool> isTaken(count, false);
+		std::vector<uint32_t> placement(count);
+		std::vector<size_t> positions;
+
+		for (uint32_t bucket: bucketOrder)
+		{
+			const uint32_t first = bucketStart[bucket];
+			const uint32_t last = bucketStart[bucket + 1];
+			if (first == last)
+			{
+				break;
+			}
+
+			bool isPlaced = false;
+			for (uint32_t seed = 0; seed < maxSeed && !isPlaced; seed++)
+			{
+				positions.clear();
+				isPlaced = true;
+				for (uint32_t i = first; i < last; i++)
+				{
+					const size_t position = GetSlot(m_Slots[bucketItems[i]].Hash, seed);
+					if (isTaken[position] || std::find(positions.begin(), positions.end(), position) != positions.end())
+					{
+						isPlaced = false;
+						break;
+					}
+					positions.push_back(position);
+				}
+
+				if (isPlaced)
+				{
+					m_Seeds[bucket] = seed;
+					for (uint32_t i = first; i < last; i++)
+					{
+						isTaken[positions[i - first]] = true;
+						placement[bucketItems[i]] = static_cast<uint32_t>(positions[i - first]);
+					}
+				}
+			}
+
+			if (!isPlaced)
+			{
+				m_Slots.clear();
+				m_Seeds.clear();
+				return false;
+			}
+		}
+
+		// Move the pairs into their slots
+		std::vector<Slot> slots(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			slots[placement[i]] = m_Slots[i];
+		}
+		m_Slots = std::move(slots);
+
+		return true;
+	}
+}
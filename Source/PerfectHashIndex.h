@@ -0,0 +1,123 @@
+#pragma once
+#include "stdafx.h"
+#include "IndexValue.h"
+#include "FoldedName.h"
+
+namespace PPR
+{
+	// Minimal perfect hash over the (section, key) pairs of one file, built with the CHD algorithm (hash, displace
+	// and compress). The pairs are split into small buckets and every bucket gets a seed which sends all of its pairs
+	// into free slots, so a lookup is one bucket read and one slot read with no collision chains. The table only knows
+	// the pairs it was built from. Names and values are the same views the index holds, the table is discarded whenever
+	// the index is rebuilt or a section is removed and the slot of a removed key is never compared again.
+	class PerfectHashIndex final
+	{
+		private:
+			// Average bucket size, larger buckets make the table smaller but the build slower
+			static constexpr size_t BucketSize = 4;
+
+		public:
+			static uint64_t GetKeyHash(size_t sectionHash, size_t keyHash) noexcept
+			{
+				// The name hashes can be 32 bits wide, spread them over the whole 64 bits
+				return Mix(static_cast<uint64_t>(sectionHash) * 0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(keyHash));
+			}
+
+		private:
+			struct Slot final
+			{
+				uint64_t Hash = 0;
+				const wchar_t* Section = nullptr;
+				const wchar_t* Key = nullptr;
+				uint32_t SectionLength = 0;
+				uint32_t KeyLength = 0;
+				bool IsDeleted = false;
+				IndexValue Value;
+			};
+
+			static uint64_t Mix(uint64_t value) noexcept
+			{
+				value ^= value >> 30;
+				value *= 0xBF58476D1CE4E5B9ull;
+				value ^= value >> 27;
+				value *= 0x94D049BB133111EBull;
+				value ^= value >> 31;
+				return value;
+			}
+			static size_t Reduce(uint64_t value, size_t range) noexcept
+			{
+				return static_cast<size_t>(((value >> 32) * static_cast<uint64_t>(range)) >> 32);
+			}
+
+		private:
+			std::vector<Slot> m_Slots;
+			std::vector<uint32_t> m_Seeds;
+
+		private:
+			size_t GetBucket(uint64_t hash) const noexcept
+			{
+				return Reduce(hash << 32, m_Seeds.size());
+			}
+			size_t GetSlot(uint64_t hash, uint32_t seed) const noexcept
+			{
+				return Reduce(Mix(hash + seed * 0x9E3779B97F4A7C15ull), m_Slots.size());
+			}
+			const Slot* FindSlot(const FoldedName& section, const FoldedName& key) const noexcept;
+			Slot* FindSlot(const FoldedName& section, const FoldedName& key) noexcept
+			{
+				return const_cast<Slot*>(std::as_const(*this).FindSlot(section, key));
+			}
+
+		public:
+			PerfectHashIndex() = default;
+			PerfectHashIndex(const PerfectHashIndex&) = delete;
+
+		public:
+			// Collects the pairs, then 'Build' places them. Returns false if the seeds can't be found,
+			// which happens only if two pairs have the same 64-bit hash.
+			void Add(kxf::StringView section, size_t sectionHash, kxf::StringView key, size_t keyHash, const IndexValue& value);
+			bool Build();
+
+			std::optional<IndexValue> Find(const FoldedName& section, const FoldedName& key) const noexcept
+			{
+				if (const Slot* slot = FindSlot(section, key))
+				{
+					return slot->Value;
+				}
+				return {};
+			}
+
+			// Keep the table in sync with the index, the section of the pair has to be locked exclusively.
+			// Both return false if the pair isn't a part of the table, a removed pair written again isn't either.
+			bool Update(const FoldedName& section, const FoldedName& key, const IndexValue& value) noexcept
+			{
+				if (Slot* slot = FindSlot(section, key))
+				{
+					slot->Value = value;
+					return true;
+				}
+				return false;
+			}
+			bool Remove(const FoldedName& section, const FoldedName& key) noexcept
+			{
+				if (Slot* slot = FindSlot(section, key))
+				{
+					slot->IsDeleted = true;
+					return true;
+				}
+				return false;
+			}
+
+			size_t GetSize() const noexcept
+			{
+				return m_Slots.size();
+			}
+			size_t GetMemorySize() const noexcept
+			{
+				return m_Slots.capacity() * sizeof(Slot) + m_Seeds.capacity() * sizeof(uint32_t);
+			}
+
+		public:
+			PerfectHashIndex& operator=(const PerfectHashIndex&) = delete;
+	};
+}
@@ -6,6 +6,7 @@
 #include <kxf/Core/EncodingConverter/NativeEncodingConverter.h>
 #include <kxf/Log/ScopedLoggerContext.h>
 #include <kxf/System/ShellOperations.h>
+#include <kxf/System/Win32Error.h>
 #include <detours/detours.h>
 #include <detours/detver.h>
 
@@ -38,7 +39,7 @@ namespace PPR
 		return {VersionMajor, VersionMinor, VersionPatch};
 	}
 
-	bool Redirector::DllMain(HMODULE module, DWORD event)
+	bool Redirector::DllMain(HMODULE module, DWORD event, void* reserved)
 	{
 		switch (event)
 		{
@@ -48,6 +49,14 @@ namespace PPR
 				{
 					g_Instance = std::make_unique<PPR::Redirector>();
 					kxf::Log::Info("Created PPR::Redirector instance");
+
+					// The module is never unloaded, so the worker threads never outlive its code and 'DLL_PROCESS_DETACH'
+					// only comes when the process terminates.
+					HMODULE pinnedModule = nullptr;
+					if (!::GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS|GET_MODULE_HANDLE_EX_FLAG_PIN, reinterpret_cast<const wchar_t*>(&Redirector::DllMain), &pinnedModule))
+					{
+						kxf::Log::Error("Couldn't pin the module, {}", kxf::Win32Error::GetLastError());
+					}
 				}
 				else
 				{
@@ -65,9 +74,17 @@ namespace PPR
 			}
 			case DLL_PROCESS_DETACH:
 			{
-				if (g_Instance && g_Instance->IsOptionEnabled(RedirectorOption::SaveOnProcessDetach))
+				if (g_Instance)
 				{
-					g_Instance->SaveChangedFiles(L"On process detach");
+					// Every other thread is gone by now, possibly in the middle of a save or holding a lock
+					if (reserved)
+					{
+						ReaderBiasedLock::SetProcessTerminating();
+					}
+
+					g_Instance->Shutdown();
+					g_Instance->LogStatistics();
+					g_Instance->SaveTraceEvents();
 				}
 				g_Instance = {};
 
@@ -109,12 +126,22 @@ namespace PPR
 		config.LoadOption(RedirectorOption::AllowSEVersionMismatch, L"AllowSEVersionMismatch");
 		config.LoadOption(RedirectorOption::WriteProtected, L"WriteProtected");
 		config.LoadOption(RedirectorOption::NativeWrite, L"NativeWrite", RedirectorOption::WriteProtected);
+		config.LoadOption(RedirectorOption::NativeWriteDeferred, L"NativeWriteDeferred", RedirectorOption::WriteProtected);
 		config.LoadOption(RedirectorOption::SaveOnWrite, L"SaveOnWrite", RedirectorOption::WriteProtected);
-		config.LoadOption(RedirectorOption::SaveOnThreadDetach, L"SaveOnThreadDetach", RedirectorOption::NativeWrite);
-		config.LoadOption(RedirectorOption::SaveOnProcessDetach, L"SaveOnProcessDetach", RedirectorOption::NativeWrite);
-		config.LoadOption(RedirectorOption::SaveOnGameSave, L"SaveOnGameSave", RedirectorOption::NativeWrite);
+
+		// Deferred native writes are replayed at the same points the files are normally saved at, so they need these options
+		const bool isNativeWriteDeferred = config.GetOptions().Contains(RedirectorOption::NativeWrite) && config.GetOptions().Contains(RedirectorOption::NativeWriteDeferred);
+		const RedirectorOption saveDisableIf = isNativeWriteDeferred ? RedirectorOption::None : RedirectorOption::NativeWrite;
+		config.LoadOption(RedirectorOption::SaveOnThreadDetach, L"SaveOnThreadDetach", saveDisableIf);
+		config.LoadOption(RedirectorOption::SaveOnProcessDetach, L"SaveOnProcessDetach", saveDisableIf);
+		config.LoadOption(RedirectorOption::SaveOnGameSave, L"SaveOnGameSave", saveDisableIf);
 		config.LoadOption(RedirectorOption::ProcessInlineComments, L"ProcessInlineComments");
+		config.LoadOption(RedirectorOption::CallerStatistics, L"CallerStatistics");
+		config.LoadOption(RedirectorOption::TraceEvents, L"TraceEvents");
+		config.LoadOption(RedirectorOption::PerfectHashIndex, L"PerfectHashIndex");
+		config.LoadOption(RedirectorOption::SharedSnapshot, L"SharedSnapshot");
 		m_Options = config.GetOptions();
+		m_Options.Mod(RedirectorOption::NativeWriteDeferred, isNativeWriteDeferred);
 
 		m_SaveOnWriteBuffer = config.GetGeneral().GetAttributeInt(L"SaveOnWriteBuffer", m_SaveOnWriteBuffer);
 		if (!m_Options.Contains(RedirectorOption::SaveOnWrite) || std::clamp(m_SaveOnWriteBuffer, 2, 4096) != m_SaveOnWriteBuffer)
@@ -122,19 +149,87 @@ namespace PPR
 			m_SaveOnWriteBuffer = 0;
 		}
 
+		m_SaveOnWriteTotalBuffer = config.GetGeneral().GetAttributeInt(L"SaveOnWriteTotalBuffer", m_SaveOnWriteTotalBuffer);
+		if (!m_Options.Contains(RedirectorOption::SaveOnWrite) || std::clamp(m_SaveOnWriteTotalBuffer, 2, 65536) != m_SaveOnWriteTotalBuffer)
+		{
+			m_SaveOnWriteTotalBuffer = 0;
+		}
+		m_SaveOnWriteTotalDelay = config.GetGeneral().GetAttributeInt(L"SaveOnWriteTotalDelay", m_SaveOnWriteTotalDelay);
+		if (!m_Options.Contains(RedirectorOption::SaveOnWrite) || std::clamp(m_SaveOnWriteTotalDelay, 100, 3600000) != m_SaveOnWriteTotalDelay)
+		{
+			m_SaveOnWriteTotalDelay = 0;
+		}
+
+		m_SaveOnIdle = config.GetGeneral().GetAttributeInt(L"SaveOnIdle", m_SaveOnIdle);
+		if ((m_Options.Contains(RedirectorOption::NativeWrite) && !isNativeWriteDeferred) || std::clamp(m_SaveOnIdle, 50, 600000) != m_SaveOnIdle)
+		{
+			m_SaveOnIdle = 0;
+		}
+		m_SaveOnIdleMaxLatency = config.GetGeneral().GetAttributeInt(L"SaveOnIdleMaxLatency", m_SaveOnIdleMaxLatency);
+		if (m_SaveOnIdle == 0 || std::clamp(m_SaveOnIdleMaxLatency, m_SaveOnIdle, 3600000) != m_SaveOnIdleMaxLatency)
+		{
+			m_SaveOnIdleMaxLatency = 0;
+		}
+		if (m_SaveOnIdle != 0)
+		{
+			m_IdleSaveScheduler = std::make_unique<IdleSaveScheduler>(std::chrono::milliseconds(m_SaveOnIdle), std::chrono::milliseconds(m_SaveOnIdleMaxLatency));
+		}
+		m_SharedSnapshotSize = config.GetGeneral().GetAttributeInt(L"SharedSnapshotSize", m_SharedSnapshotSize);
+		if (!m_Options.Contains(RedirectorOption::SharedSnapshot) || std::clamp(m_SharedSnapshotSize, 64, 1048576) != m_SharedSnapshotSize)
+		{
+			m_SharedSnapshotSize = 0;
+		}
+		if (m_SharedSnapshotSize != 0)
+		{
+			m_SnapshotPublisher = std::make_unique<SnapshotPublisher>(static_cast<size_t>(m_SharedSnapshotSize) * 1024);
+		}
+
+		// Changes of the write-protected files never reach the disk and can't be loaded again
+		m_MemoryLimit = config.GetGeneral().GetAttributeInt(L"MemoryLimit", m_MemoryLimit);
+		if (m_Options.Contains(RedirectorOption::WriteProtected) || std::clamp(m_MemoryLimit, 1, 65536) != m_MemoryLimit)
+		{
+			m_MemoryLimit = 0;
+		}
+		if (m_Options.Contains(RedirectorOption::TraceEvents))
+		{
+			m_TraceRecorder = std::make_unique<TraceRecorder>();
+		}
+		if (m_Options.Contains(RedirectorOption::PerfectHashIndex))
+		{
+			m_PerfectHashBuilder = std::make_unique<PerfectHashBuilder>();
+		}
+
 		auto encodingConverter = std::make_unique<kxf::NativeEncodingConverter>(config.GetGeneral().GetAttributeInt(L"CodePage", CP_ACP));
+		if (m_Options.Contains(RedirectorOption::CallerStatistics))
+		{
+			// The converter object stays the same after it's moved into 'm_EncodingConverter'
+			m_CallerStatistics = std::make_unique<CallerStatistics>(*encodingConverter);
+			m_CallerStatisticsCommand = config.GetGeneral().GetAttribute(L"CallerStatisticsCommand");
+		}
 
 		// Print options
 		KX_SCOPEDLOG.Info().Format("LogLevel: {} -> {}", kxf::ScopedLoggerGlobalContext::GetInstance().GetLogLevel(), kxf::Log::IsEnabled());
 		KX_SCOPEDLOG.Info().Format("AllowSEVersionMismatch: {}", m_Options.Contains(RedirectorOption::AllowSEVersionMismatch));
 		KX_SCOPEDLOG.Info().Format("WriteProtected: {}", m_Options.Contains(RedirectorOption::WriteProtected));
 		KX_SCOPEDLOG.Info().Format("NativeWrite: {}", m_Options.Contains(RedirectorOption::NativeWrite));
+		KX_SCOPEDLOG.Info().Format("NativeWriteDeferred: {}", m_Options.Contains(RedirectorOption::NativeWriteDeferred));
 		KX_SCOPEDLOG.Info().Format("SaveOnWrite: {}", m_Options.Contains(RedirectorOption::SaveOnWrite));
 		KX_SCOPEDLOG.Info().Format("SaveOnThreadDetach: {}", m_Options.Contains(RedirectorOption::SaveOnThreadDetach));
 		KX_SCOPEDLOG.Info().Format("SaveOnProcessDetach: {}", m_Options.Contains(RedirectorOption::SaveOnProcessDetach));
 		KX_SCOPEDLOG.Info().Format("SaveOnGameSave: {}", m_Options.Contains(RedirectorOption::SaveOnGameSave));
 		KX_SCOPEDLOG.Info().Format("ProcessInlineComments: {}", m_Options.Contains(RedirectorOption::ProcessInlineComments));
+		KX_SCOPEDLOG.Info().Format("CallerStatistics: {}", m_Options.Contains(RedirectorOption::CallerStatistics));
+		KX_SCOPEDLOG.Info().Format("CallerStatisticsCommand: '{}'", m_CallerStatisticsCommand);
+		KX_SCOPEDLOG.Info().Format("TraceEvents: {}", m_Options.Contains(RedirectorOption::TraceEvents));
+		KX_SCOPEDLOG.Info().Format("PerfectHashIndex: {}", m_Options.Contains(RedirectorOption::PerfectHashIndex));
+		KX_SCOPEDLOG.Info().Format("SharedSnapshot: {}", m_Options.Contains(RedirectorOption::SharedSnapshot));
 		KX_SCOPEDLOG.Info().Format("SaveOnWriteBuffer: {}", m_SaveOnWriteBuffer);
+		KX_SCOPEDLOG.Info().Format("SaveOnWriteTotalBuffer: {}", m_SaveOnWriteTotalBuffer);
+		KX_SCOPEDLOG.Info().Format("SaveOnWriteTotalDelay: {}", m_SaveOnWriteTotalDelay);
+		KX_SCOPEDLOG.Info().Format("SaveOnIdle: {}", m_SaveOnIdle);
+		KX_SCOPEDLOG.Info().Format("SaveOnIdleMaxLatency: {}", m_SaveOnIdleMaxLatency);
+		KX_SCOPEDLOG.Info().Format("SharedSnapshotSize: {}", m_SharedSnapshotSize);
+		KX_SCOPEDLOG.Info().Format("MemoryLimit: {}", m_MemoryLimit);
 		KX_SCOPEDLOG.Info().Format("CodePage: '{}'/{}", encodingConverter->GetEncodingName(), encodingConverter->GetCodePage());
 
 		m_EncodingConverter = std::move(encodingConverter);
@@ -183,6 +278,28 @@ namespace PPR
 		m_Functions.PrivateProfile.WriteStringA = ::WritePrivateProfileStringA;
 		m_Functions.PrivateProfile.WriteStringW = ::WritePrivateProfileStringW;
 
+		m_Functions.PrivateProfile.WriteSectionA = ::WritePrivateProfileSectionA;
+		m_Functions.PrivateProfile.WriteSectionW = ::WritePrivateProfileSectionW;
+
+		m_Functions.PrivateProfile.GetStructA = ::GetPrivateProfileStructA;
+		m_Functions.PrivateProfile.GetStructW = ::GetPrivateProfileStructW;
+
+		m_Functions.PrivateProfile.WriteStructA = ::WritePrivateProfileStructA;
+		m_Functions.PrivateProfile.WriteStructW = ::WritePrivateProfileStructW;
+
+		// Profile (win.ini)
+		m_Functions.PrivateProfile.GetProfileStringA = ::GetProfileStringA;
+		m_Functions.PrivateProfile.GetProfileStringW = ::GetProfileStringW;
+
+		m_Functions.PrivateProfile.GetProfileIntA = ::GetProfileIntA;
+		m_Functions.PrivateProfile.GetProfileIntW = ::GetProfileIntW;
+
+		m_Functions.PrivateProfile.GetProfileSectionA = ::GetProfileSectionA;
+		m_Functions.PrivateProfile.GetProfileSectionW = ::GetProfileSectionW;
+
+		m_Functions.PrivateProfile.WriteProfileStringA = ::WriteProfileStringA;
+		m_Functions.PrivateProfile.WriteProfileStringW = ::WriteProfileStringW;
+
 		KX_SCOPEDLOG.SetSuccess();
 	}
 	void Redirector::OverrideFunctions()
@@ -215,6 +332,39 @@ namespace PPR
 		{
 			AttachFunctionN(GetSectionA);
 			AttachFunctionN(GetSectionW);
+
+			AttachFunctionN(WriteSectionA);
+			AttachFunctionN(WriteSectionW);
+		});
+
+		// 4
+		FunctionRedirector::PerformTransaction([this]()
+		{
+			AttachFunctionN(GetStructA);
+			AttachFunctionN(GetStructW);
+
+			AttachFunctionN(WriteStructA);
+			AttachFunctionN(WriteStructW);
+		});
+
+		// 5
+		FunctionRedirector::PerformTransaction([this]()
+		{
+			AttachFunctionN(GetProfileStringA);
+			AttachFunctionN(GetProfileStringW);
+
+			AttachFunctionN(GetProfileIntA);
+			AttachFunctionN(GetProfileIntW);
+		});
+
+		// 6
+		FunctionRedirector::PerformTransaction([this]()
+		{
+			AttachFunctionN(GetProfileSectionA);
+			AttachFunctionN(GetProfileSectionW);
+
+			AttachFunctionN(WriteProfileStringA);
+			AttachFunctionN(WriteProfileStringW);
 		});
 
 		#undef AttachFunctionN
@@ -250,6 +400,39 @@ namespace PPR
 		{
 			DetachFunctionN(GetSectionA);
 			DetachFunctionN(GetSectionW);
+
+			DetachFunctionN(WriteSectionA);
+			DetachFunctionN(WriteSectionW);
+		});
+
+		// 4
+		FunctionRedirector::PerformTransaction([this]()
+		{
+			DetachFunctionN(GetStructA);
+			DetachFunctionN(GetStructW);
+
+			DetachFunctionN(WriteStructA);
+			DetachFunctionN(WriteStructW);
+		});
+
+		// 5
+		FunctionRedirector::PerformTransaction([this]()
+		{
+			DetachFunctionN(GetProfileStringA);
+			DetachFunctionN(GetProfileStringW);
+
+			DetachFunctionN(GetProfileIntA);
+			DetachFunctionN(GetProfileIntW);
+		});
+
+		// 6
+		FunctionRedirector::PerformTransaction([this]()
+		{
+			DetachFunctionN(GetProfileSectionA);
+			DetachFunctionN(GetProfileSectionW);
+
+			DetachFunctionN(WriteProfileStringA);
+			DetachFunctionN(WriteProfileStringW);
 		});
 
 		#undef DetachFunctionN
@@ -272,6 +455,7 @@ namespace PPR
 	{
 		KX_SCOPEDLOG_FUNC;
 
+		StopBackgroundWork();
 		RestoreFunctions();
 		FunctionRedirector::Uninitialize();
 
@@ -283,56 +467,262 @@ namespace PPR
 		return SEInterface::GetInstance();
 	}
 
+	kxf::String Redirector::ResolveFilePath(const kxf::String& filePath) const
+	{
+		std::wstring path(kxf::StringViewOf(filePath));
+
+		// Same rule the native functions use: a bare file name without any path components refers to a file in the Windows directory
+		if (path.find_first_of(L"\\/:") == path.npos)
+		{
+			wchar_t windowsDirectory[MAX_PATH] = {};
+			if (size_t length = ::GetWindowsDirectoryW(windowsDirectory, std::size(windowsDirectory)); length != 0 && length < std::size(windowsDirectory))
+			{
+				path.insert(0, L"\\");
+				path.insert(0, windowsDirectory, length);
+			}
+		}
+
+		// Make the path absolute, fold the slashes and dot-segments
+		if (DWORD length = ::GetFullPathNameW(path.c_str(), 0, nullptr, nullptr); length != 0)
+		{
+			std::wstring fullPath(length, L'\0');
+			if (length = ::GetFullPathNameW(path.c_str(), length, fullPath.data(), nullptr); length != 0 && length < fullPath.size())
+			{
+				fullPath.resize(length);
+				return fullPath;
+			}
+		}
+		return path;
+	}
+
+	bool Redirector::IsPathMemoizable(kxf::StringView filePath) noexcept
+	{
+		auto IsSeparator = [](wchar_t c)
+		{
+			return c == L'\\' || c == L'/';
+		};
+
+		// A bare file name always refers to the Windows directory, see 'ResolveFilePath'
+		if (filePath.find_first_of(L"\\/:") == filePath.npos)
+		{
+			return true;
+		}
+
+		// 'C:\path' and the UNC or device paths. Everything else ('Data\path', '.\path', '\path' and 'C:path')
+		// is resolved against the current directory, which can change between the calls.
+		if (filePath.length() >= 3 && filePath[1] == L':' && IsSeparator(filePath[2]))
+		{
+			return true;
+		}
+		return filePath.length() >= 2 && IsSeparator(filePath[0]) && IsSeparator(filePath[1]);
+	}
+
+	size_t Redirector::EvictColdFiles()
+	{
+		KX_SCOPEDLOG_FUNC;
+		TraceSpan traceSpan(m_TraceRecorder.get(), "EvictColdFiles");
+
+		// File objects are never destroyed, so the candidates are taken under the map lock
+		// and every one of them is evicted with only its own lock held.
+		std::vector<std::pair<uint64_t, ConfigObject*>> candidates;
+		{
+			ReaderBiasedLock::ReadGuard lock(m_INIMapLock);
+			candidates.reserve(m_INIMap.size());
+			for (const auto& [path, config]: m_INIMap)
+			{
+				if (!config->IsEvicted())
+				{
+					candidates.emplace_back(config->m_LastAccess.load(std::memory_order_relaxed), config.get());
+				}
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		const uint64_t now = ::GetTickCount64();
+		const size_t memoryLimit = GetMemoryLimit();
+		size_t count = 0;
+		for (const auto& [lastAccess, config]: candidates)
+		{
+			if (m_MemoryInUse <= memoryLimit || lastAccess + EvictionMinIdleTime > now)
+			{
+				break;
+			}
+
+			// Skip the file if it was accessed since the candidates were taken
+			ReaderBiasedLock::WriteGuard lock(config->m_Lock);
+			if (config->m_LastAccess == lastAccess && config->Evict())
+			{
+				const size_t stubMemoryUsage = config->GetStubMemoryUsage();
+				m_MemoryInUse -= config->m_MemoryUsage.exchange(stubMemoryUsage) - stubMemoryUsage;
+				count++;
+			}
+		}
+		m_EvictionCount += count;
+
+		// Everything left is either dirty or still in use, try again later
+		if (m_MemoryInUse > memoryLimit)
+		{
+			m_NextEvictionTime = now + EvictionRetryDelay;
+			m_IsEvictionPending = true;
+		}
+		if (count != 0 && m_SnapshotPublisher)
+		{
+			m_SnapshotPublisher->Schedule();
+		}
+
+		KX_SCOPEDLOG.Info().Format("Evicted {} files, memory in use: {} bytes (out of {})", count, m_MemoryInUse.load(), memoryLimit);
+		KX_SCOPEDLOG.LogReturn(count);
+		return count;
+	}
+
+	void CALLBACK Redirector::OnEvictionWork(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
+	{
+		static_cast<Redirector*>(context)->EvictColdFiles();
+	}
+	void Redirector::ScheduleEviction()
+	{
+		// Not created in 'DllMain', the first file over the limit creates it
+		std::call_once(m_EvictionWorkCreated, [&]()
+		{
+			m_EvictionWork = ::CreateThreadpoolWork(&Redirector::OnEvictionWork, this, nullptr);
+			if (!m_EvictionWork)
+			{
+				kxf::Log::WarningCategory("MemoryLimit", "Failed to create the eviction work, {}", kxf::Win32Error::GetLastError());
+			}
+		});
+
+		if (m_EvictionWork)
+		{
+			::SubmitThreadpoolWork(m_EvictionWork);
+		}
+	}
+
 	ConfigObject& Redirector::GetOrLoadFile(const kxf::String& filePath)
 	{
+		// Only one eviction is pending at a time, it takes the file locks on its own thread
+		if (m_IsEvictionPending.load(std::memory_order_relaxed) && ::GetTickCount64() >= m_NextEvictionTime && m_IsEvictionPending.exchange(false))
+		{
+			ScheduleEviction();
+		}
+
 		// Get loaded file
-		if (kxf::ReadLockGuard lock(m_INIMapLock); !m_INIMap.empty())
+		const FoldedName foldedPath(filePath);
+		const bool isMemoizable = IsPathMemoizable(kxf::StringViewOf(filePath));
+		if (ReaderBiasedLock::ReadGuard lock(m_INIMapLock); isMemoizable && !m_PathMemo.empty())
 		{
-			if (auto it = m_INIMap.find(filePath); it != m_INIMap.end())
+			if (auto it = m_PathMemo.find(foldedPath); it != m_PathMemo.end())
 			{
+				if (m_MemoryLimit != 0)
+				{
+					it->second->OnAccess();
+				}
+				return *it->second;
+			}
+		}
+
+		// Resolve the path outside of the lock, this is done only once per distinct absolute path spelling
+		// and on every call for the relative ones.
+		TraceSpan traceSpan(m_TraceRecorder.get(), "GetOrLoadFile");
+		kxf::String canonicalPath = ResolveFilePath(filePath);
+		if (!isMemoizable)
+		{
+			ReaderBiasedLock::ReadGuard lock(m_INIMapLock);
+			if (auto it = m_INIMap.find(canonicalPath); it != m_INIMap.end())
+			{
+				if (m_MemoryLimit != 0)
+				{
+					it->second->OnAccess();
+				}
 				return *it->second;
 			}
 		}
 
-		// Load the file
 		KX_SCOPEDLOG_ARGS(filePath);
-		kxf::WriteLockGuard lock(m_INIMapLock);
+		ReaderBiasedLock::WriteGuard lock(m_INIMapLock);
+		if (auto it = m_PathMemo.find(foldedPath); isMemoizable && it != m_PathMemo.end())
+		{
+			// Another thread got here first
+			KX_SCOPEDLOG.SetSuccess();
+			return *it->second;
+		}
 
-		auto& config = m_INIMap.insert_or_assign(filePath, std::make_unique<ConfigObject>(filePath)).first->second;
-		config->LoadFile();
+		auto [it, inserted] = m_INIMap.try_emplace(canonicalPath);
+		if (inserted)
+		{
+			// Load the file
+			it->second = std::make_unique<ConfigObject>(canonicalPath);
+			it->second->LoadFile();
+
+			KX_SCOPEDLOG.Info().Format("Attempt to access file: '{}' -> '{}' file object initialized. Exist on disk: {}", filePath, canonicalPath, it->second->IsExistOnDisk());
+		}
+		else
+		{
+			m_PathAliasCount++;
+			KX_SCOPEDLOG.Info().Format("Attempt to access file: '{}' -> using already loaded file object for '{}'", filePath, canonicalPath);
+		}
+		ConfigObject& config = *it->second;
+		if (isMemoizable)
+		{
+			m_PathMemo.insert_or_assign(std::wstring(foldedPath.GetFolded()), &config);
+		}
 
-		KX_SCOPEDLOG.Info().Format("Attempt to access file: '{}' -> file object initialized. Exist on disk: {}", filePath, config->IsExistOnDisk());
-		
 		KX_SCOPEDLOG.SetSuccess();
-		return *config;
+		return config;
 	}
 	size_t Redirector::SaveChangedFiles(const wchar_t* message)
 	{
-		KX_SCOPEDLOG_ARGS(message, m_TotalWriteCount.load());
+		// Nothing was written since the last flush, this is the common case for the thread detach notifications
+		if (!m_DirtyFiles.load(std::memory_order_acquire))
+		{
+			return 0;
+		}
+		const size_t writeCount = m_TotalWriteCount;
+		KX_SCOPEDLOG_ARGS(message, writeCount);
+		TraceSpan traceSpan(m_TraceRecorder.get(), "SaveChangedFiles");
 
+		// Take the whole list at once, files written after this point are going to be pushed into a new list
+		size_t dirtyCount = 0;
 		size_t changedCount = 0;
-		if (kxf::ReadLockGuard lock(m_INIMapLock); !m_INIMap.empty())
+		size_t failedCount = 0;
+		for (ConfigObject* config = m_DirtyFiles.exchange(nullptr, std::memory_order_acquire); config;)
 		{
-			for (const auto& [path, config]: m_INIMap)
-			{
-				auto lock = config->LockExclusive();
+			// Read the link before unlisting the file as it can be pushed again right after that
+			ConfigObject* next = config->m_NextDirty;
+			auto lock = config->LockExclusive();
+			config->m_IsDirtyListed = false;
+			config->m_NextDirty = nullptr;
+			dirtyCount++;
 
-				if (config->HasChanges())
+			if (config->HasChanges())
+			{
+				if (config->SaveFile())
 				{
-					if (config->SaveFile())
-					{
-						changedCount++;
-						KX_SCOPEDLOG.Info().Format("File saved: '{}', is empty: {}", path, config->IsEmpty());
-					}
+					changedCount++;
+					KX_SCOPEDLOG.Info().Format("File saved: '{}', is empty: {}", config->GetFilePath().GetFullPath(), config->IsEmpty());
 				}
-				else
+				else if (config->HasChanges() && !config->m_IsDirtyListed.exchange(true))
 				{
-					KX_SCOPEDLOG.Info().Format("No changes: '{}', is empty: {}", path, config->IsEmpty());
+					// The changes are still there, put the file back to be retried by the next flush
+					PushDirtyFile(*config);
+					failedCount++;
 				}
 			}
-			KX_SCOPEDLOG.Info().Format("All changed files saved. Total: {}, Changed: {}", m_INIMap.size(), changedCount);
+			config = next;
+		}
+		KX_SCOPEDLOG.Info().Format("All changed files saved. Dirty: {}, Changed: {}, Failed: {}", dirtyCount, changedCount, failedCount);
+		m_FlushCount++;
+
+		// Only the writes seen before taking the list are flushed, the ones made since then start a new budget.
+		// A racing writer either is counted here or finds the time reset and arms the timer by itself.
+		m_FirstPendingWriteTime = 0;
+		if (m_TotalWriteCount.fetch_sub(writeCount) != writeCount)
+		{
+			uint64_t firstWriteTime = 0;
+			if (m_FirstPendingWriteTime.compare_exchange_strong(firstWriteTime, ::GetTickCount64()) && m_SaveOnWriteTotalDelay > 0)
+			{
+				ScheduleFlushTimer(m_SaveOnWriteTotalDelay);
+			}
 		}
-		m_TotalWriteCount = 0;
 
 		KX_SCOPEDLOG.LogReturn(changedCount);
 		return changedCount;
@@ -340,42 +730,403 @@ namespace PPR
 	size_t Redirector::OnFileWrite(ConfigObject& configObject) noexcept
 	{
 		auto count = ++m_TotalWriteCount;
-		#if 0
-		if (m_SaveOnWriteBuffer > 0)
+		if (m_SaveOnWriteTotalBuffer > 0 || m_SaveOnWriteTotalDelay > 0)
 		{
-			if (count >= m_SaveOnWriteBuffer)
+			const uint64_t now = ::GetTickCount64();
+			uint64_t firstWriteTime = 0;
+			if (m_FirstPendingWriteTime.compare_exchange_strong(firstWriteTime, now))
+			{
+				firstWriteTime = now;
+				if (m_SaveOnWriteTotalDelay > 0)
+				{
+					ScheduleFlushTimer(m_SaveOnWriteTotalDelay);
+				}
+			}
+
+			// The file that is being written to is locked at this point, so the flush itself is deferred
+			// until the write function releases the lock, see 'FlushPendingWrites'.
+			if (m_SaveOnWriteTotalBuffer > 0 && count >= static_cast<size_t>(m_SaveOnWriteTotalBuffer))
 			{
-				kxf::Log::TraceCategory("SaveOnWrite:Total", "Total changes amount {} reached buffer capacity ({}), flushing changes", count, m_SaveOnWriteBuffer);
-				SaveChangedFiles(L"Total file writes");
+				kxf::Log::TraceCategory("SaveOnWrite:Total", "Total changes amount {} reached buffer capacity ({}), flushing changes", count, m_SaveOnWriteTotalBuffer);
+				m_BatchFlushPending = true;
+			}
+			else if (m_SaveOnWriteTotalDelay > 0 && now - firstWriteTime >= static_cast<uint64_t>(m_SaveOnWriteTotalDelay))
+			{
+				kxf::Log::TraceCategory("SaveOnWrite:Total", "Oldest pending change is {} ms old (out of {}), flushing changes", now - firstWriteTime, m_SaveOnWriteTotalDelay);
+				m_BatchFlushPending = true;
+			}
+			else if (m_SaveOnWriteTotalBuffer > 0)
+			{
+				kxf::Log::TraceCategory("SaveOnWrite:Total", "Accumulated {} changes (out of {}) for all files", count, m_SaveOnWriteTotalBuffer);
 			}
 			else
 			{
-				kxf::Log::TraceCategory("SaveOnWrite:Total", "Accumulated {} changes (out of {}) for all files", count, m_SaveOnWriteBuffer);
+				// Only the delay is set, there's no buffer capacity to report
+				kxf::Log::TraceCategory("SaveOnWrite:Total", "Accumulated {} changes for all files", count);
 			}
 		}
-		#endif
 
 		return count;
 	}
+	void CALLBACK Redirector::OnFlushTimer(PTP_CALLBACK_INSTANCE instance, void* context, PTP_TIMER timer)
+	{
+		Redirector& redirector = *static_cast<Redirector*>(context);
+
+		// Everything could've been flushed by the writes in the meantime
+		const uint64_t firstWriteTime = redirector.m_FirstPendingWriteTime;
+		if (firstWriteTime == 0)
+		{
+			return;
+		}
+
+		const uint64_t now = ::GetTickCount64();
+		const uint64_t delay = static_cast<uint64_t>(redirector.m_SaveOnWriteTotalDelay);
+		if (now - firstWriteTime >= delay)
+		{
+			kxf::Log::TraceCategory("SaveOnWrite:Total", "Oldest pending change is {} ms old (out of {}), flushing changes on timer", now - firstWriteTime, delay);
+			redirector.m_BatchFlushPending = true;
+			redirector.FlushPendingWrites();
+		}
+		else
+		{
+			redirector.ScheduleFlushTimer(firstWriteTime + delay - now);
+		}
+	}
+	void Redirector::ScheduleFlushTimer(uint64_t delay)
+	{
+		// Not created in 'DllMain', the first write creates it
+		std::call_once(m_FlushTimerCreated, [&]()
+		{
+			m_FlushTimer = ::CreateThreadpoolTimer(&Redirector::OnFlushTimer, this, nullptr);
+		});
+
+		if (m_FlushTimer)
+		{
+			// Relative due time in 100 ns units
+			ULARGE_INTEGER dueTime = {};
+			dueTime.QuadPart = static_cast<ULONGLONG>(-static_cast<LONGLONG>(delay * 10000));
+
+			FILETIME fileTime = {};
+			fileTime.dwLowDateTime = dueTime.LowPart;
+			fileTime.dwHighDateTime = dueTime.HighPart;
+			::SetThreadpoolTimer(m_FlushTimer, &fileTime, 0, 0);
+		}
+	}
+	size_t Redirector::FlushPendingWrites()
+	{
+		if (m_BatchFlushPending.exchange(false))
+		{
+			m_BatchedFlushCount++;
+			const size_t count = SaveChangedFiles(L"Total write budget");
+			m_Subscriptions.Deliver();
+
+			return count;
+		}
+		return 0;
+	}
+	void Redirector::PushDirtyFile(ConfigObject& configObject) noexcept
+	{
+		ConfigObject* head = m_DirtyFiles.load(std::memory_order_relaxed);
+		do
+		{
+			configObject.m_NextDirty = head;
+		}
+		while (!m_DirtyFiles.compare_exchange_weak(head, &configObject, std::memory_order_release, std::memory_order_relaxed));
+	}
 	size_t Redirector::RefreshINI()
 	{
 		KX_SCOPEDLOG_FUNC;
+		TraceSpan traceSpan(m_TraceRecorder.get(), "RefreshINI");
 
 		size_t count = 0;
-		if (kxf::WriteLockGuard lock(m_INIMapLock); !m_INIMap.empty())
+		if (ReaderBiasedLock::WriteGuard lock(m_INIMapLock); !m_INIMap.empty())
 		{
 			for (const auto& [path, config]: m_INIMap)
 			{
-				KX_SCOPEDLOG.Info().Format(L"Reloading '{}'", path);
+				// Evicted files are read from the disk anyway once they're accessed again
+				ReaderBiasedLock::WriteGuard lock(config->m_Lock);
+				if (config->IsEvicted())
+				{
+					continue;
+				}
 
-				auto lock = config->LockExclusive();
+				KX_SCOPEDLOG.Info().Format(L"Reloading '{}'", path);
 				config->LoadFile();
 				count++;
 			}
-			KX_SCOPEDLOG.Info().Format(L"Executing 'RefreshINI' done, {} files reloaded", m_INIMap.size());
+			KX_SCOPEDLOG.Info().Format(L"Executing 'RefreshINI' done, {} files reloaded", count);
 		}
 
+		// Every reloaded file is marked as changed for its subscribers, the map lock has to be released for the callbacks
+		m_Subscriptions.Deliver();
+
 		KX_SCOPEDLOG.LogReturn(count);
 		return count;
 	}
+	void Redirector::Shutdown()
+	{
+		KX_SCOPEDLOG_FUNC;
+
+		StopBackgroundWork();
+
+		// Files which are waiting for their idle deadline are saved now as well, it's not going to come.
+		// Deferred native writes are always replayed, the callers were told they've been written.
+		SaveOnShutdown(IsOptionEnabled(RedirectorOption::SaveOnProcessDetach) || m_IdleSaveScheduler);
+
+		KX_SCOPEDLOG.SetSuccess();
+	}
+	void Redirector::StopBackgroundWork()
+	{
+		// Nothing runs in the background after this point. When the process is terminating the threads are gone already
+		// and nothing waits for them, the thread pool can be in any state then so its timer is left alone.
+		// The subscribers are stopped first, so a flush in progress doesn't call any more callbacks.
+		m_Subscriptions.Stop();
+		if (m_FlushTimer)
+		{
+			if (!ReaderBiasedLock::IsProcessTerminating())
+			{
+				::SetThreadpoolTimer(m_FlushTimer, nullptr, 0, 0);
+				::WaitForThreadpoolTimerCallbacks(m_FlushTimer, TRUE);
+				::CloseThreadpoolTimer(m_FlushTimer);
+			}
+			m_FlushTimer = nullptr;
+		}
+		if (m_EvictionWork)
+		{
+			if (!ReaderBiasedLock::IsProcessTerminating())
+			{
+				::WaitForThreadpoolWorkCallbacks(m_EvictionWork, TRUE);
+				::CloseThreadpoolWork(m_EvictionWork);
+			}
+			m_EvictionWork = nullptr;
+		}
+
+		if (m_IdleSaveScheduler)
+		{
+			m_IdleSaveScheduler->Stop();
+		}
+		if (m_PerfectHashBuilder)
+		{
+			m_PerfectHashBuilder->Stop();
+		}
+		if (m_SnapshotPublisher)
+		{
+			m_SnapshotPublisher->Stop();
+		}
+	}
+	size_t Redirector::SaveOnShutdown(bool saveChanges)
+	{
+		KX_SCOPEDLOG_ARGS(saveChanges);
+
+		// Every file is checked instead of the dirty list, a file which save was cut short by the termination
+		// has already been taken off the list.
+		std::vector<ConfigObject*> files;
+		if (ReaderBiasedLock::ReadGuard lock(m_INIMapLock); !lock.IsAbandoned())
+		{
+			for (const auto& [path, config]: m_INIMap)
+			{
+				files.push_back(config.get());
+			}
+		}
+		else
+		{
+			KX_SCOPEDLOG.Warning().Format("The file map was being changed when the process terminated, saving only the listed files");
+			for (ConfigObject* config = m_DirtyFiles.exchange(nullptr); config; config = config->m_NextDirty)
+			{
+				files.push_back(config);
+			}
+		}
+
+		size_t savedCount = 0;
+		size_t replayedCount = 0;
+		for (ConfigObject* config: files)
+		{
+			// The queue doesn't depend on the document, it's replayed whatever state the file is in
+			ReaderBiasedLock::WriteGuard lock(config->m_Lock);
+			if (!config->m_NativeWrites.IsEmpty())
+			{
+				replayedCount += config->ReplayNativeWrites();
+			}
+			if (!saveChanges)
+			{
+				continue;
+			}
+
+			// The document is only read while it's being saved, so an interrupted save can be done again.
+			// Anything else could've left it half-changed, a value write holds its section lock as well.
+			const bool isSaveInterrupted = config->m_IsSaving;
+			if ((lock.IsAbandoned() && !isSaveInterrupted) || config->HasAbandonedSectionLock())
+			{
+				KX_SCOPEDLOG.Warning().Format("'{}' was being changed when the process terminated, it's not saved", config->GetFilePath().GetFullPath());
+				continue;
+			}
+
+			if (config->HasChanges() || isSaveInterrupted)
+			{
+				if (isSaveInterrupted)
+				{
+					KX_SCOPEDLOG.Warning().Format("Saving '{}' again, the previous save was interrupted", config->GetFilePath().GetFullPath());
+				}
+				if (config->SaveFile())
+				{
+					savedCount++;
+				}
+			}
+		}
+		m_FlushCount++;
+
+		KX_SCOPEDLOG.Info().Format("Saved {} files, replayed {} deferred native writes", savedCount, replayedCount);
+		KX_SCOPEDLOG.LogReturn(savedCount);
+		return savedCount;
+	}
+	void Redirector::LogStatistics() const
+	{
+		KX_SCOPEDLOG_FUNC;
+
+		MemoryStats totalMemory;
+		size_t perfectHashCount = 0;
+		size_t perfectHashEntries = 0;
+		size_t perfectHashBytes = 0;
+		size_t nativeWritesReplayed = 0;
+		size_t nativeWritesCollapsed = 0;
+		size_t evictedCount = 0;
+		size_t fileCount = 0;
+		size_t pathSpellingCount = 0;
+		size_t pathAliasCount = 0;
+		if (ReaderBiasedLock::ReadGuard lock(m_INIMapLock); !lock.IsAbandoned() && !m_INIMap.empty())
+		{
+			fileCount = m_INIMap.size();
+			pathSpellingCount = m_PathMemo.size();
+			pathAliasCount = m_PathAliasCount;
+
+			for (const auto& [path, config]: m_INIMap)
+			{
+				// Don't load the evicted files again just to report them
+				ReaderBiasedLock::ReadGuard lock(config->m_Lock);
+				if (config->IsEvicted())
+				{
+					evictedCount++;
+				}
+				MemoryStats memory = config->GetINI().GetMemoryStats();
+
+				KX_SCOPEDLOG.Info().Format("'{}': index: {} allocations in {} blocks ({} bytes), total blocks: {} ({} bytes), compactions: {}, interned: {} bytes",
+										   path,
+										   memory.IndexAllocations,
+										   memory.Allocations,
+										   memory.AllocatedBytes,
+										   memory.TotalAllocations,
+										   memory.TotalAllocatedBytes,
+										   memory.Compactions,
+										   memory.InternedBytes
+				);
+				totalMemory += memory;
+
+				if (const PerfectHashIndex* perfectHash = config->GetINI().GetPerfectHash())
+				{
+					perfectHashCount++;
+					perfectHashEntries += perfectHash->GetSize();
+					perfectHashBytes += perfectHash->GetMemorySize();
+				}
+
+				nativeWritesReplayed += config->GetNativeWriteQueue().GetReplayedCount();
+				nativeWritesCollapsed += config->GetNativeWriteQueue().GetCollapsedCount();
+			}
+		}
+
+		KX_SCOPEDLOG.Info().Format("Files: {}, path spellings: {}, duplicate file objects avoided: {}", fileCount, pathSpellingCount, pathAliasCount);
+		KX_SCOPEDLOG.Info().Format("Flushes: {}, batched by total write budget: {}, per-file buffer flushes: {}, idle saves: {}",
+								   m_FlushCount.load(),
+								   m_BatchedFlushCount.load(),
+								   m_BufferFlushCount.load(),
+								   m_IdleSaveScheduler ? m_IdleSaveScheduler->GetSaveCount() : 0
+		);
+		if (IsOptionEnabled(RedirectorOption::NativeWriteDeferred))
+		{
+			KX_SCOPEDLOG.Info().Format("Deferred native writes replayed: {}, collapsed: {}", nativeWritesReplayed, nativeWritesCollapsed);
+		}
+		KX_SCOPEDLOG.Info().Format("Files: {}, indexes: {} allocations in {} blocks ({} bytes), total blocks: {} ({} bytes), compactions: {}",
+								   fileCount,
+								   totalMemory.IndexAllocations,
+								   totalMemory.Allocations,
+								   totalMemory.AllocatedBytes,
+								   totalMemory.TotalAllocations,
+								   totalMemory.TotalAllocatedBytes,
+								   totalMemory.Compactions
+		);
+
+		const ValuePool::Stats valuePool = ValuePool::GetInstance().GetStats();
+		KX_SCOPEDLOG.Info().Format("Value pool entries: {} ({} bytes), interned: {} bytes, saved: {} bytes",
+								   valuePool.Entries,
+								   valuePool.StoredBytes,
+								   totalMemory.InternedBytes,
+								   totalMemory.InternedBytes > valuePool.StoredBytes ? totalMemory.InternedBytes - valuePool.StoredBytes : 0
+		);
+		if (m_MemoryLimit != 0)
+		{
+			KX_SCOPEDLOG.Info().Format("Memory in use: {} bytes (out of {}), evicted files: {}, evictions: {}, reloads: {}",
+									   m_MemoryInUse.load(),
+									   GetMemoryLimit(),
+									   evictedCount,
+									   m_EvictionCount.load(),
+									   m_ReloadCount.load()
+			);
+		}
+		if (m_PerfectHashBuilder)
+		{
+			KX_SCOPEDLOG.Info().Format("Perfect hash indexes: {} ({} entries, {} bytes), builds: {}, discarded: {}",
+									   perfectHashCount,
+									   perfectHashEntries,
+									   perfectHashBytes,
+									   m_PerfectHashBuilder->GetBuildCount(),
+									   m_PerfectHashBuilder->GetDiscardCount()
+			);
+		}
+		if (m_SnapshotPublisher)
+		{
+			KX_SCOPEDLOG.Info().Format("Shared snapshots published: {}, last size: {} bytes (out of {}), truncated: {}",
+									   m_SnapshotPublisher->GetPublishCount(),
+									   m_SnapshotPublisher->GetDataSize(),
+									   m_SnapshotPublisher->GetRegionSize(),
+									   m_SnapshotPublisher->GetTruncatedCount()
+			);
+		}
+		if (m_Subscriptions.GetCount() != 0 || m_Subscriptions.GetDeliveryCount() != 0)
+		{
+			KX_SCOPEDLOG.Info().Format("Change subscriptions: {}, notifications delivered: {}", m_Subscriptions.GetCount(), m_Subscriptions.GetDeliveryCount());
+		}
+		if (m_CallerStatistics)
+		{
+			for (const kxf::String& line: m_CallerStatistics->GetReport())
+			{
+				KX_SCOPEDLOG.Info().Format("Caller {}", line);
+			}
+		}
+		KX_SCOPEDLOG.SetSuccess();
+	}
+	bool Redirector::SaveTraceEvents()
+	{
+		if (!m_TraceRecorder)
+		{
+			return false;
+		}
+		KX_SCOPEDLOG_FUNC;
+
+		auto stream = m_ConfigFS.OpenToWrite("PrivateProfileRedirector.trace.json");
+		if (!stream)
+		{
+			stream = m_PluginFS.OpenToWrite("PrivateProfileRedirector.trace.json");
+		}
+
+		if (stream)
+		{
+			m_TraceRecorder->WriteJSON(*stream);
+
+			KX_SCOPEDLOG.Info().Format("Trace events written: {}, dropped: {}", m_TraceRecorder->GetSpanCount(), m_TraceRecorder->GetDroppedCount());
+			KX_SCOPEDLOG.LogReturn(true);
+			return true;
+		}
+
+		KX_SCOPEDLOG.LogReturn(false);
+		return false;
+	}
 }
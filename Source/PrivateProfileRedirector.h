@@ -5,10 +5,17 @@
 #include "FunctionRedirector.h"
 #include "FunctionTable.h"
 #include "ConfigObject.h"
+#include "ProfileMapping.h"
+#include "IdleSaveScheduler.h"
+#include "CallerStatistics.h"
+#include "TraceRecorder.h"
+#include "PerfectHashBuilder.h"
+#include "SubscriptionManager.h"
+#include "SnapshotPublisher.h"
 #include <kxf/Core/IEncodingConverter.h>
 #include <kxf/FileSystem/NativeFileSystem.h>
-#include <kxf/Threading/ReadWriteLock.h>
 #include <kxf/Utility/String.h>
+#include <mutex>
 
 namespace PPR
 {
@@ -20,6 +27,7 @@ namespace PPR
 	class Redirector final
 	{
 		friend class RedirectorConfigLoader;
+		friend class SnapshotPublisher;
 
 		public:
 			static bool HasInstance();
@@ -29,10 +37,11 @@ namespace PPR
 			static kxf::String GetLibraryAuthor();
 			static kxf::Version GetLibraryVersion();
 
-			static bool DllMain(HMODULE module, DWORD event);
+			static bool DllMain(HMODULE module, DWORD event, void* reserved);
 
 		private:
 			FunctionTable m_Functions;
+			ProfileMapping m_ProfileMapping;
 
 			kxf::NativeFileSystem m_PluginFS;
 			kxf::NativeFileSystem m_ConfigFS;
@@ -40,19 +49,83 @@ namespace PPR
 			kxf::FlagSet<RedirectorOption> m_Options;
 			std::unique_ptr<kxf::IEncodingConverter> m_EncodingConverter;
 			int m_SaveOnWriteBuffer = 0;
+			int m_SaveOnWriteTotalBuffer = 0;
+			int m_SaveOnWriteTotalDelay = 0;
+			int m_SaveOnIdle = 0;
+			int m_SaveOnIdleMaxLatency = 0;
+			int m_SharedSnapshotSize = 4096;
+			int m_MemoryLimit = 0;
+			std::unique_ptr<IdleSaveScheduler> m_IdleSaveScheduler;
+			std::unique_ptr<CallerStatistics> m_CallerStatistics;
+			kxf::String m_CallerStatisticsCommand;
+			std::unique_ptr<TraceRecorder> m_TraceRecorder;
+			std::unique_ptr<PerfectHashBuilder> m_PerfectHashBuilder;
+			std::unique_ptr<SnapshotPublisher> m_SnapshotPublisher;
+			SubscriptionManager m_Subscriptions;
 
-			mutable kxf::ReadWriteLock m_INIMapLock;
+			// Files are owned by 'm_INIMap' which is keyed by the canonical absolute path, 'm_PathMemo' maps every distinct
+			// path spelling requested by the callers to the file object so the path resolution is done only once per spelling.
+			// Only the spellings which don't depend on the working directory are memoized, see 'IsPathMemoizable'.
+			mutable ReaderBiasedLock m_INIMapLock;
 			kxf::Utility::UnorderedMapNoCase<kxf::String, std::unique_ptr<ConfigObject>> m_INIMap;
+			std::unordered_map<std::wstring, ConfigObject*, FoldedName::Hash, FoldedName::Equal> m_PathMemo;
+			size_t m_PathAliasCount = 0;
 			std::atomic<size_t> m_TotalWriteCount = 0;
 
+			// Lock-free stack of files that were written to since the last flush, linked through 'ConfigObject::m_NextDirty'
+			std::atomic<ConfigObject*> m_DirtyFiles = nullptr;
+
+			// Global write budget across all files. The total delay is checked by every write and by a timer armed
+			// by the first pending one, so the changes are flushed on time even if no other write comes after them.
+			std::atomic<uint64_t> m_FirstPendingWriteTime = 0;
+			std::atomic<bool> m_BatchFlushPending = false;
+			PTP_TIMER m_FlushTimer = nullptr;
+			std::once_flag m_FlushTimerCreated;
+
+			// Memory cap, clean files which weren't accessed for 'EvictionMinIdleTime' are evicted in the LRU order
+			// once the loaded files take more than 'MemoryLimit' megabytes, see 'EvictColdFiles'. The evicted files
+			// still count with their stub objects. The eviction runs on a thread pool thread, not on the caller's one.
+			std::atomic<size_t> m_MemoryInUse = 0;
+			std::atomic<bool> m_IsEvictionPending = false;
+			PTP_WORK m_EvictionWork = nullptr;
+			std::once_flag m_EvictionWorkCreated;
+			std::atomic<uint64_t> m_NextEvictionTime = 0;
+			std::atomic<size_t> m_EvictionCount = 0;
+			std::atomic<size_t> m_ReloadCount = 0;
+
+			// Statistics
+			std::atomic<size_t> m_FlushCount = 0;
+			std::atomic<size_t> m_BatchedFlushCount = 0;
+			std::atomic<size_t> m_BufferFlushCount = 0;
+
+		private:
+			static constexpr uint64_t EvictionMinIdleTime = 5000;
+			static constexpr uint64_t EvictionRetryDelay = 1000;
+
 		private:
 			void InitConfig();
 			bool OpenLog(kxf::LogLevel logLevel);
 
+			static void CALLBACK OnFlushTimer(PTP_CALLBACK_INSTANCE instance, void* context, PTP_TIMER timer);
+			void ScheduleFlushTimer(uint64_t delay);
+			static void CALLBACK OnEvictionWork(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work);
+			void ScheduleEviction();
+
+			kxf::String ResolveFilePath(const kxf::String& filePath) const;
+			static bool IsPathMemoizable(kxf::StringView filePath) noexcept;
+			size_t EvictColdFiles();
+			size_t GetMemoryLimit() const noexcept
+			{
+				return static_cast<size_t>(m_MemoryLimit) * 1024 * 1024;
+			}
+
 			void InitFunctions();
 			void OverrideFunctions();
 			void RestoreFunctions();
 
+			void StopBackgroundWork();
+			size_t SaveOnShutdown(bool saveChanges);
+
 		public:
 			Redirector();
 			~Redirector();
@@ -63,6 +136,10 @@ namespace PPR
 				return m_Functions;
 			}
 			SEInterface& GetSEInterface() const noexcept;
+			ProfileMapping& GetProfileMapping() noexcept
+			{
+				return m_ProfileMapping;
+			}
 			kxf::IEncodingConverter& GetEncodingConverter() const noexcept
 			{
 				return *m_EncodingConverter;
@@ -76,6 +153,34 @@ namespace PPR
 				}
 				return {};
 			}
+			IdleSaveScheduler* GetIdleSaveScheduler() const noexcept
+			{
+				return m_IdleSaveScheduler.get();
+			}
+			CallerStatistics* GetCallerStatistics() const noexcept
+			{
+				return m_CallerStatistics.get();
+			}
+			const kxf::String& GetCallerStatisticsCommand() const noexcept
+			{
+				return m_CallerStatisticsCommand;
+			}
+			TraceRecorder* GetTraceRecorder() const noexcept
+			{
+				return m_TraceRecorder.get();
+			}
+			PerfectHashBuilder* GetPerfectHashBuilder() const noexcept
+			{
+				return m_PerfectHashBuilder.get();
+			}
+			SnapshotPublisher* GetSnapshotPublisher() const noexcept
+			{
+				return m_SnapshotPublisher.get();
+			}
+			SubscriptionManager& GetSubscriptions() noexcept
+			{
+				return m_Subscriptions;
+			}
 			bool IsOptionEnabled(RedirectorOption option) const noexcept
 			{
 				return m_Options.Contains(option);
@@ -84,6 +189,27 @@ namespace PPR
 			ConfigObject& GetOrLoadFile(const kxf::String& filePath);
 			size_t SaveChangedFiles(const wchar_t* message);
 			size_t OnFileWrite(ConfigObject& configObject) noexcept;
+			size_t FlushPendingWrites();
+			void OnFileBufferFlush() noexcept
+			{
+				m_BufferFlushCount++;
+			}
+			void PushDirtyFile(ConfigObject& configObject) noexcept;
+			void OnFileLoad(size_t oldMemoryUsage, size_t newMemoryUsage) noexcept
+			{
+				const size_t memoryInUse = m_MemoryInUse += newMemoryUsage - oldMemoryUsage;
+				if (m_MemoryLimit != 0 && memoryInUse > GetMemoryLimit())
+				{
+					m_IsEvictionPending = true;
+				}
+			}
+			void OnFileReload() noexcept
+			{
+				m_ReloadCount++;
+			}
 			size_t RefreshINI();
+			void Shutdown();
+			void LogStatistics() const;
+			bool SaveTraceEvents();
 	};
 }
@@ -0,0 +1,86 @@
+#include "stdafx.h"
+#include "ProfileMapping.h"
+
+namespace
+{
+	constexpr wchar_t IniFileMappingKey[] = L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\IniFileMapping\\win.ini";
+}
+
+namespace PPR
+{
+	void ProfileMapping::Initialize()
+	{
+		KX_SCOPEDLOG_FUNC;
+
+		// File path
+		wchar_t windowsDirectory[MAX_PATH] = {};
+		if (size_t length = ::GetWindowsDirectoryW(windowsDirectory, std::size(windowsDirectory)); length != 0 && length < std::size(windowsDirectory))
+		{
+			m_PathW = windowsDirectory;
+		}
+		m_PathW += L"\\win.ini";
+
+		char windowsDirectoryA[MAX_PATH] = {};
+		if (size_t length = ::GetWindowsDirectoryA(windowsDirectoryA, std::size(windowsDirectoryA)); length != 0 && length < std::size(windowsDirectoryA))
+		{
+			m_PathA = windowsDirectoryA;
+		}
+		m_PathA += "\\win.ini";
+
+		// Registry-mapped sections, both listed as values and subkeys. Unnamed (default) value means the whole file is mapped.
+		HKEY key = nullptr;
+		if (::RegOpenKeyExW(HKEY_LOCAL_MACHINE, IniFileMappingKey, 0, KEY_READ, &key) == ERROR_SUCCESS)
+		{
+			wchar_t name[256] = {};
+			for (DWORD i = 0; ; i++)
+			{
+				DWORD nameLength = std::size(name);
+				if (::RegEnumValueW(key, i, name, &nameLength, nullptr, nullptr, nullptr, nullptr) != ERROR_SUCCESS)
+				{
+					break;
+				}
+
+				if (nameLength == 0)
+				{
+					m_AllSectionsMapped = true;
+				}
+				else
+				{
+					m_MappedSections.emplace_back(name, nameLength);
+				}
+			}
+			for (DWORD i = 0; ; i++)
+			{
+				DWORD nameLength = std::size(name);
+				if (::RegEnumKeyExW(key, i, name, &nameLength, nullptr, nullptr, nullptr, nullptr) != ERROR_SUCCESS)
+				{
+					break;
+				}
+				m_MappedSections.emplace_back(name, nameLength);
+			}
+			::RegCloseKey(key);
+		}
+
+		KX_SCOPEDLOG.Info().Format(L"Path: '{}', registry-mapped sections: {}, all sections mapped: {}", m_PathW, m_MappedSections.size(), m_AllSectionsMapped);
+		KX_SCOPEDLOG.SetSuccess();
+	}
+
+	bool ProfileMapping::IsSectionMapped(const kxf::String& section)
+	{
+		EnsureInitialized();
+		if (m_AllSectionsMapped)
+		{
+			return true;
+		}
+
+		auto sectionView = kxf::StringViewOf(section);
+		for (const std::wstring& mappedSection: m_MappedSections)
+		{
+			if (::CompareStringOrdinal(mappedSection.data(), static_cast<int>(mappedSection.length()), sectionView.data(), static_cast<int>(sectionView.length()), TRUE) == CSTR_EQUAL)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
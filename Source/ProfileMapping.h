@@ -0,0 +1,61 @@
+#pragma once
+#include "stdafx.h"
+#include <mutex>
+
+namespace PPR
+{
+	// Describes how the non-private 'GetProfile*'/'WriteProfile*' functions are mapped: the 'win.ini' file in the Windows directory
+	// and the list of its sections redirected to the registry by the 'IniFileMapping' key. Registry-mapped sections aren't stored
+	// in the file at all so they're left to the native implementation.
+	class ProfileMapping final
+	{
+		private:
+			std::once_flag m_InitFlag;
+
+			std::string m_PathA;
+			std::wstring m_PathW;
+			std::vector<std::wstring> m_MappedSections;
+			bool m_AllSectionsMapped = false;
+
+		private:
+			void Initialize();
+			void EnsureInitialized()
+			{
+				std::call_once(m_InitFlag, &ProfileMapping::Initialize, this);
+			}
+
+		public:
+			ProfileMapping() = default;
+			ProfileMapping(const ProfileMapping&) = delete;
+
+		public:
+			template<class TChar>
+			const TChar* GetFilePath()
+			{
+				EnsureInitialized();
+
+				if constexpr(std::is_same_v<TChar, char>)
+				{
+					return m_PathA.c_str();
+				}
+				else if constexpr(std::is_same_v<TChar, wchar_t>)
+				{
+					return m_PathW.c_str();
+				}
+				else
+				{
+					static_assert(sizeof(TChar*) == 0, "invalid type");
+				}
+			}
+
+			bool HasMappedSections()
+			{
+				EnsureInitialized();
+				return m_AllSectionsMapped || !m_MappedSections.empty();
+			}
+			bool IsSectionMapped(const kxf::String& section);
+
+		public:
+			ProfileMapping& operator=(const ProfileMapping&) = delete;
+	};
+}
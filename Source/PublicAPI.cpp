@@ -0,0 +1,258 @@
+#include "stdafx.h"
+#include "API/PrivateProfileRedirectorAPI.h"
+#include "PrivateProfileRedirector.h"
+#include "SettingParser.h"
+#include "CallTracking.h"
+#include <bit>
+#include <intrin.h>
+#pragma intrinsic(_ReturnAddress)
+
+namespace
+{
+	// See 'PPR::TrackCall', the calls of the other plugins are recorded the same way as the redirected functions
+	template<class TChar, class TFunc>
+	auto TrackAPICall(const char* name, const void* returnAddress, const TChar* fileName, TFunc&& func)
+	{
+		using namespace PPR;
+
+		Redirector& redirector = Redirector::GetInstance();
+		return PPR::TrackCall(redirector.GetCallerStatistics(), redirector.GetTraceRecorder(), name, returnAddress, [&]()
+		{
+			return fileName;
+		}, std::forward<TFunc>(func));
+	}
+
+	template<class TChar, class TResult>
+	void CopyResult(TResult& result, std::basic_string_view<TChar> value, bool found) noexcept
+	{
+		result.Length = static_cast<uint32_t>(value.length());
+		result.Found = found ? 1 : 0;
+
+		if (result.Buffer && result.BufferSize != 0)
+		{
+			const size_t copySize = std::min<size_t>(value.length(), result.BufferSize - 1);
+			std::copy_n(value.data(), copySize, result.Buffer);
+			result.Buffer[copySize] = 0;
+		}
+	}
+
+	template<class TChar, class TResult>
+	uint32_t QueryValuesT(const TChar* fileName, const TChar* sectionName, const TChar* const* keyNames, uint32_t count, TResult* results)
+	{
+		using namespace PPR;
+
+		if (!fileName || !sectionName || (count != 0 && (!keyNames || !results)))
+		{
+			::SetLastError(ERROR_INVALID_PARAMETER);
+			return 0;
+		}
+
+		KX_SCOPEDLOG_AUTO;
+		KX_SCOPEDLOG.Trace().Format("Section: '{}', Keys: {}, Path: '{}'", sectionName, count, fileName);
+
+		Redirector& redirector = Redirector::GetInstance();
+		kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
+
+		// Everything that's the same for all the keys is done only once
+		ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(fileName, converter));
+		const INIWrapper& ini = configObject.GetINI();
+		const kxf::String section = INIWrapper::EncodingTo(sectionName, converter);
+		const FoldedName foldedSection(section);
+
+		uint32_t foundCount = 0;
+		std::basic_string<TChar> buffer;
+		auto lock = configObject.LockSectionShared(foldedSection);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			std::optional<IndexValue> value;
+			if (keyNames[i])
+			{
+				const kxf::String key = INIWrapper::EncodingTo(keyNames[i], converter);
+				value = ini.FindValue(foldedSection, FoldedName(key));
+			}
+
+			if (value)
+			{
+				CopyResult<TChar>(results[i], value->GetView<TChar>(buffer, converter), true);
+				foundCount++;
+			}
+			else
+			{
+				CopyResult<TChar>(results[i], {}, false);
+			}
+		}
+
+		KX_SCOPEDLOG.Trace().Format("Found {} of {} keys", foundCount, count);
+		KX_SCOPEDLOG.LogReturn(foundCount);
+		return foundCount;
+	}
+
+	// The parsed value is kept as raw bits in the value cache slot of the key, along with its text
+	template<class TChar, class TFunc>
+	std::optional<uint64_t> GetParsedValueT(PPR::OptimisticValueCache::ParsedKind kind, const TChar* fileName, const TChar* sectionName, const TChar* keyName, TFunc&& parse)
+	{
+		using namespace PPR;
+
+		if (!fileName || !sectionName || !keyName)
+		{
+			::SetLastError(ERROR_INVALID_PARAMETER);
+			return {};
+		}
+
+		Redirector& redirector = Redirector::GetInstance();
+		kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
+
+		ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(fileName, converter));
+		const INIWrapper& ini = configObject.GetINI();
+		const kxf::String section = INIWrapper::EncodingTo(sectionName, converter);
+		const kxf::String key = INIWrapper::EncodingTo(keyName, converter);
+		const FoldedName foldedSection(section);
+		const FoldedName foldedKey(key);
+
+		uint64_t parsed = 0;
+		if (configObject.FindCachedValue(foldedSection, foldedKey, kind, parsed))
+		{
+			return parsed;
+		}
+
+		auto lock = configObject.LockSectionShared(foldedSection);
+		if (auto value = ini.FindValue(foldedSection, foldedKey))
+		{
+			std::string buffer;
+			parsed = std::invoke(parse, value->GetView(buffer, converter), kxf::StringViewOf(key));
+			ini.CacheValue(foldedSection, foldedKey, *value, kind, parsed);
+
+			return parsed;
+		}
+		return {};
+	}
+
+	template<class TChar>
+	float GetFloatT(const TChar* fileName, const TChar* section, const TChar* key, float defaultValue)
+	{
+		auto parsed = GetParsedValueT(PPR::OptimisticValueCache::ParsedKind::Float, fileName, section, key, [](std::string_view value, kxf::StringView)
+		{
+			return static_cast<uint64_t>(std::bit_cast<uint32_t>(PPR::SettingParser::ParseFloat(value)));
+		});
+		return parsed ? std::bit_cast<float>(static_cast<uint32_t>(*parsed)) : defaultValue;
+	}
+
+	template<class TChar>
+	int32_t GetBoolT(const TChar* fileName, const TChar* section, const TChar* key, int32_t defaultValue)
+	{
+		auto parsed = GetParsedValueT(PPR::OptimisticValueCache::ParsedKind::Bool, fileName, section, key, [](std::string_view value, kxf::StringView)
+		{
+			return static_cast<uint64_t>(PPR::SettingParser::ParseBool(value));
+		});
+		return parsed ? static_cast<int32_t>(*parsed) : defaultValue;
+	}
+
+	template<class TChar>
+	int64_t GetInt64T(const TChar* fileName, const TChar* section, const TChar* key, int64_t defaultValue)
+	{
+		auto parsed = GetParsedValueT(PPR::OptimisticValueCache::ParsedKind::Integer, fileName, section, key, [](std::string_view value, kxf::StringView keyName)
+		{
+			return static_cast<uint64_t>(PPR::SettingParser::ParseInteger(value, keyName));
+		});
+		return parsed ? static_cast<int64_t>(*parsed) : defaultValue;
+	}
+
+	template<class TChar>
+	uint64_t SubscribeT(const TChar* fileName, const TChar* section, const TChar* key, PPR_ChangeCallback callback, void* userData)
+	{
+		using namespace PPR;
+
+		if (!fileName || !section || !key || !callback)
+		{
+			::SetLastError(ERROR_INVALID_PARAMETER);
+			return 0;
+		}
+
+		Redirector& redirector = Redirector::GetInstance();
+		kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
+
+		ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(fileName, converter));
+		const uint64_t id = redirector.GetSubscriptions().Subscribe(configObject, INIWrapper::EncodingTo(section, converter), INIWrapper::EncodingTo(key, converter), callback, userData);
+		kxf::Log::InfoCategory("Subscriptions", "Subscription {} added for section '{}', key '{}' of '{}'", id, section, key, configObject.GetFilePath().GetFullPath());
+
+		return id;
+	}
+}
+
+uint32_t PPR_CALL PPR_GetAPIVersion(void)
+{
+	return PPR_API_VERSION;
+}
+
+uint32_t PPR_CALL PPR_QueryValuesA(const char* fileName, const char* section, const char* const* keys, uint32_t count, PPR_QueryResultA* results)
+{
+	return TrackAPICall(__func__, _ReturnAddress(), fileName, [&]()
+	{
+		return QueryValuesT(fileName, section, keys, count, results);
+	});
+}
+uint32_t PPR_CALL PPR_QueryValuesW(const wchar_t* fileName, const wchar_t* section, const wchar_t* const* keys, uint32_t count, PPR_QueryResultW* results)
+{
+	return TrackAPICall(__func__, _ReturnAddress(), fileName, [&]()
+	{
+		return QueryValuesT(fileName, section, keys, count, results);
+	});
+}
+
+float PPR_CALL PPR_GetFloatA(const char* fileName, const char* section, const char* key, float defaultValue)
+{
+	return TrackAPICall(__func__, _ReturnAddress(), fileName, [&]()
+	{
+		return GetFloatT(fileName, section, key, defaultValue);
+	});
+}
+float PPR_CALL PPR_GetFloatW(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, float defaultValue)
+{
+	return TrackAPICall(__func__, _ReturnAddress(), fileName, [&]()
+	{
+		return GetFloatT(fileName, section, key, defaultValue);
+	});
+}
+
+int32_t PPR_CALL PPR_GetBoolA(const char* fileName, const char* section, const char* key, int32_t defaultValue)
+{
+	return TrackAPICall(__func__, _ReturnAddress(), fileName, [&]()
+	{
+		return GetBoolT(fileName, section, key, defaultValue);
+	});
+}
+int32_t PPR_CALL PPR_GetBoolW(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, int32_t defaultValue)
+{
+	return TrackAPICall(__func__, _ReturnAddress(), fileName, [&]()
+	{
+		return GetBoolT(fileName, section, key, defaultValue);
+	});
+}
+
+int64_t PPR_CALL PPR_GetInt64A(const char* fileName, const char* section, const char* key, int64_t defaultValue)
+{
+	return TrackAPICall(__func__, _ReturnAddress(), fileName, [&]()
+	{
+		return GetInt64T(fileName, section, key, defaultValue);
+	});
+}
+int64_t PPR_CALL PPR_GetInt64W(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, int64_t defaultValue)
+{
+	return TrackAPICall(__func__, _ReturnAddress(), fileName, [&]()
+	{
+		return GetInt64T(fileName, section, key, defaultValue);
+	});
+}
+
+uint64_t PPR_CALL PPR_SubscribeA(const char* fileName, const char* section, const char* key, PPR_ChangeCallback callback, void* userData)
+{
+	return SubscribeT(fileName, section, key, callback, userData);
+}
+uint64_t PPR_CALL PPR_SubscribeW(const wchar_t* fileName, const wchar_t* section, const wchar_t* key, PPR_ChangeCallback callback, void* userData)
+{
+	return SubscribeT(fileName, section, key, callback, userData);
+}
+int32_t PPR_CALL PPR_Unsubscribe(uint64_t subscription)
+{
+	return PPR::Redirector::GetInstance().GetSubscriptions().Unsubscribe(subscription) ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+#include "stdafx.h"
+#include "ReaderBiasedLock.h"
+
+namespace
+{
+	// Global table of the readers published by all the reader-biased locks
+	std::atomic<PPR::ReaderBiasedLock*> g_ReaderTable[4096] = {};
+
+	// Handed out to the readers of a lock that's held by a terminated thread, it's not a part of the table
+	std::atomic<PPR::ReaderBiasedLock*> g_AbandonedSlot = nullptr;
+	std::atomic<bool> g_IsProcessTerminating = false;
+
+	size_t GetThreadSalt() noexcept
+	{
+		// Address of a thread-local variable is unique among the running threads
+		thread_local char threadMarker = 0;
+		return reinterpret_cast<size_t>(&threadMarker);
+	}
+}
+
+namespace PPR
+{
+	std::atomic<ReaderBiasedLock*>* ReaderBiasedLock::AcquireReaderSlot(ReaderBiasedLock& lock) noexcept
+	{
+		static_assert(std::size(g_ReaderTable) == ReaderTableSize);
+
+		// Mix the thread and the lock addresses (SplitMix64 finalizer)
+		uint64_t hash = static_cast<uint64_t>(GetThreadSalt()) ^ (static_cast<uint64_t>(reinterpret_cast<size_t>(&lock)) * 0x9E3779B97F4A7C15ull);
+		hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+		hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+		hash ^= hash >> 31;
+
+		auto& slot = g_ReaderTable[hash % ReaderTableSize];
+		ReaderBiasedLock* expected = nullptr;
+		if (slot.compare_exchange_strong(expected, &lock))
+		{
+			return &slot;
+		}
+		return nullptr;
+	}
+	std::atomic<ReaderBiasedLock*>* ReaderBiasedLock::GetAbandonedSlot() noexcept
+	{
+		return &g_AbandonedSlot;
+	}
+	int64_t ReaderBiasedLock::GetTimestamp() noexcept
+	{
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+	}
+
+	void ReaderBiasedLock::SetProcessTerminating(bool isTerminating) noexcept
+	{
+		g_IsProcessTerminating = isTerminating;
+	}
+	bool ReaderBiasedLock::IsProcessTerminating() noexcept
+	{
+		return g_IsProcessTerminating.load(std::memory_order_relaxed);
+	}
+
+	std::atomic<ReaderBiasedLock*>* ReaderBiasedLock::LockShared() noexcept
+	{
+		if (m_ReaderBias.load())
+		{
+			if (auto slot = AcquireReaderSlot(*this))
+			{
+				// The writer clears the bias before scanning the table, so if it's still set after the slot is published
+				// the writer is guaranteed to see the slot and wait for it.
+				if (m_ReaderBias.load())
+				{
+					return slot;
+				}
+				slot->store(nullptr);
+			}
+		}
+
+		if (IsProcessTerminating())
+		{
+			return ::TryAcquireSRWLockShared(&m_Lock) ? nullptr : GetAbandonedSlot();
+		}
+
+		::AcquireSRWLockShared(&m_Lock);
+		if (!m_ReaderBias.load(std::memory_order_relaxed) && GetTimestamp() >= m_InhibitUntil.load(std::memory_order_relaxed))
+		{
+			m_ReaderBias.store(true);
+		}
+		return nullptr;
+	}
+	void ReaderBiasedLock::UnlockShared(std::atomic<ReaderBiasedLock*>* slot) noexcept
+	{
+		if (slot)
+		{
+			slot->store(nullptr, std::memory_order_release);
+		}
+		else
+		{
+			::ReleaseSRWLockShared(&m_Lock);
+		}
+	}
+
+	bool ReaderBiasedLock::LockExclusive() noexcept
+	{
+		// Nothing is going to release the lock from now on. The readers published by the terminated threads never leave
+		// their slots either, so the lock is abandoned if any of them is still there.
+		if (IsProcessTerminating())
+		{
+			if (!::TryAcquireSRWLockExclusive(&m_Lock))
+			{
+				return false;
+			}
+
+			m_ReaderBias.store(false);
+			for (auto& slot: g_ReaderTable)
+			{
+				if (slot.load() == this)
+				{
+					::ReleaseSRWLockExclusive(&m_Lock);
+					return false;
+				}
+			}
+			return true;
+		}
+
+		::AcquireSRWLockExclusive(&m_Lock);
+		if (m_ReaderBias.load(std::memory_order_relaxed))
+		{
+			// Revoke the bias and wait for all the published readers to leave
+			m_ReaderBias.store(false);
+
+			const int64_t start = GetTimestamp();
+			for (auto& slot: g_ReaderTable)
+			{
+				while (slot.load() == this)
+				{
+					::YieldProcessor();
+				}
+			}
+
+			// Don't let the readers turn the bias back on until the revocation cost is amortized
+			const int64_t now = GetTimestamp();
+			m_InhibitUntil.store(now + (now - start) * InhibitMultiplier, std::memory_order_relaxed);
+		}
+		return true;
+	}
+	void ReaderBiasedLock::UnlockExclusive() noexcept
+	{
+		::ReleaseSRWLockExclusive(&m_Lock);
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include "stdafx.h"
+
+namespace PPR
+{
+	// Reader-writer lock biased towards readers (BRAVO scheme). While the bias is on, a reader doesn't touch the lock
+	// itself, it publishes the lock pointer in a slot of a global table picked by its thread and the lock address, so
+	// readers of the same lock on different threads write to different cache lines. A writer takes the underlying lock,
+	// revokes the bias and waits for the published readers to drain. Readers take the underlying lock in shared mode
+	// while the bias is off and turn it back on after a cool-down proportional to the time the last revocation took,
+	// so a lock that's written to often stays a plain SRW lock.
+	//
+	// Once the process is terminating every other thread is gone and the locks they held are never going to be released,
+	// see 'SetProcessTerminating'. The locks are only tried from then on, a lock that can't be taken is reported as
+	// abandoned by its guard and the caller decides whether the data behind it can still be used.
+	class ReaderBiasedLock final
+	{
+		public:
+			class ReadGuard;
+			class WriteGuard;
+
+		private:
+			static constexpr size_t ReaderTableSize = 4096;
+			static constexpr int64_t InhibitMultiplier = 9;
+
+			static std::atomic<ReaderBiasedLock*>* AcquireReaderSlot(ReaderBiasedLock& lock) noexcept;
+			static std::atomic<ReaderBiasedLock*>* GetAbandonedSlot() noexcept;
+			static int64_t GetTimestamp() noexcept;
+
+		public:
+			// Called on the thread that runs 'DLL_PROCESS_DETACH' of a terminating process, there is no way back.
+			// Only the tests turn it off again.
+			static void SetProcessTerminating(bool isTerminating = true) noexcept;
+			static bool IsProcessTerminating() noexcept;
+
+		private:
+			SRWLOCK m_Lock = SRWLOCK_INIT;
+			std::atomic<bool> m_ReaderBias = true;
+			std::atomic<int64_t> m_InhibitUntil = 0;
+
+		public:
+			ReaderBiasedLock() noexcept = default;
+			ReaderBiasedLock(const ReaderBiasedLock&) = delete;
+
+		public:
+			// Returns the slot the reader is published in or null if it holds the underlying lock instead,
+			// the value has to be passed to 'UnlockShared'.
+			[[nodiscard]] std::atomic<ReaderBiasedLock*>* LockShared() noexcept;
+			void UnlockShared(std::atomic<ReaderBiasedLock*>* slot) noexcept;
+
+			// Returns false only if the process is terminating and the lock was held by one of the terminated threads,
+			// either through the underlying lock or a published reader slot. 'UnlockExclusive' must not be called then.
+			[[nodiscard]] bool LockExclusive() noexcept;
+			void UnlockExclusive() noexcept;
+
+		public:
+			ReaderBiasedLock& operator=(const ReaderBiasedLock&) = delete;
+	};
+}
+
+namespace PPR
+{
+	class ReaderBiasedLock::ReadGuard final
+	{
+		private:
+			ReaderBiasedLock* m_Lock = nullptr;
+			std::atomic<ReaderBiasedLock*>* m_Slot = nullptr;
+
+		public:
+			ReadGuard(ReaderBiasedLock& lock) noexcept
+				:m_Lock(&lock), m_Slot(lock.LockShared())
+			{
+			}
+			ReadGuard(ReadGuard&& other) noexcept
+				:m_Lock(std::exchange(other.m_Lock, nullptr)), m_Slot(std::exchange(other.m_Slot, nullptr))
+			{
+			}
+			ReadGuard(const ReadGuard&) = delete;
+			~ReadGuard() noexcept
+			{
+				if (m_Lock)
+				{
+					m_Lock->UnlockShared(m_Slot);
+				}
+			}
+
+		public:
+			bool IsAbandoned() const noexcept
+			{
+				return m_Slot == GetAbandonedSlot();
+			}
+
+		public:
+			ReadGuard& operator=(ReadGuard&&) = delete;
+			ReadGuard& operator=(const ReadGuard&) = delete;
+	};
+
+	class ReaderBiasedLock::WriteGuard final
+	{
+		private:
+			ReaderBiasedLock* m_Lock = nullptr;
+			bool m_IsAbandoned = false;
+
+		public:
+			WriteGuard(ReaderBiasedLock& lock) noexcept
+				:m_Lock(lock.LockExclusive() ? &lock : nullptr), m_IsAbandoned(m_Lock == nullptr)
+			{
+			}
+			WriteGuard(WriteGuard&& other) noexcept
+				:m_Lock(std::exchange(other.m_Lock, nullptr)), m_IsAbandoned(other.m_IsAbandoned)
+			{
+			}
+			WriteGuard(const WriteGuard&) = delete;
+			~WriteGuard() noexcept
+			{
+				if (m_Lock)
+				{
+					m_Lock->UnlockExclusive();
+				}
+			}
+
+		public:
+			bool IsAbandoned() const noexcept
+			{
+				return m_IsAbandoned;
+			}
+
+		public:
+			WriteGuard& operator=(WriteGuard&&) = delete;
+			WriteGuard& operator=(const WriteGuard&) = delete;
+	};
+}
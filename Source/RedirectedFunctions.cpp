@@ -1,9 +1,13 @@
 #include "stdafx.h"
 #include "RedirectedFunctions.h"
 #include "PrivateProfileRedirector.h"
+#include "CallTracking.h"
 #include <kxf/Log/Categories.h>
 #include <kxf/System/Win32Error.h>
 #include <strsafe.h>
+#include <intrin.h>
+#include <unordered_set>
+#pragma intrinsic(_ReturnAddress)
 
 #undef PPR_API
 #define PPR_API(retType) retType WINAPI
@@ -22,6 +26,20 @@ namespace
 		KX_DefineLogCategory(GetPrivateProfileSectionW);
 		KX_DefineLogCategory(WritePrivateProfileStringA);
 		KX_DefineLogCategory(WritePrivateProfileStringW);
+		KX_DefineLogCategory(GetPrivateProfileStructA);
+		KX_DefineLogCategory(GetPrivateProfileStructW);
+		KX_DefineLogCategory(WritePrivateProfileStructA);
+		KX_DefineLogCategory(WritePrivateProfileStructW);
+		KX_DefineLogCategory(WritePrivateProfileSectionA);
+		KX_DefineLogCategory(WritePrivateProfileSectionW);
+		KX_DefineLogCategory(GetProfileStringA);
+		KX_DefineLogCategory(GetProfileStringW);
+		KX_DefineLogCategory(GetProfileIntA);
+		KX_DefineLogCategory(GetProfileIntW);
+		KX_DefineLogCategory(GetProfileSectionA);
+		KX_DefineLogCategory(GetProfileSectionW);
+		KX_DefineLogCategory(WriteProfileStringA);
+		KX_DefineLogCategory(WriteProfileStringW);
 	}
 
 	template<class TChar>
@@ -69,34 +87,29 @@ namespace
 		return STRSAFE_E_INVALID_PARAMETER;
 	}
 
-	template<class TChar>
-	HRESULT StringCopyBuffer(TChar* dst, size_t dstSize, const TChar* src, size_t srcSize, size_t* copiedSize = nullptr) noexcept
+	// The source can be narrower than the destination, the ASCII index values are widened while being copied
+	template<class TChar, class TSrcChar>
+	HRESULT StringCopyBuffer(TChar* dst, size_t dstSize, const TSrcChar* src, size_t srcSize, size_t* copiedSize = nullptr) noexcept
 	{
+		static_assert(sizeof(TSrcChar) <= sizeof(TChar));
+
 		kxf::Utility::SetIfNotNull(copiedSize, 0);
 
 		if (dst && src)
 		{
-			// Zero out the dst buffer first
-			std::memset(dst, 0, dstSize * sizeof(TChar));
+			// Only the copied data and its terminator(s) are written, the rest of the dst buffer is left untouched.
+			// Callers routinely pass buffers of tens of kilobytes to read a few characters.
 
 			// See how much we need to copy
 			size_t copySize = std::min(dstSize, srcSize);
+			size_t writtenSize = 0;
 			kxf::Utility::ScopeGuard atExit = [&]()
 			{
 				if (kxf::Log::IsLevelEnabled(kxf::LogLevel::Trace))
 				{
-					// Make the function print a few bytes after the src length if the dst has the space for it
-					size_t padding = 0;
-					if (dstSize > copySize)
-					{
-						padding++;
-					}
-					if (dstSize > copySize + 1)
-					{
-						padding++;
-					}
-
-					auto dstHex = MemoryToHex(dst, copySize * sizeof(TChar), padding);
+					// Only what was written, the terminator past the copied data is printed after the separator.
+					// The rest of the buffer is the caller's uninitialized memory.
+					auto dstHex = MemoryToHex(dst, copySize * sizeof(TChar), (writtenSize - copySize) * sizeof(TChar));
 					kxf::Log::TraceCategory("StringCopyBuffer", "srcSize: {}, dstSize: {}, copySize: {} ({} bytes), dst contents: [{}]",
 											srcSize,
 											dstSize,
@@ -109,21 +122,39 @@ namespace
 
 			// We can have zero characters to copy either because the dst buffer size is zero
 			// or because the src buffer itself is zero sized. In this case we can still return
-			// success. The dst buffer is zeroed out anyway, whatever size it is.
+			// success after writing the null-terminator if there's space for it.
 			if (copySize == 0)
 			{
+				if (dstSize != 0)
+				{
+					dst[0] = 0;
+					writtenSize = 1;
+				}
+
 				kxf::Utility::SetIfNotNull(copiedSize, 0);
 				return S_OK;
 			}
 
 			// Copy the data to dst
-			std::memcpy(dst, src, copySize * sizeof(TChar));
+			if constexpr(std::is_same_v<TChar, TSrcChar>)
+			{
+				std::memcpy(dst, src, copySize * sizeof(TChar));
+			}
+			else
+			{
+				std::transform(src, src + copySize, dst, [](TSrcChar c)
+				{
+					return static_cast<TChar>(static_cast<std::make_unsigned_t<TSrcChar>>(c));
+				});
+			}
 			kxf::Utility::SetIfNotNull(copiedSize, copySize);
+			writtenSize = copySize;
 
 			if (dstSize > srcSize)
 			{
 				// Null-terminate at the position past copied data
 				dst[srcSize] = 0;
+				writtenSize++;
 				return S_OK;
 			}
 			else if (dstSize == srcSize && dst[dstSize - 1] == 0)
@@ -142,6 +173,147 @@ namespace
 		}
 		return STRSAFE_E_INVALID_PARAMETER;
 	}
+
+	// Struct values are stored as two upper-case hex digits per byte followed by a one byte checksum,
+	// which is the sum of all the bytes truncated to 8 bits.
+	template<class TChar>
+	std::basic_string<TChar> StructToHex(const void* data, size_t size)
+	{
+		constexpr char digits[] = "0123456789ABCDEF";
+
+		std::basic_string<TChar> buffer;
+		buffer.reserve(size * 2 + 2);
+
+		uint8_t checksum = 0;
+		auto AppendByte = [&](uint8_t value)
+		{
+			buffer.append(1, static_cast<TChar>(digits[value >> 4]));
+			buffer.append(1, static_cast<TChar>(digits[value & 0x0F]));
+		};
+		for (size_t i = 0; i < size; i++)
+		{
+			const uint8_t value = reinterpret_cast<const uint8_t*>(data)[i];
+
+			checksum += value;
+			AppendByte(value);
+		}
+		AppendByte(checksum);
+
+		return buffer;
+	}
+
+	bool HexToStruct(kxf::StringView hex, void* data, size_t size) noexcept
+	{
+		auto FromHexDigit = [](wchar_t c) -> int
+		{
+			if (c >= L'0' && c <= L'9')
+			{
+				return c - L'0';
+			}
+			else if (c >= L'A' && c <= L'F')
+			{
+				return c - L'A' + 10;
+			}
+			else if (c >= L'a' && c <= L'f')
+			{
+				return c - L'a' + 10;
+			}
+			return -1;
+		};
+		auto ReadByte = [&](size_t index, uint8_t& value)
+		{
+			const int high = FromHexDigit(hex[index * 2]);
+			const int low = FromHexDigit(hex[index * 2 + 1]);
+			if (high >= 0 && low >= 0)
+			{
+				value = static_cast<uint8_t>((high << 4) | low);
+				return true;
+			}
+			return false;
+		};
+
+		if (hex.length() != size * 2 + 2)
+		{
+			return false;
+		}
+
+		// Decode into a temporary buffer first, the output must stay untouched if the data is invalid
+		std::vector<uint8_t> buffer(size);
+		uint8_t checksum = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			if (!ReadByte(i, buffer[i]))
+			{
+				return false;
+			}
+			checksum += buffer[i];
+		}
+
+		uint8_t storedChecksum = 0;
+		if (ReadByte(size, storedChecksum) && storedChecksum == checksum)
+		{
+			std::memcpy(data, buffer.data(), size);
+			return true;
+		}
+		return false;
+	}
+
+	// The native 'A' functions convert their arguments using the ANSI code page and call the 'W' ones,
+	// so the deferred native writes are stored the same way regardless of the 'CodePage' option.
+	template<class TChar>
+	std::wstring ToNativeWideString(const TChar* str, size_t length)
+	{
+		if constexpr(std::is_same_v<TChar, char>)
+		{
+			std::wstring buffer;
+			if (int size = ::MultiByteToWideChar(CP_ACP, 0, str, static_cast<int>(length), nullptr, 0); size > 0)
+			{
+				buffer.resize(size);
+				::MultiByteToWideChar(CP_ACP, 0, str, static_cast<int>(length), buffer.data(), size);
+			}
+			return buffer;
+		}
+		else if constexpr(std::is_same_v<TChar, wchar_t>)
+		{
+			return {str, length};
+		}
+		else
+		{
+			static_assert(false);
+		}
+	}
+
+	template<class TChar>
+	std::wstring ToNativeWideString(const TChar* str)
+	{
+		return ToNativeWideString(str, std::char_traits<TChar>::length(str));
+	}
+
+	// See 'PPR::TrackCall', the statistics and the trace recorder are taken from the redirector instance
+	template<class TChar, class TFunc>
+	auto TrackFileCall(const char* name, const void* returnAddress, const TChar* lpFileName, TFunc&& func)
+	{
+		using namespace PPR;
+
+		Redirector& redirector = Redirector::GetInstance();
+		return PPR::TrackCall(redirector.GetCallerStatistics(), redirector.GetTraceRecorder(), name, returnAddress, [&]()
+		{
+			return lpFileName;
+		}, std::forward<TFunc>(func));
+	}
+
+	// The profile mapping functions don't take the file name, it's only looked up when the statistics need it
+	template<class TChar, class TFunc>
+	auto TrackMappedCall(const char* name, const void* returnAddress, TFunc&& func)
+	{
+		using namespace PPR;
+
+		Redirector& redirector = Redirector::GetInstance();
+		return PPR::TrackCall(redirector.GetCallerStatistics(), redirector.GetTraceRecorder(), name, returnAddress, [&]()
+		{
+			return redirector.GetProfileMapping().GetFilePath<TChar>();
+		}, std::forward<TFunc>(func));
+	}
 }
 
 namespace PPR::PrivateProfile
@@ -166,13 +338,60 @@ namespace PPR::PrivateProfile
 		Redirector& redirector = Redirector::GetInstance();
 		kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
 		ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(lpFileName, converter));
-		auto lock = configObject.LockShared();
 		const INIWrapper& ini = configObject.GetINI();
 
+		auto CopyText = [&](auto valueRef)
+		{
+			size_t copiedSize = 0;
+			HRESULT hr = StringCopyBuffer(lpReturnedString, nSize, valueRef.data(), valueRef.length(), &copiedSize);
+			DWORD result = valueRef.length();
+			if (hr == STRSAFE_E_INSUFFICIENT_BUFFER)
+			{
+				KX_SCOPEDLOG.Trace(logCategory).Log("STRSAFE_E_INSUFFICIENT_BUFFER");
+				result = nSize - 1;
+			}
+
+			KX_SCOPEDLOG.Trace(logCategory).Format("Value found: '{}', result: {}, copied: {}", valueRef, result, copiedSize);
+			return result;
+		};
+		auto CopyValue = [&](const IndexValue& value)
+		{
+			// ASCII values are copied to the 'A' callers as is and widened straight into the buffer of the 'W' callers,
+			// only the other values for the 'A' callers go through the converter
+			if (value.IsASCII())
+			{
+				return CopyText(value.GetASCII());
+			}
+			else if constexpr(std::is_same_v<TChar, wchar_t>)
+			{
+				return CopyText(value.GetWide());
+			}
+			else
+			{
+				std::string buffer;
+				return CopyText(value.GetView(buffer, converter));
+			}
+		};
+
+		// Short values can be read without taking the section lock
+		const kxf::String section = INIWrapper::EncodingTo(appName, converter);
+		const kxf::String key = INIWrapper::EncodingTo(keyName, converter);
+		const FoldedName foldedSection(section);
+		const FoldedName foldedKey(key);
+		if (appName && keyName)
+		{
+			OptimisticValueCache::Value cachedValue;
+			if (configObject.FindCachedValue(foldedSection, foldedKey, cachedValue))
+			{
+				return CopyValue(IndexValue(cachedValue.GetView()));
+			}
+		}
+
 		// Enum all sections
 		if (!appName)
 		{
 			KX_SCOPEDLOG.Trace(logCategory).Format("Enum all sections of file '{}'", lpFileName);
+			auto lock = configObject.LockShared();
 
 			size_t count = 0;
 			bool truncated = false;
@@ -206,10 +425,11 @@ namespace PPR::PrivateProfile
 		if (!keyName)
 		{
 			KX_SCOPEDLOG.Trace(logCategory).Format("Enum all keys in '{}' section of file '{}'", appName, lpFileName);
+			auto lock = configObject.LockShared();
 
 			size_t count = 0;
 			bool truncated = false;
-			auto keys = ini.GetKeyNamesZSSTRZZ<TChar>(converter, INIWrapper::EncodingTo(appName, converter), nSize, &truncated, &count);
+			auto keys = ini.GetKeyNamesZSSTRZZ<TChar>(converter, section, nSize, &truncated, &count);
 			KX_SCOPEDLOG.Trace(logCategory).Format("Enumerated {} keys of {} characters ({} bytes), is truncated: {}",
 												   count,
 												   keys.length(),
@@ -235,21 +455,11 @@ namespace PPR::PrivateProfile
 		}
 
 		// Get the value
-		if (auto value = ini.QueryValue(INIWrapper::EncodingTo(appName, converter), INIWrapper::EncodingTo(keyName, converter)))
+		auto lock = configObject.LockSectionShared(foldedSection);
+		if (auto value = ini.FindValue(foldedSection, foldedKey))
 		{
-			auto valueRef = INIWrapper::EncodingFrom<TChar>(*value, converter);
-
-			size_t copiedSize = 0;
-			HRESULT hr = StringCopyBuffer(lpReturnedString, nSize, valueRef.data(), valueRef.length(), &copiedSize);
-			DWORD result = valueRef.length();
-			if (hr == STRSAFE_E_INSUFFICIENT_BUFFER)
-			{
-				KX_SCOPEDLOG.Trace(logCategory).Log("STRSAFE_E_INSUFFICIENT_BUFFER");
-				result = nSize - 1;
-			}
-
-			KX_SCOPEDLOG.Trace(logCategory).Format("Value found: '{}', result: {}, copied: {}", *value, result, copiedSize);
-			return result;
+			ini.CacheValue(foldedSection, foldedKey, *value);
+			return CopyValue(*value);
 		}
 		else if (defaultValue)
 		{
@@ -301,20 +511,41 @@ namespace PPR::PrivateProfile
 		kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
 
 		ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(lpFileName, converter));
-		auto lock = configObject.LockShared();
+		const INIWrapper& ini = configObject.GetINI();
 
-		if (auto value = configObject.GetINI().QueryValue(INIWrapper::EncodingTo(appName, converter), INIWrapper::EncodingTo(keyName, converter)))
+		auto ConvertValue = [&](kxf::StringView value) -> UINT
 		{
-			if (auto intValue = value->ToInteger<INT>(-1))
+			if (auto intValue = kxf::String(value).ToInteger<INT>(-1))
 			{
-				KX_SCOPEDLOG.Trace(logCategory).Format("String '{}' converted to an integer: '{}'", *value, *intValue);
+				KX_SCOPEDLOG.Trace(logCategory).Format("String '{}' converted to an integer: '{}'", value, *intValue);
 				return *intValue;
 			}
 			else
 			{
-				KX_SCOPEDLOG.Trace(logCategory).Format("Couldn't convert string '{}' to an integer, returning default: {}", *value, defaultValue);
+				KX_SCOPEDLOG.Trace(logCategory).Format("Couldn't convert string '{}' to an integer, returning default: {}", value, defaultValue);
 				return defaultValue;
 			}
+		};
+
+		// Integers are short enough to almost always be read without taking the section lock
+		const kxf::String section = INIWrapper::EncodingTo(appName, converter);
+		const kxf::String key = INIWrapper::EncodingTo(keyName, converter);
+		const FoldedName foldedSection(section);
+		const FoldedName foldedKey(key);
+
+		OptimisticValueCache::Value cachedValue;
+		if (configObject.FindCachedValue(foldedSection, foldedKey, cachedValue))
+		{
+			return ConvertValue(cachedValue.GetView());
+		}
+
+		auto lock = configObject.LockSectionShared(foldedSection);
+		if (auto value = ini.FindValue(foldedSection, foldedKey))
+		{
+			ini.CacheValue(foldedSection, foldedKey, *value);
+
+			std::wstring buffer;
+			return ConvertValue(value->GetView(buffer));
 		}
 
 		KX_SCOPEDLOG.Trace(logCategory).Format("Couldn't find the requested data, returning default: '{}'", defaultValue);
@@ -353,21 +584,22 @@ namespace PPR::PrivateProfile
 		kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
 
 		ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(lpFileName, converter));
-		auto lock = configObject.LockShared();
+		auto sectionName = INIWrapper::EncodingTo(appName, converter);
+		const FoldedName foldedSection(sectionName);
+		auto lock = configObject.LockSectionShared(foldedSection);
 		const INIWrapper& ini = configObject.GetINI();
 
 		KX_SCOPEDLOG.Trace(logCategory).Format("Enum all key-value from section '{}' of file '{}'", appName, lpFileName);
 
 		size_t count = 0;
 		bool truncated = false;
-		auto sectionName = INIWrapper::EncodingTo(appName, converter);
 		auto keyValuePairs = INIWrapper::CreateZSSTRZZ<TChar>([&](std::basic_string<TChar>& buffer, const kxf::String& keyName)
 		{
-			if (auto value = ini.QueryValue(sectionName, keyName))
+			if (auto value = ini.FindValue(foldedSection, keyName))
 			{
 				buffer.append(INIWrapper::EncodingFrom<TChar>(keyName, converter));
 				buffer.append(1, '=');
-				buffer.append(INIWrapper::EncodingFrom<TChar>(*value, converter));
+				value->AppendTo(buffer, converter);
 
 				return kxf::CallbackCommand::Continue;
 			}
@@ -405,8 +637,11 @@ namespace PPR::PrivateProfile
 		KX_SCOPEDLOG.Trace(logCategory).Format("Section: '{}', Key: '{}', Value: '{}', Path: '{}'", appName, keyName, lpString, lpFileName);
 
 		Redirector& redirector = Redirector::GetInstance();
+		const bool isNativeWriteDeferred = redirector.IsOptionEnabled(RedirectorOption::NativeWriteDeferred);
 
 		// When 'NativeWrite' or 'WriteProtected' options are enabled, it will not flush updated file to the disk.
+		// In the deferred 'NativeWrite' mode the changes are queued to be replayed with the native functions instead.
+		ConfigObject* writtenObject = nullptr;
 		auto WriteStringToMemoryFile = [&](const TChar* appName, const TChar* keyName, const TChar* lpString, const TChar* lpFileName)
 		{
 			if (!lpFileName)
@@ -422,15 +657,22 @@ namespace PPR::PrivateProfile
 
 			kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
 			ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(lpFileName, converter));
-			auto lock = configObject.LockExclusive();
 			INIWrapper& ini = configObject.GetINI();
+			writtenObject = &configObject;
 
 			// Delete section
+			const kxf::String section = INIWrapper::EncodingTo(appName, converter);
+			const FoldedName foldedSection(section);
 			if (!keyName)
 			{
-				if (ini.DeleteSection(INIWrapper::EncodingTo(appName, converter)))
+				auto lock = configObject.LockExclusive();
+				if (ini.DeleteSection(foldedSection))
 				{
 					KX_SCOPEDLOG.Trace(logCategory).Format("Section '{}' deleted", appName);
+					if (isNativeWriteDeferred)
+					{
+						configObject.GetNativeWriteQueue().DeleteSection(ToNativeWideString(appName));
+					}
 					configObject.OnWrite();
 
 					return true;
@@ -439,11 +681,18 @@ namespace PPR::PrivateProfile
 			}
 
 			// Delete value
+			const kxf::String key = INIWrapper::EncodingTo(keyName, converter);
+			const FoldedName foldedKey(key);
 			if (!lpString)
 			{
-				if (ini.DeleteKey(INIWrapper::EncodingTo(appName, converter), INIWrapper::EncodingTo(keyName, converter)))
+				auto lock = configObject.LockSectionExclusive(foldedSection);
+				if (ini.DeleteKey(foldedSection, foldedKey))
 				{
 					KX_SCOPEDLOG.Trace(logCategory).Format("Key '{}' in section '{}' deleted", keyName, appName);
+					if (isNativeWriteDeferred)
+					{
+						configObject.GetNativeWriteQueue().DeleteKey(ToNativeWideString(appName), ToNativeWideString(keyName));
+					}
 					configObject.OnWrite();
 
 					return true;
@@ -452,25 +701,46 @@ namespace PPR::PrivateProfile
 			}
 
 			// Set value
-			bool isSameData = false;
-			if (ini.SetValue(appName, keyName, INIWrapper::EncodingTo(lpString, converter), &isSameData))
+			auto SetValue = [&]()
 			{
-				if (isSameData)
-				{
-					KX_SCOPEDLOG.Trace(logCategory).Format("Attempt to assign already existing value '{}' to key '{}' in section '{}', write request ignored", lpString, keyName, appName);
-				}
-				else
+				bool isSameData = false;
+				if (ini.SetValue(foldedSection, foldedKey, INIWrapper::EncodingTo(lpString, converter), &isSameData))
 				{
-					KX_SCOPEDLOG.Trace(logCategory).Format("Assigned value '{}' to key '{}' in section '{}'", lpString, keyName, appName);
-					configObject.OnWrite();
+					if (isSameData)
+					{
+						KX_SCOPEDLOG.Trace(logCategory).Format("Attempt to assign already existing value '{}' to key '{}' in section '{}', write request ignored", lpString, keyName, appName);
+					}
+					else
+					{
+						KX_SCOPEDLOG.Trace(logCategory).Format("Assigned value '{}' to key '{}' in section '{}'", lpString, keyName, appName);
+						if (isNativeWriteDeferred)
+						{
+							configObject.GetNativeWriteQueue().SetValue(ToNativeWideString(appName), ToNativeWideString(keyName), ToNativeWideString(lpString));
+						}
+						configObject.OnWrite();
+					}
+					return true;
 				}
-				return true;
+				return false;
+			};
+
+			// Writers of the existing sections only lock their section, adding a new one changes the section list and needs the whole file
+			if (auto lock = configObject.LockSectionExclusive(foldedSection); ini.HasSection(foldedSection))
+			{
+				return SetValue();
 			}
-			return false;
+
+			auto lock = configObject.LockExclusive();
+			return SetValue();
 		};
 		bool memoryWriteSuccess = WriteStringToMemoryFile(appName, keyName, lpString, lpFileName);
+		if (writtenObject)
+		{
+			writtenObject->OnWriteFinished();
+		}
+		redirector.FlushPendingWrites();
 
-		if (redirector.IsOptionEnabled(RedirectorOption::NativeWrite))
+		if (redirector.IsOptionEnabled(RedirectorOption::NativeWrite) && !isNativeWriteDeferred)
 		{
 			if constexpr(std::is_same_v<TChar, char>)
 			{
@@ -486,48 +756,447 @@ namespace PPR::PrivateProfile
 		return memoryWriteSuccess ? TRUE : FALSE;
 	}
 
+	template<class TChar>
+	BOOL GetStructT(kxf::StringView logCategory, const TChar* appName, const TChar* keyName, LPVOID lpStruct, UINT uSizeStruct, const TChar* lpFileName)
+	{
+		KX_SCOPEDLOG_AUTO;
+		KX_SCOPEDLOG.Trace(logCategory).Format("Section: '{}', Key: '{}', Struct size: '{}', Path: '{}'", appName, keyName, uSizeStruct, lpFileName);
+
+		if (!lpFileName)
+		{
+			::SetLastError(ERROR_FILE_NOT_FOUND);
+			return FALSE;
+		}
+		if (!appName || !keyName || !lpStruct)
+		{
+			::SetLastError(ERROR_INVALID_PARAMETER);
+			return FALSE;
+		}
+
+		Redirector& redirector = Redirector::GetInstance();
+		kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
+
+		ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(lpFileName, converter));
+		const kxf::String section = INIWrapper::EncodingTo(appName, converter);
+		auto lock = configObject.LockSectionShared(section);
+
+		if (auto value = configObject.GetINI().FindValue(section, INIWrapper::EncodingTo(keyName, converter)))
+		{
+			std::wstring buffer;
+			kxf::StringView hex = value->GetView(buffer);
+			if (HexToStruct(hex, lpStruct, uSizeStruct))
+			{
+				KX_SCOPEDLOG.Trace(logCategory).Format("String '{}' converted to a struct of {} bytes", hex, uSizeStruct);
+				return TRUE;
+			}
+
+			KX_SCOPEDLOG.Trace(logCategory).Format("String '{}' is not a valid struct of {} bytes", hex, uSizeStruct);
+			::SetLastError(ERROR_BAD_LENGTH);
+			return FALSE;
+		}
+
+		KX_SCOPEDLOG.Trace(logCategory).Format("Couldn't find the requested data");
+		::SetLastError(ERROR_FILE_NOT_FOUND);
+		return FALSE;
+	}
+
+	template<class TChar>
+	BOOL WriteStructT(kxf::StringView logCategory, const TChar* appName, const TChar* keyName, LPVOID lpStruct, UINT uSizeStruct, const TChar* lpFileName)
+	{
+		// Native implementation stores the struct through the same path as a regular string value, so the cached copy,
+		// write-back policies and 'NativeWrite' option all apply to it as well. No data means deleting the key.
+		if (lpStruct)
+		{
+			auto hex = StructToHex<TChar>(lpStruct, uSizeStruct);
+			return WriteStringT(logCategory, appName, keyName, hex.c_str(), lpFileName);
+		}
+		return WriteStringT(logCategory, appName, keyName, static_cast<const TChar*>(nullptr), lpFileName);
+	}
+
+	template<class TChar>
+	BOOL WriteSectionT(kxf::StringView logCategory, const TChar* appName, const TChar* lpString, const TChar* lpFileName)
+	{
+		KX_SCOPEDLOG_AUTO;
+		KX_SCOPEDLOG.Trace(logCategory).Format("Section: '{}', Path: '{}'", appName, lpFileName);
+
+		Redirector& redirector = Redirector::GetInstance();
+		const bool isNativeWriteDeferred = redirector.IsOptionEnabled(RedirectorOption::NativeWriteDeferred);
+
+		ConfigObject* writtenObject = nullptr;
+		auto WriteSectionToMemoryFile = [&]()
+		{
+			if (!lpFileName)
+			{
+				::SetLastError(ERROR_FILE_NOT_FOUND);
+				return false;
+			}
+			if (!appName)
+			{
+				::SetLastError(ERROR_INVALID_PARAMETER);
+				return false;
+			}
+
+			kxf::IEncodingConverter& converter = redirector.GetEncodingConverter();
+			ConfigObject& configObject = redirector.GetOrLoadFile(INIWrapper::EncodingTo(lpFileName, converter));
+			auto lock = configObject.LockExclusive();
+			INIWrapper& ini = configObject.GetINI();
+			writtenObject = &configObject;
+
+			// No content means deleting the section
+			const auto sectionName = INIWrapper::EncodingTo(appName, converter);
+			const FoldedName foldedSection(sectionName);
+			if (!lpString)
+			{
+				const bool deleted = ini.DeleteSection(foldedSection);
+				if (deleted)
+				{
+					KX_SCOPEDLOG.Trace(logCategory).Format("Section '{}' deleted", appName);
+					if (isNativeWriteDeferred)
+					{
+						configObject.GetNativeWriteQueue().DeleteSection(ToNativeWideString(appName));
+					}
+					configObject.OnWrite();
+				}
+				return deleted;
+			}
+
+			// The new content replaces the section in place as the native function does. The listed keys are written first,
+			// so the section doesn't become empty in between and keeps its position in the file, the keys which aren't
+			// listed anymore are deleted after that. Existing keys keep their order, the new ones are appended.
+			const std::vector<kxf::String> oldKeys = ini.GetKeyNames(sectionName);
+			std::unordered_set<std::wstring, FoldedName::Hash, FoldedName::Equal> newKeys;
+
+			// Parse the 'key=value\0key=value\0\0' list
+			size_t count = 0;
+			const TChar* item = lpString;
+			for (; *item; item += std::char_traits<TChar>::length(item) + 1)
+			{
+				std::basic_string_view<TChar> line = item;
+				const size_t pos = line.find(TChar('='));
+				if (pos == 0)
+				{
+					KX_SCOPEDLOG.Trace(logCategory).Format("Skipping line without a key name: '{}'", line);
+					continue;
+				}
+
+				// The native function writes the lines without '=' verbatim and they're read back as keys without a value.
+				// The document has no such entries, these lines become keys with an empty value.
+				auto keyName = INIWrapper::EncodingTo(std::basic_string<TChar>(line.substr(0, pos)).c_str(), converter);
+				auto value = pos != line.npos ? INIWrapper::EncodingTo(std::basic_string<TChar>(line.substr(pos + 1)).c_str(), converter) : kxf::String();
+
+				const FoldedName foldedKey(keyName);
+				if (ini.SetValue(foldedSection, foldedKey, value))
+				{
+					newKeys.emplace(foldedKey.GetFolded());
+					count++;
+				}
+			}
+			for (const kxf::String& keyName: oldKeys)
+			{
+				const FoldedName foldedKey(keyName);
+				if (!newKeys.contains(foldedKey.GetFolded()))
+				{
+					ini.DeleteKey(foldedSection, foldedKey);
+				}
+			}
+
+			KX_SCOPEDLOG.Trace(logCategory).Format("Section '{}' replaced with {} key-value pairs", appName, count);
+			if (isNativeWriteDeferred)
+			{
+				// Keep the list as is, including the item terminators, the final one is added by the string itself
+				configObject.GetNativeWriteQueue().ReplaceSection(ToNativeWideString(appName), ToNativeWideString(lpString, item - lpString));
+			}
+			configObject.OnWrite();
+			return true;
+		};
+		bool memoryWriteSuccess = WriteSectionToMemoryFile();
+		if (writtenObject)
+		{
+			writtenObject->OnWriteFinished();
+		}
+		redirector.FlushPendingWrites();
+
+		if (redirector.IsOptionEnabled(RedirectorOption::NativeWrite) && !isNativeWriteDeferred)
+		{
+			if constexpr(std::is_same_v<TChar, char>)
+			{
+				KX_SCOPEDLOG.Trace(logCategory).Format("Calling native 'WritePrivateProfileSectionA'");
+				return redirector.GetFunctionTable().PrivateProfile.WriteSectionA(appName, lpString, lpFileName);
+			}
+			else if constexpr(std::is_same_v<TChar, wchar_t>)
+			{
+				KX_SCOPEDLOG.Trace(logCategory).Format("Calling native 'WritePrivateProfileSectionW'");
+				return redirector.GetFunctionTable().PrivateProfile.WriteSectionW(appName, lpString, lpFileName);
+			}
+		}
+		return memoryWriteSuccess ? TRUE : FALSE;
+	}
+
+	template<class TChar>
+	bool IsRegistryMappedProfileSection(Redirector& redirector, const TChar* appName)
+	{
+		// Enumerating all sections has to include the registry-mapped ones as well
+		ProfileMapping& mapping = redirector.GetProfileMapping();
+		if (!appName)
+		{
+			return mapping.HasMappedSections();
+		}
+		return mapping.IsSectionMapped(INIWrapper::EncodingTo(appName, redirector.GetEncodingConverter()));
+	}
+
+	template<class TChar>
+	DWORD GetProfileStringT(kxf::StringView logCategory, const TChar* appName, const TChar* keyName, const TChar* defaultValue, TChar* lpReturnedString, DWORD nSize)
+	{
+		Redirector& redirector = Redirector::GetInstance();
+		if (IsRegistryMappedProfileSection(redirector, appName))
+		{
+			kxf::Log::TraceCategory(logCategory, "Section '{}' is mapped to the registry, calling native function", appName);
+			if constexpr(std::is_same_v<TChar, char>)
+			{
+				return redirector.GetFunctionTable().PrivateProfile.GetProfileStringA(appName, keyName, defaultValue, lpReturnedString, nSize);
+			}
+			else if constexpr(std::is_same_v<TChar, wchar_t>)
+			{
+				return redirector.GetFunctionTable().PrivateProfile.GetProfileStringW(appName, keyName, defaultValue, lpReturnedString, nSize);
+			}
+		}
+		return GetStringT(logCategory, appName, keyName, defaultValue, lpReturnedString, nSize, redirector.GetProfileMapping().GetFilePath<TChar>());
+	}
+
+	template<class TChar>
+	UINT GetProfileIntT(kxf::StringView logCategory, const TChar* appName, const TChar* keyName, INT defaultValue)
+	{
+		Redirector& redirector = Redirector::GetInstance();
+		if (IsRegistryMappedProfileSection(redirector, appName))
+		{
+			kxf::Log::TraceCategory(logCategory, "Section '{}' is mapped to the registry, calling native function", appName);
+			if constexpr(std::is_same_v<TChar, char>)
+			{
+				return redirector.GetFunctionTable().PrivateProfile.GetProfileIntA(appName, keyName, defaultValue);
+			}
+			else if constexpr(std::is_same_v<TChar, wchar_t>)
+			{
+				return redirector.GetFunctionTable().PrivateProfile.GetProfileIntW(appName, keyName, defaultValue);
+			}
+		}
+		return GetIntT(logCategory, appName, keyName, defaultValue, redirector.GetProfileMapping().GetFilePath<TChar>());
+	}
+
+	template<class TChar>
+	DWORD GetProfileSectionT(kxf::StringView logCategory, const TChar* appName, TChar* lpReturnedString, DWORD nSize)
+	{
+		Redirector& redirector = Redirector::GetInstance();
+		if (IsRegistryMappedProfileSection(redirector, appName))
+		{
+			kxf::Log::TraceCategory(logCategory, "Section '{}' is mapped to the registry, calling native function", appName);
+			if constexpr(std::is_same_v<TChar, char>)
+			{
+				return redirector.GetFunctionTable().PrivateProfile.GetProfileSectionA(appName, lpReturnedString, nSize);
+			}
+			else if constexpr(std::is_same_v<TChar, wchar_t>)
+			{
+				return redirector.GetFunctionTable().PrivateProfile.GetProfileSectionW(appName, lpReturnedString, nSize);
+			}
+		}
+		return GetSectionT(logCategory, appName, lpReturnedString, nSize, redirector.GetProfileMapping().GetFilePath<TChar>());
+	}
+
+	template<class TChar>
+	BOOL WriteProfileStringT(kxf::StringView logCategory, const TChar* appName, const TChar* keyName, const TChar* lpString)
+	{
+		Redirector& redirector = Redirector::GetInstance();
+		if (IsRegistryMappedProfileSection(redirector, appName))
+		{
+			kxf::Log::TraceCategory(logCategory, "Section '{}' is mapped to the registry, calling native function", appName);
+			if constexpr(std::is_same_v<TChar, char>)
+			{
+				return redirector.GetFunctionTable().PrivateProfile.WriteProfileStringA(appName, keyName, lpString);
+			}
+			else if constexpr(std::is_same_v<TChar, wchar_t>)
+			{
+				return redirector.GetFunctionTable().PrivateProfile.WriteProfileStringW(appName, keyName, lpString);
+			}
+		}
+		return WriteStringT(logCategory, appName, keyName, lpString, redirector.GetProfileMapping().GetFilePath<TChar>());
+	}
+
 	PPR_API(DWORD) GetStringA(LPCSTR appName, LPCSTR keyName, LPCSTR defaultValue, LPSTR lpReturnedString, DWORD nSize, LPCSTR lpFileName)
 	{
-		return GetStringT(LogCategory::GetPrivateProfileStringA, appName, keyName, defaultValue, lpReturnedString, nSize, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetStringT(LogCategory::GetPrivateProfileStringA, appName, keyName, defaultValue, lpReturnedString, nSize, lpFileName);
+		});
 	}
 	PPR_API(DWORD) GetStringW(LPCWSTR appName, LPCWSTR keyName, LPCWSTR defaultValue, LPWSTR lpReturnedString, DWORD nSize, LPCWSTR lpFileName)
 	{
-		return GetStringT(LogCategory::GetPrivateProfileStringA, appName, keyName, defaultValue, lpReturnedString, nSize, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetStringT(LogCategory::GetPrivateProfileStringA, appName, keyName, defaultValue, lpReturnedString, nSize, lpFileName);
+		});
 	}
 
 	PPR_API(UINT) GetIntA(LPCSTR appName, LPCSTR keyName, INT defaultValue, LPCSTR lpFileName)
 	{
-		return GetIntT(LogCategory::GetPrivateProfileIntA, appName, keyName, defaultValue, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetIntT(LogCategory::GetPrivateProfileIntA, appName, keyName, defaultValue, lpFileName);
+		});
 	}
 	PPR_API(UINT) GetIntW(LPCWSTR appName, LPCWSTR keyName, INT defaultValue, LPCWSTR lpFileName)
 	{
-		return GetIntT(LogCategory::GetPrivateProfileIntW, appName, keyName, defaultValue, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetIntT(LogCategory::GetPrivateProfileIntW, appName, keyName, defaultValue, lpFileName);
+		});
 	}
 
 	PPR_API(DWORD) GetSectionNamesA(LPSTR lpszReturnBuffer, DWORD nSize, LPCSTR lpFileName)
 	{
-		return GetSectionNamesT(LogCategory::GetPrivateProfileSectionNamesA, lpszReturnBuffer, nSize, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetSectionNamesT(LogCategory::GetPrivateProfileSectionNamesA, lpszReturnBuffer, nSize, lpFileName);
+		});
 	}
 	PPR_API(DWORD) GetSectionNamesW(LPWSTR lpszReturnBuffer, DWORD nSize, LPCWSTR lpFileName)
 	{
-		return GetSectionNamesT(LogCategory::GetPrivateProfileSectionNamesW, lpszReturnBuffer, nSize, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetSectionNamesT(LogCategory::GetPrivateProfileSectionNamesW, lpszReturnBuffer, nSize, lpFileName);
+		});
 	}
 
 	PPR_API(DWORD) GetSectionA(LPCSTR appName, LPSTR lpReturnedString, DWORD nSize, LPCSTR lpFileName)
 	{
-		return GetSectionT(LogCategory::GetPrivateProfileSectionA, appName, lpReturnedString, nSize, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetSectionT(LogCategory::GetPrivateProfileSectionA, appName, lpReturnedString, nSize, lpFileName);
+		});
 	}
 	PPR_API(DWORD) GetSectionW(LPCWSTR appName, LPWSTR lpReturnedString, DWORD nSize, LPCWSTR lpFileName)
 	{
-		return GetSectionT(LogCategory::GetPrivateProfileSectionW, appName, lpReturnedString, nSize, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetSectionT(LogCategory::GetPrivateProfileSectionW, appName, lpReturnedString, nSize, lpFileName);
+		});
 	}
 
 	PPR_API(BOOL) WriteStringA(LPCSTR appName, LPCSTR keyName, LPCSTR lpString, LPCSTR lpFileName)
 	{
-		return WriteStringT(LogCategory::WritePrivateProfileStringW, appName, keyName, lpString, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return WriteStringT(LogCategory::WritePrivateProfileStringW, appName, keyName, lpString, lpFileName);
+		});
 	}
 	PPR_API(BOOL) WriteStringW(LPCWSTR appName, LPCWSTR keyName, LPCWSTR lpString, LPCWSTR lpFileName)
 	{
-		return WriteStringT(LogCategory::WritePrivateProfileStringW, appName, keyName, lpString, lpFileName);
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return WriteStringT(LogCategory::WritePrivateProfileStringW, appName, keyName, lpString, lpFileName);
+		});
+	}
+
+	PPR_API(BOOL) GetStructA(LPCSTR appName, LPCSTR keyName, LPVOID lpStruct, UINT uSizeStruct, LPCSTR lpFileName)
+	{
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetStructT(LogCategory::GetPrivateProfileStructA, appName, keyName, lpStruct, uSizeStruct, lpFileName);
+		});
+	}
+	PPR_API(BOOL) GetStructW(LPCWSTR appName, LPCWSTR keyName, LPVOID lpStruct, UINT uSizeStruct, LPCWSTR lpFileName)
+	{
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return GetStructT(LogCategory::GetPrivateProfileStructW, appName, keyName, lpStruct, uSizeStruct, lpFileName);
+		});
+	}
+
+	PPR_API(BOOL) WriteStructA(LPCSTR appName, LPCSTR keyName, LPVOID lpStruct, UINT uSizeStruct, LPCSTR lpFileName)
+	{
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return WriteStructT(LogCategory::WritePrivateProfileStructA, appName, keyName, lpStruct, uSizeStruct, lpFileName);
+		});
+	}
+	PPR_API(BOOL) WriteStructW(LPCWSTR appName, LPCWSTR keyName, LPVOID lpStruct, UINT uSizeStruct, LPCWSTR lpFileName)
+	{
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return WriteStructT(LogCategory::WritePrivateProfileStructW, appName, keyName, lpStruct, uSizeStruct, lpFileName);
+		});
+	}
+
+	PPR_API(BOOL) WriteSectionA(LPCSTR appName, LPCSTR lpString, LPCSTR lpFileName)
+	{
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return WriteSectionT(LogCategory::WritePrivateProfileSectionA, appName, lpString, lpFileName);
+		});
+	}
+	PPR_API(BOOL) WriteSectionW(LPCWSTR appName, LPCWSTR lpString, LPCWSTR lpFileName)
+	{
+		return TrackFileCall(__func__, _ReturnAddress(), lpFileName, [&]()
+		{
+			return WriteSectionT(LogCategory::WritePrivateProfileSectionW, appName, lpString, lpFileName);
+		});
+	}
+
+	PPR_API(DWORD) GetProfileStringA(LPCSTR appName, LPCSTR keyName, LPCSTR defaultValue, LPSTR lpReturnedString, DWORD nSize)
+	{
+		return TrackMappedCall<char>(__func__, _ReturnAddress(), [&]()
+		{
+			return GetProfileStringT(LogCategory::GetProfileStringA, appName, keyName, defaultValue, lpReturnedString, nSize);
+		});
+	}
+	PPR_API(DWORD) GetProfileStringW(LPCWSTR appName, LPCWSTR keyName, LPCWSTR defaultValue, LPWSTR lpReturnedString, DWORD nSize)
+	{
+		return TrackMappedCall<wchar_t>(__func__, _ReturnAddress(), [&]()
+		{
+			return GetProfileStringT(LogCategory::GetProfileStringW, appName, keyName, defaultValue, lpReturnedString, nSize);
+		});
+	}
+
+	PPR_API(UINT) GetProfileIntA(LPCSTR appName, LPCSTR keyName, INT defaultValue)
+	{
+		return TrackMappedCall<char>(__func__, _ReturnAddress(), [&]()
+		{
+			return GetProfileIntT(LogCategory::GetProfileIntA, appName, keyName, defaultValue);
+		});
+	}
+	PPR_API(UINT) GetProfileIntW(LPCWSTR appName, LPCWSTR keyName, INT defaultValue)
+	{
+		return TrackMappedCall<wchar_t>(__func__, _ReturnAddress(), [&]()
+		{
+			return GetProfileIntT(LogCategory::GetProfileIntW, appName, keyName, defaultValue);
+		});
+	}
+
+	PPR_API(DWORD) GetProfileSectionA(LPCSTR appName, LPSTR lpReturnedString, DWORD nSize)
+	{
+		return TrackMappedCall<char>(__func__, _ReturnAddress(), [&]()
+		{
+			return GetProfileSectionT(LogCategory::GetProfileSectionA, appName, lpReturnedString, nSize);
+		});
+	}
+	PPR_API(DWORD) GetProfileSectionW(LPCWSTR appName, LPWSTR lpReturnedString, DWORD nSize)
+	{
+		return TrackMappedCall<wchar_t>(__func__, _ReturnAddress(), [&]()
+		{
+			return GetProfileSectionT(LogCategory::GetProfileSectionW, appName, lpReturnedString, nSize);
+		});
+	}
+
+	PPR_API(BOOL) WriteProfileStringA(LPCSTR appName, LPCSTR keyName, LPCSTR lpString)
+	{
+		return TrackMappedCall<char>(__func__, _ReturnAddress(), [&]()
+		{
+			return WriteProfileStringT(LogCategory::WriteProfileStringA, appName, keyName, lpString);
+		});
+	}
+	PPR_API(BOOL) WriteProfileStringW(LPCWSTR appName, LPCWSTR keyName, LPCWSTR lpString)
+	{
+		return TrackMappedCall<wchar_t>(__func__, _ReturnAddress(), [&]()
+		{
+			return WriteProfileStringT(LogCategory::WriteProfileStringW, appName, keyName, lpString);
+		});
 	}
 }
@@ -19,4 +19,25 @@ namespace PPR::PrivateProfile
 
 	PPR_API(BOOL) WriteStringA(LPCSTR appName, LPCSTR keyName, LPCSTR lpString, LPCSTR lpFileName);
 	PPR_API(BOOL) WriteStringW(LPCWSTR appName, LPCWSTR keyName, LPCWSTR lpString, LPCWSTR lpFileName);
+
+	PPR_API(BOOL) GetStructA(LPCSTR appName, LPCSTR keyName, LPVOID lpStruct, UINT uSizeStruct, LPCSTR lpFileName);
+	PPR_API(BOOL) GetStructW(LPCWSTR appName, LPCWSTR keyName, LPVOID lpStruct, UINT uSizeStruct, LPCWSTR lpFileName);
+
+	PPR_API(BOOL) WriteStructA(LPCSTR appName, LPCSTR keyName, LPVOID lpStruct, UINT uSizeStruct, LPCSTR lpFileName);
+	PPR_API(BOOL) WriteStructW(LPCWSTR appName, LPCWSTR keyName, LPVOID lpStruct, UINT uSizeStruct, LPCWSTR lpFileName);
+
+	PPR_API(BOOL) WriteSectionA(LPCSTR appName, LPCSTR lpString, LPCSTR lpFileName);
+	PPR_API(BOOL) WriteSectionW(LPCWSTR appName, LPCWSTR lpString, LPCWSTR lpFileName);
+
+	PPR_API(DWORD) GetProfileStringA(LPCSTR appName, LPCSTR keyName, LPCSTR defaultValue, LPSTR lpReturnedString, DWORD nSize);
+	PPR_API(DWORD) GetProfileStringW(LPCWSTR appName, LPCWSTR keyName, LPCWSTR defaultValue, LPWSTR lpReturnedString, DWORD nSize);
+
+	PPR_API(UINT) GetProfileIntA(LPCSTR appName, LPCSTR keyName, INT defaultValue);
+	PPR_API(UINT) GetProfileIntW(LPCWSTR appName, LPCWSTR keyName, INT defaultValue);
+
+	PPR_API(DWORD) GetProfileSectionA(LPCSTR appName, LPSTR lpReturnedString, DWORD nSize);
+	PPR_API(DWORD) GetProfileSectionW(LPCWSTR appName, LPWSTR lpReturnedString, DWORD nSize);
+
+	PPR_API(BOOL) WriteProfileStringA(LPCSTR appName, LPCSTR keyName, LPCSTR lpString);
+	PPR_API(BOOL) WriteProfileStringW(LPCWSTR appName, LPCWSTR keyName, LPCWSTR lpString);
 }
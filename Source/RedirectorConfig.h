@@ -15,7 +15,12 @@ namespace PPR
 		SaveOnThreadDetach = 1 << 4,
 		SaveOnProcessDetach = 1 << 5,
 		SaveOnGameSave = 1 << 6,
-		ProcessInlineComments = 1 << 7
+		ProcessInlineComments = 1 << 7,
+		NativeWriteDeferred = 1 << 8,
+		CallerStatistics = 1 << 9,
+		TraceEvents = 1 << 10,
+		PerfectHashIndex = 1 << 11,
+		SharedSnapshot = 1 << 12
 	};
 }
 
@@ -0,0 +1,119 @@
+#include "stdafx.h"
+#include "SettingParser.h"
+#include <charconv>
+#include <cmath>
+
+namespace
+{
+	std::string_view SkipWhitespace(std::string_view value) noexcept
+	{
+		const size_t start = value.find_first_not_of(" \t\r\n\v\f");
+		return start != value.npos ? value.substr(start) : std::string_view();
+	}
+
+	// 'strtol' rules: optional sign, decimal digits, saturated on overflow
+	template<class T>
+	T ParseDecimal(std::string_view value, bool& isNegative) noexcept
+	{
+		isNegative = false;
+		value = SkipWhitespace(value);
+		if (!value.empty() && (value.front() == '+' || value.front() == '-'))
+		{
+			isNegative = value.front() == '-';
+			value.remove_prefix(1);
+		}
+
+		T result = 0;
+		if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result); ec == std::errc::result_out_of_range)
+		{
+			result = std::numeric_limits<T>::max();
+		}
+		return result;
+	}
+}
+
+namespace PPR
+{
+	float SettingParser::ParseFloat(std::string_view value) noexcept
+	{
+		value = SkipWhitespace(value);
+
+		bool isNegative = false;
+		if (!value.empty() && (value.front() == '+' || value.front() == '-'))
+		{
+			isNegative = value.front() == '-';
+			value.remove_prefix(1);
+		}
+
+		// 'atof' reads hexadecimal floats as well, 'from_chars' takes them without the prefix. It also takes a minus sign
+		// by itself, which 'atof' doesn't accept after the one that's already skipped.
+		auto format = std::chars_format::general;
+		if (value.length() >= 2 && value[0] == '0' && (value[1] == 'x' || value[1] == 'X'))
+		{
+			format = std::chars_format::hex;
+			value.remove_prefix(2);
+		}
+		if (value.starts_with('-'))
+		{
+			return 0.0f;
+		}
+
+		double result = 0;
+		if (auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), result, format); ec == std::errc::result_out_of_range)
+		{
+			// Same as 'atof', which returns HUGE_VAL on overflow and zero on underflow. The value is out of range
+			// either because of its exponent or because of the number of its integer or fractional digits.
+			bool isUnderflow = false;
+			if (size_t exponent = value.find_first_of(format == std::chars_format::hex ? "pP" : "eE"); exponent != value.npos)
+			{
+				isUnderflow = value.substr(exponent + 1).starts_with('-');
+			}
+			else
+			{
+				isUnderflow = value.substr(0, value.find('.')).find_first_not_of('0') == value.npos;
+			}
+			result = isUnderflow ? 0.0 : HUGE_VAL;
+		}
+		return static_cast<float>(isNegative ? -result : result);
+	}
+	bool SettingParser::ParseBool(std::string_view value) noexcept
+	{
+		value = SkipWhitespace(value);
+		if (value.length() >= 4 && _strnicmp(value.data(), "true", 4) == 0)
+		{
+			return true;
+		}
+		else if (value.length() >= 5 && _strnicmp(value.data(), "false", 5) == 0)
+		{
+			return false;
+		}
+
+		bool isNegative = false;
+		return ParseDecimal<uint64_t>(value, isNegative) != 0;
+	}
+	int64_t SettingParser::ParseInteger(std::string_view value, kxf::StringView keyName) noexcept
+	{
+		const wchar_t prefix = !keyName.empty() ? keyName.front() : 0;
+
+		bool isNegative = false;
+		const uint64_t magnitude = ParseDecimal<uint64_t>(value, isNegative);
+		if (prefix == L'u' || prefix == L'U')
+		{
+			// 'strtoul' negates the value in the unsigned type, but saturates on overflow
+			if (magnitude > std::numeric_limits<uint32_t>::max())
+			{
+				return std::numeric_limits<uint32_t>::max();
+			}
+			const uint32_t result = static_cast<uint32_t>(magnitude);
+			return isNegative ? static_cast<uint32_t>(0u - result) : result;
+		}
+
+		const int64_t min = prefix == L'i' || prefix == L'I' ? std::numeric_limits<int32_t>::min() : std::numeric_limits<int64_t>::min();
+		const int64_t max = prefix == L'i' || prefix == L'I' ? std::numeric_limits<int32_t>::max() : std::numeric_limits<int64_t>::max();
+		if (isNegative)
+		{
+			return magnitude > static_cast<uint64_t>(max) + 1 ? min : static_cast<int64_t>(0 - magnitude);
+		}
+		return magnitude > static_cast<uint64_t>(max) ? max : static_cast<int64_t>(magnitude);
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "stdafx.h"
+
+namespace PPR
+{
+	// Parses the values the same way the game engine parses its own settings, which type is given by the first letter
+	// of the key name: 'f' is read with 'atof' (hexadecimal floats included), 'b' is "true", "false" or an integer, 'i' is
+	// read with 'atoi' and 'u' with 'strtoul'. Leading whitespace is skipped, parsing stops at the first unexpected character
+	// and a value that doesn't start with a number is zero. Parsing doesn't depend on the current locale.
+	class SettingParser final
+	{
+		public:
+			static float ParseFloat(std::string_view value) noexcept;
+			static bool ParseBool(std::string_view value) noexcept;
+
+			// 'i' and 'u' keys are parsed as 32-bit integers like the engine does, others use the full 64-bit range
+			static int64_t ParseInteger(std::string_view value, kxf::StringView keyName) noexcept;
+
+		public:
+			SettingParser() = delete;
+	};
+}
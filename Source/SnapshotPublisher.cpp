@@ -0,0 +1,264 @@
+#include "stdafx.h"
+#include "SnapshotPublisher.h"
+#include "PrivateProfileRedirector.h"
+#include "ConfigObject.h"
+#include "IndexValue.h"
+#include <kxf/System/Win32Error.h>
+#include <bit>
+
+namespace PPR
+{
+	// The layout is little-endian with UTF-16 strings, which is what the process uses natively
+	static_assert(std::endian::native == std::endian::little && sizeof(wchar_t) == sizeof(uint16_t));
+	static_assert(sizeof(PPR_SnapshotHeader) == 64 && offsetof(PPR_SnapshotHeader, Sequence) % sizeof(uint64_t) == 0);
+	static_assert(sizeof(PPR_SnapshotRecord) == 8);
+
+	uint8_t* SnapshotWriter::AddRecord(PPR_SnapshotRecordType type, size_t length)
+	{
+		PPR_SnapshotRecord record = {};
+		record.Type = static_cast<uint16_t>(type);
+		record.Length = static_cast<uint32_t>(length);
+
+		// Padding bytes are zeroed by 'resize'
+		const size_t offset = m_Data.size();
+		m_Data.resize(offset + sizeof(record) + ((length * sizeof(uint16_t) + 3) & ~size_t(3)));
+		std::memcpy(m_Data.data() + offset, &record, sizeof(record));
+
+		return m_Data.data() + offset + sizeof(record);
+	}
+	void SnapshotWriter::AddText(PPR_SnapshotRecordType type, kxf::StringView text)
+	{
+		uint8_t* data = AddRecord(type, text.length());
+		std::memcpy(data, text.data(), text.length() * sizeof(wchar_t));
+	}
+	void SnapshotWriter::AddText(PPR_SnapshotRecordType type, std::string_view text)
+	{
+		uint8_t* data = AddRecord(type, text.length());
+		for (char c: text)
+		{
+			const uint16_t unit = static_cast<uint8_t>(c);
+			std::memcpy(data, &unit, sizeof(unit));
+			data += sizeof(unit);
+		}
+	}
+
+	void SnapshotWriter::BeginFile(kxf::StringView path)
+	{
+		m_FileStart = m_Data.size();
+		AddText(PPR_SNAPSHOT_RECORD_FILE, path);
+	}
+	void SnapshotWriter::AddSection(kxf::StringView name)
+	{
+		AddText(PPR_SNAPSHOT_RECORD_SECTION, name);
+	}
+	void SnapshotWriter::AddValue(kxf::StringView key, const IndexValue& value)
+	{
+		AddText(PPR_SNAPSHOT_RECORD_KEY, key);
+		if (value.IsASCII())
+		{
+			AddText(PPR_SNAPSHOT_RECORD_VALUE, value.GetASCII());
+		}
+		else
+		{
+			AddText(PPR_SNAPSHOT_RECORD_VALUE, value.GetWide());
+		}
+	}
+	bool SnapshotWriter::EndFile(size_t capacity)
+	{
+		if (m_Data.size() > capacity)
+		{
+			m_Data.resize(m_FileStart);
+			m_IsTruncated = true;
+
+			return false;
+		}
+
+		m_FileCount++;
+		return true;
+	}
+}
+
+namespace PPR
+{
+	void SnapshotPublisher::StartThread()
+	{
+		std::lock_guard lock(m_Mutex);
+		if (!m_Stop)
+		{
+			m_Thread = std::thread(&SnapshotPublisher::RunThread, this);
+		}
+	}
+	void SnapshotPublisher::RunThread()
+	{
+		std::unique_lock lock(m_Mutex);
+		while (!m_Stop)
+		{
+			if (!m_IsPending)
+			{
+				m_Condition.wait(lock);
+				continue;
+			}
+			if (Clock::now() < m_Deadline)
+			{
+				m_Condition.wait_until(lock, m_Deadline);
+				continue;
+			}
+
+			// Writes made from now on schedule the next snapshot
+			m_IsPending = false;
+			lock.unlock();
+			Publish();
+			lock.lock();
+
+			// Writes made while publishing wait for the rest of the delay
+			m_Deadline = Clock::now() + Delay;
+		}
+	}
+	bool SnapshotPublisher::CreateRegion()
+	{
+		const auto name = std::format(L"Local\\" PPR_SNAPSHOT_NAME_PREFIX L"{}", ::GetCurrentProcessId());
+
+		m_Mapping = ::CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(m_RegionSize), name.c_str());
+		if (m_Mapping)
+		{
+			m_Header = static_cast<PPR_SnapshotHeader*>(::MapViewOfFile(m_Mapping, FILE_MAP_WRITE, 0, 0, m_RegionSize));
+		}
+		if (!m_Header)
+		{
+			kxf::Log::WarningCategory("SharedSnapshot", L"Failed to create the shared snapshot '{}', {}", name, kxf::Win32Error::GetLastError());
+			m_IsRegionFailed = true;
+
+			return false;
+		}
+
+		// The region is zero-filled, so it's an empty snapshot until the first one is published
+		m_Header->LayoutVersion = PPR_SNAPSHOT_LAYOUT_VERSION;
+		m_Header->HeaderSize = sizeof(PPR_SnapshotHeader);
+		m_Header->RegionSize = static_cast<uint32_t>(m_RegionSize);
+		std::atomic_ref(m_Header->Magic).store(PPR_SNAPSHOT_MAGIC, std::memory_order_release);
+
+		kxf::Log::InfoCategory("SharedSnapshot", L"Created the shared snapshot '{}', {} bytes", name, m_RegionSize);
+		return true;
+	}
+	bool SnapshotPublisher::Publish()
+	{
+		if (m_IsRegionFailed || (!m_Header && !CreateRegion()))
+		{
+			return false;
+		}
+
+		Redirector& redirector = Redirector::GetInstance();
+		TraceSpan traceSpan(redirector.GetTraceRecorder(), "PublishSnapshot");
+
+		// File objects are never destroyed, take the list and serialize them without holding the map lock
+		std::vector<ConfigObject*> files;
+		{
+			ReaderBiasedLock::ReadGuard lock(redirector.m_INIMapLock);
+			files.reserve(redirector.m_INIMap.size());
+			for (const auto& [path, config]: redirector.m_INIMap)
+			{
+				files.push_back(config.get());
+			}
+		}
+
+		// Serialize everything first, so the readers only have to retry while the finished data is copied
+		const size_t capacity = m_RegionSize - m_Header->HeaderSize;
+
+		m_Writer.Clear();
+		for (ConfigObject* configObject: files)
+		{
+			if (configObject->WriteSnapshot(m_Writer))
+			{
+				m_Writer.EndFile(capacity);
+			}
+		}
+
+		PPR_SnapshotHeader& header = *m_Header;
+		std::atomic_ref sequence(header.Sequence);
+		const uint64_t value = sequence.load(std::memory_order_relaxed);
+
+		// The odd counter must become visible before any of the data changes
+		sequence.store(value + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		std::memcpy(reinterpret_cast<uint8_t*>(&header) + header.HeaderSize, m_Writer.GetData(), m_Writer.GetSize());
+		header.Flags = m_Writer.IsTruncated() ? PPR_SNAPSHOT_FLAG_TRUNCATED : 0;
+		header.Generation++;
+		header.DataSize = static_cast<uint32_t>(m_Writer.GetSize());
+		header.FileCount = static_cast<uint32_t>(m_Writer.GetFileCount());
+
+		sequence.store(value + 2, std::memory_order_release);
+
+		m_PublishCount++;
+		m_DataSize = m_Writer.GetSize();
+		if (m_Writer.IsTruncated() && m_TruncatedCount++ == 0)
+		{
+			kxf::Log::WarningCategory("SharedSnapshot", "Snapshot doesn't fit into {} bytes, {} of {} files published", capacity, m_Writer.GetFileCount(), files.size());
+		}
+		return true;
+	}
+
+	SnapshotPublisher::SnapshotPublisher(size_t regionSize)
+		:m_RegionSize(regionSize)
+	{
+	}
+	SnapshotPublisher::~SnapshotPublisher()
+	{
+		Stop();
+
+		// The thread is either joined or terminated along with the process at this point
+		if (m_Header)
+		{
+			::UnmapViewOfFile(m_Header);
+		}
+		if (m_Mapping)
+		{
+			::CloseHandle(m_Mapping);
+		}
+	}
+
+	void SnapshotPublisher::Schedule()
+	{
+		// Only the first write after a snapshot has to wake the thread up
+		if (m_IsPending.exchange(true))
+		{
+			return;
+		}
+
+		// Don't start the thread from 'DllMain', do it with the first loaded file instead
+		std::call_once(m_ThreadStarted, &SnapshotPublisher::StartThread, this);
+		{
+			std::lock_guard lock(m_Mutex);
+			if (m_Stop)
+			{
+				return;
+			}
+			m_Deadline = Clock::now() + Delay;
+		}
+		m_Condition.notify_one();
+	}
+	void SnapshotPublisher::Stop()
+	{
+		// The thread has been terminated along with the rest of the process and it could've been holding the mutex,
+		// only its handle is left to release.
+		if (ReaderBiasedLock::IsProcessTerminating())
+		{
+			if (m_Thread.joinable())
+			{
+				m_Thread.detach();
+			}
+			return;
+		}
+
+		{
+			std::lock_guard lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_Condition.notify_one();
+
+		if (m_Thread.joinable())
+		{
+			m_Thread.join();
+		}
+	}
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "stdafx.h"
+#include "API/PrivateProfileRedirectorSnapshot.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace PPR
+{
+	class ConfigObject;
+	class IndexValue;
+}
+
+namespace PPR
+{
+	// Serializes the files into the flat record layout of the shared snapshot, see 'PrivateProfileRedirectorSnapshot.h'.
+	// The buffer is reused between the snapshots.
+	class SnapshotWriter final
+	{
+		private:
+			std::vector<uint8_t> m_Data;
+			size_t m_FileStart = 0;
+			size_t m_FileCount = 0;
+			bool m_IsTruncated = false;
+
+		private:
+			uint8_t* AddRecord(PPR_SnapshotRecordType type, size_t length);
+			void AddText(PPR_SnapshotRecordType type, kxf::StringView text);
+			void AddText(PPR_SnapshotRecordType type, std::string_view text);
+
+		public:
+			void Clear() noexcept
+			{
+				m_Data.clear();
+				m_FileStart = 0;
+				m_FileCount = 0;
+				m_IsTruncated = false;
+			}
+
+			void BeginFile(kxf::StringView path);
+			void AddSection(kxf::StringView name);
+			void AddValue(kxf::StringView key, const IndexValue& value);
+
+			// Drops the file if the data doesn't fit into the capacity anymore
+			bool EndFile(size_t capacity);
+
+			const uint8_t* GetData() const noexcept
+			{
+				return m_Data.data();
+			}
+			size_t GetSize() const noexcept
+			{
+				return m_Data.size();
+			}
+			size_t GetFileCount() const noexcept
+			{
+				return m_FileCount;
+			}
+			bool IsTruncated() const noexcept
+			{
+				return m_IsTruncated;
+			}
+	};
+}
+
+namespace PPR
+{
+	// Publishes the content of all the loaded files into a named shared memory region ('SharedSnapshot' option), so the
+	// external tools can see the values that haven't been saved yet. Writes only mark the snapshot as outdated, it's
+	// rebuilt by a background thread at most once per 'Delay' and copied into the region under a sequence lock.
+	class SnapshotPublisher final
+	{
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			static constexpr std::chrono::milliseconds Delay = std::chrono::milliseconds(250);
+
+		private:
+			std::mutex m_Mutex;
+			std::condition_variable m_Condition;
+			Clock::time_point m_Deadline;
+			std::atomic<bool> m_IsPending = false;
+			bool m_Stop = false;
+
+			// Only used by the publisher thread
+			const size_t m_RegionSize = 0;
+			HANDLE m_Mapping = nullptr;
+			PPR_SnapshotHeader* m_Header = nullptr;
+			bool m_IsRegionFailed = false;
+			SnapshotWriter m_Writer;
+
+			std::atomic<size_t> m_PublishCount = 0;
+			std::atomic<size_t> m_TruncatedCount = 0;
+			std::atomic<size_t> m_DataSize = 0;
+
+			// Started by the first loaded file and joined by 'Stop', the publisher has to be stopped before the files are destroyed
+			std::thread m_Thread;
+			std::once_flag m_ThreadStarted;
+
+		private:
+			void RunThread();
+			bool CreateRegion();
+			bool Publish();
+
+			void StartThread();
+
+		public:
+			SnapshotPublisher(size_t regionSize);
+			SnapshotPublisher(const SnapshotPublisher&) = delete;
+			~SnapshotPublisher();
+
+		public:
+			void Schedule();
+
+			// Waits for the thread to finish the snapshot it's in the middle of, nothing is published after this returns
+			void Stop();
+
+			size_t GetPublishCount() const noexcept
+			{
+				return m_PublishCount;
+			}
+			size_t GetTruncatedCount() const noexcept
+			{
+				return m_TruncatedCount;
+			}
+			size_t GetDataSize() const noexcept
+			{
+				return m_DataSize;
+			}
+			size_t GetRegionSize() const noexcept
+			{
+				return m_RegionSize;
+			}
+
+		public:
+			SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+	};
+}
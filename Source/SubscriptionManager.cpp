@@ -0,0 +1,175 @@
+#include "stdafx.h"
+#include "SubscriptionManager.h"
+#include "ConfigObject.h"
+#include "ReaderBiasedLock.h"
+
+namespace PPR
+{
+	std::optional<kxf::String> SubscriptionManager::QueryValue(ConfigObject& file, const kxf::String& section, const kxf::String& key)
+	{
+		const FoldedName foldedSection(section);
+		auto lock = file.LockSectionShared(foldedSection);
+		return file.GetINI().QueryValue(foldedSection, FoldedName(key));
+	}
+
+	uint64_t SubscriptionManager::Subscribe(ConfigObject& file, kxf::String section, kxf::String key, PPR_ChangeCallback callback, void* userData)
+	{
+		// Read the current state before taking the lock, the file locks are never taken after it except by 'Deliver'
+		Subscription subscription;
+		subscription.Value = QueryValue(file, section, key);
+		subscription.File = &file;
+		subscription.Section = std::move(section);
+		subscription.Key = std::move(key);
+		subscription.Callback = callback;
+		subscription.UserData = userData;
+
+		std::lock_guard lock(m_Lock);
+		const uint64_t id = ++m_LastID;
+		m_Subscriptions.emplace(id, std::move(subscription));
+		file.AddSubscriber();
+		m_Count++;
+
+		return id;
+	}
+	bool SubscriptionManager::IsInvokingOnThisThread() const noexcept
+	{
+		const DWORD threadID = ::GetCurrentThreadId();
+		return std::any_of(m_Invocations.begin(), m_Invocations.end(), [&](const Invocation& invocation)
+		{
+			return invocation.ThreadID == threadID;
+		});
+	}
+	void SubscriptionManager::WaitForInvocations(std::unique_lock<std::mutex>& lock, uint64_t id)
+	{
+		// Nothing is waited for from a callback, the other thread can be waiting for this one. The threads
+		// of a terminating process are gone already and would never finish their callbacks.
+		if (IsInvokingOnThisThread() || ReaderBiasedLock::IsProcessTerminating())
+		{
+			return;
+		}
+
+		m_InvocationFinished.wait(lock, [&]()
+		{
+			return std::none_of(m_Invocations.begin(), m_Invocations.end(), [&](const Invocation& invocation)
+			{
+				return id == 0 || invocation.ID == id;
+			});
+		});
+	}
+
+	bool SubscriptionManager::Unsubscribe(uint64_t id)
+	{
+		std::unique_lock lock(m_Lock);
+		if (auto it = m_Subscriptions.find(id); it != m_Subscriptions.end())
+		{
+			it->second.File->RemoveSubscriber();
+			m_Subscriptions.erase(it);
+			m_Count--;
+
+			// Wait for the callback being called on the other threads, so it isn't called anymore after this returns
+			WaitForInvocations(lock, id);
+			return true;
+		}
+		return false;
+	}
+	void SubscriptionManager::Stop()
+	{
+		std::unique_lock lock(m_Lock);
+		m_Stopped = true;
+		WaitForInvocations(lock);
+	}
+
+	size_t SubscriptionManager::Deliver()
+	{
+		if (m_Count == 0 || ReaderBiasedLock::IsProcessTerminating())
+		{
+			return 0;
+		}
+
+		// Compare the watched values of the changed files with their last seen state
+		std::vector<uint64_t> changed;
+		{
+			std::lock_guard lock(m_Lock);
+			if (m_Stopped)
+			{
+				return 0;
+			}
+
+			// Take the change flag of every file once, a write can set it again in the meantime
+			std::vector<ConfigObject*> checkedFiles;
+			std::vector<ConfigObject*> changedFiles;
+			for (const auto& [id, subscription]: m_Subscriptions)
+			{
+				if (std::find(checkedFiles.begin(), checkedFiles.end(), subscription.File) == checkedFiles.end())
+				{
+					checkedFiles.push_back(subscription.File);
+					if (subscription.File->TakeSubscribedChanges())
+					{
+						changedFiles.push_back(subscription.File);
+					}
+				}
+			}
+
+			for (auto& [id, subscription]: m_Subscriptions)
+			{
+				if (std::find(changedFiles.begin(), changedFiles.end(), subscription.File) != changedFiles.end())
+				{
+					auto value = QueryValue(*subscription.File, subscription.Section, subscription.Key);
+					if (value != subscription.Value)
+					{
+						subscription.Value = std::move(value);
+						changed.push_back(id);
+					}
+				}
+			}
+		}
+
+		// The callbacks are copied under the lock and called outside of it, so they can use the whole API including
+		// another flush. A callback can unsubscribe the other ones and the manager can be stopped in the meantime.
+		size_t count = 0;
+		const DWORD threadID = ::GetCurrentThreadId();
+		for (uint64_t id: changed)
+		{
+			PPR_ChangeCallback callback = nullptr;
+			void* userData = nullptr;
+			{
+				std::lock_guard lock(m_Lock);
+				if (m_Stopped || ReaderBiasedLock::IsProcessTerminating())
+				{
+					break;
+				}
+
+				if (auto it = m_Subscriptions.find(id); it != m_Subscriptions.end())
+				{
+					callback = it->second.Callback;
+					userData = it->second.UserData;
+					m_Invocations.push_back({id, threadID});
+				}
+			}
+
+			if (callback)
+			{
+				kxf::Utility::ScopeGuard atExit = [&]()
+				{
+					{
+						std::lock_guard lock(m_Lock);
+
+						// The nested deliveries of this thread finish first, so the last matching entry is this one
+						auto it = std::find_if(m_Invocations.rbegin(), m_Invocations.rend(), [&](const Invocation& invocation)
+						{
+							return invocation.ID == id && invocation.ThreadID == threadID;
+						});
+						m_Invocations.erase(std::next(it).base());
+					}
+					m_InvocationFinished.notify_all();
+				};
+
+				std::invoke(callback, id, userData);
+				count++;
+			}
+		}
+
+		m_DeliveryCount += count;
+		return count;
+	}
+}
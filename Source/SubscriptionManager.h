@@ -0,0 +1,82 @@
+#pragma once
+#include "stdafx.h"
+#include "API/PrivateProfileRedirectorAPI.h"
+#include <mutex>
+#include <condition_variable>
+#include <map>
+
+namespace PPR
+{
+	class ConfigObject;
+}
+
+namespace PPR
+{
+	// Change subscriptions of the other plugins, see 'PPR_Subscribe'. Writes only mark their file as changed if it has
+	// any subscribers, the watched values are compared with their last seen state when the changes are flushed
+	// and the callbacks of the changed ones are called once per flush, on the flushing thread and without any lock held.
+	// Nothing is delivered after 'Stop' or while the process is terminating.
+	class SubscriptionManager final
+	{
+		private:
+			struct Subscription final
+			{
+				ConfigObject* File = nullptr;
+				kxf::String Section;
+				kxf::String Key;
+				std::optional<kxf::String> Value;
+
+				PPR_ChangeCallback Callback = nullptr;
+				void* UserData = nullptr;
+			};
+
+			// Callback being called right now and the thread it's called on
+			struct Invocation final
+			{
+				uint64_t ID = 0;
+				DWORD ThreadID = 0;
+			};
+
+		private:
+			std::mutex m_Lock;
+			std::condition_variable m_InvocationFinished;
+			std::map<uint64_t, Subscription> m_Subscriptions;
+			std::vector<Invocation> m_Invocations;
+			uint64_t m_LastID = 0;
+			bool m_Stopped = false;
+			std::atomic<size_t> m_Count = 0;
+			std::atomic<size_t> m_DeliveryCount = 0;
+
+		private:
+			static std::optional<kxf::String> QueryValue(ConfigObject& file, const kxf::String& section, const kxf::String& key);
+
+			bool IsInvokingOnThisThread() const noexcept;
+			void WaitForInvocations(std::unique_lock<std::mutex>& lock, uint64_t id = 0);
+
+		public:
+			SubscriptionManager() = default;
+			SubscriptionManager(const SubscriptionManager&) = delete;
+
+		public:
+			uint64_t Subscribe(ConfigObject& file, kxf::String section, kxf::String key, PPR_ChangeCallback callback, void* userData);
+			bool Unsubscribe(uint64_t id);
+
+			// Must be called without any file lock held and not from 'DllMain', the callbacks are called on the calling thread
+			size_t Deliver();
+
+			// Waits for the callbacks being called on the other threads, unless the process is terminating
+			void Stop();
+
+			size_t GetCount() const noexcept
+			{
+				return m_Count;
+			}
+			size_t GetDeliveryCount() const noexcept
+			{
+				return m_DeliveryCount;
+			}
+
+		public:
+			SubscriptionManager& operator=(const SubscriptionManager&) = delete;
+	};
+}
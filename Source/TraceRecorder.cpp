@@ -0,0 +1,164 @@
+#include "stdafx.h"
+#include "TraceRecorder.h"
+#include "ReaderBiasedLock.h"
+#include <format>
+
+namespace
+{
+	// There's only one recorder per process, so the buffer of the current thread can be cached without any key
+	thread_local void* g_ThreadBuffer = nullptr;
+
+	// A thread terminated at the process exit can still hold any of the locks, they're only tried then
+	std::unique_lock<std::mutex> LockBuffer(std::mutex& mutex)
+	{
+		if (PPR::ReaderBiasedLock::IsProcessTerminating())
+		{
+			return std::unique_lock(mutex, std::try_to_lock);
+		}
+		return std::unique_lock(mutex);
+	}
+}
+
+namespace PPR
+{
+	TraceRecorder::ThreadBuffer* TraceRecorder::GetThreadBuffer()
+	{
+		if (!g_ThreadBuffer)
+		{
+			auto lock = LockBuffer(m_BuffersLock);
+			if (!lock.owns_lock())
+			{
+				return nullptr;
+			}
+
+			auto buffer = std::make_unique<ThreadBuffer>();
+			buffer->ThreadID = ::GetCurrentThreadId();
+			buffer->Spans.reserve(256);
+			g_ThreadBuffer = m_Buffers.emplace_back(std::move(buffer)).get();
+		}
+		return static_cast<ThreadBuffer*>(g_ThreadBuffer);
+	}
+
+	TraceRecorder::TraceRecorder()
+	{
+		LARGE_INTEGER frequency = {};
+		if (::QueryPerformanceFrequency(&frequency) && frequency.QuadPart != 0)
+		{
+			m_Frequency = frequency.QuadPart;
+		}
+	}
+
+	void TraceRecorder::Record(const char* name, int64_t begin, int64_t end)
+	{
+		ThreadBuffer* buffer = GetThreadBuffer();
+		if (!buffer)
+		{
+			return;
+		}
+
+		auto lock = LockBuffer(buffer->Lock);
+		if (!lock.owns_lock())
+		{
+			return;
+		}
+
+		if (buffer->Spans.size() < MaxSpansPerThread)
+		{
+			buffer->Spans.emplace_back(Span{name, begin, end});
+		}
+		else
+		{
+			buffer->Dropped++;
+		}
+	}
+
+	void TraceRecorder::WriteJSON(kxf::IOutputStream& stream) const
+	{
+		const uint32_t processID = ::GetCurrentProcessId();
+		auto ToMicroseconds = [&](int64_t ticks)
+		{
+			return static_cast<double>(ticks) * 1000000.0 / static_cast<double>(m_Frequency);
+		};
+
+		// The trace is written at exit, so it's formatted into a small buffer which is flushed whenever it fills up
+		constexpr size_t chunkSize = 64 * 1024;
+		std::string chunk;
+		chunk.reserve(chunkSize + 512);
+		auto Flush = [&]()
+		{
+			stream.Write(chunk.data(), chunk.size());
+			chunk.clear();
+		};
+
+		// Complete events ('X') with the timestamps on the QPC clock, so they line up with the other traces taken from the same machine
+		chunk += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool isFirst = true;
+
+		if (auto lock = LockBuffer(m_BuffersLock); lock.owns_lock())
+		{
+			for (const auto& buffer: m_Buffers)
+			{
+				auto bufferLock = LockBuffer(buffer->Lock);
+				if (!bufferLock.owns_lock())
+				{
+					continue;
+				}
+
+				for (const Span& span: buffer->Spans)
+				{
+					if (!isFirst)
+					{
+						chunk += ',';
+					}
+					isFirst = false;
+
+					std::format_to(std::back_inserter(chunk), "\n{{\"name\":\"{}\",\"cat\":\"PPR\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{}}}",
+								   span.Name,
+								   ToMicroseconds(span.Begin),
+								   ToMicroseconds(span.End - span.Begin),
+								   processID,
+								   buffer->ThreadID
+					);
+					if (chunk.size() >= chunkSize)
+					{
+						Flush();
+					}
+				}
+			}
+		}
+		chunk += "\n]}\n";
+		Flush();
+	}
+	size_t TraceRecorder::GetSpanCount() const
+	{
+		size_t count = 0;
+
+		if (auto lock = LockBuffer(m_BuffersLock); lock.owns_lock())
+		{
+			for (const auto& buffer: m_Buffers)
+			{
+				if (auto bufferLock = LockBuffer(buffer->Lock); bufferLock.owns_lock())
+				{
+					count += buffer->Spans.size();
+				}
+			}
+		}
+		return count;
+	}
+	size_t TraceRecorder::GetDroppedCount() const
+	{
+		size_t count = 0;
+
+		if (auto lock = LockBuffer(m_BuffersLock); lock.owns_lock())
+		{
+			for (const auto& buffer: m_Buffers)
+			{
+				if (auto bufferLock = LockBuffer(buffer->Lock); bufferLock.owns_lock())
+				{
+					count += buffer->Dropped;
+				}
+			}
+		}
+		return count;
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "stdafx.h"
+#include "CallerStatistics.h"
+#include <mutex>
+
+namespace PPR
+{
+	// Records the time spans of the redirector operations into per-thread buffers and writes them
+	// as a Chrome trace-event file which can be opened in 'chrome://tracing' or Perfetto UI.
+	class TraceRecorder final
+	{
+		public:
+			// 1.5 MB per thread, the spans past that are only counted
+			static constexpr size_t MaxSpansPerThread = 1 << 16;
+
+		private:
+			struct Span final
+			{
+				const char* Name = nullptr;
+				int64_t Begin = 0;
+				int64_t End = 0;
+			};
+			struct ThreadBuffer final
+			{
+				// Only contended while the trace is being written
+				std::mutex Lock;
+				uint32_t ThreadID = 0;
+				std::vector<Span> Spans;
+				size_t Dropped = 0;
+			};
+
+		private:
+			mutable std::mutex m_BuffersLock;
+			std::vector<std::unique_ptr<ThreadBuffer>> m_Buffers;
+			int64_t m_Frequency = 1;
+
+		private:
+			ThreadBuffer* GetThreadBuffer();
+
+		public:
+			TraceRecorder();
+			TraceRecorder(const TraceRecorder&) = delete;
+
+		public:
+			// The name must be a string literal or otherwise outlive the recorder
+			void Record(const char* name, int64_t begin, int64_t end);
+
+			// Writes the Chrome trace-event JSON in chunks. At the process termination the buffers locked by the terminated threads are skipped.
+			void WriteJSON(kxf::IOutputStream& stream) const;
+			size_t GetSpanCount() const;
+			size_t GetDroppedCount() const;
+
+		public:
+			TraceRecorder& operator=(const TraceRecorder&) = delete;
+	};
+}
+
+namespace PPR
+{
+	class TraceSpan final
+	{
+		private:
+			TraceRecorder* m_Recorder = nullptr;
+			const char* m_Name = nullptr;
+			int64_t m_Begin = 0;
+
+		public:
+			TraceSpan(TraceRecorder* recorder, const char* name) noexcept
+				:m_Recorder(recorder), m_Name(name)
+			{
+				if (m_Recorder)
+				{
+					m_Begin = CallerStatistics::GetTimestamp();
+				}
+			}
+			TraceSpan(const TraceSpan&) = delete;
+			~TraceSpan()
+			{
+				if (m_Recorder)
+				{
+					m_Recorder->Record(m_Name, m_Begin, CallerStatistics::GetTimestamp());
+				}
+			}
+
+		public:
+			TraceSpan& operator=(const TraceSpan&) = delete;
+	};
+}
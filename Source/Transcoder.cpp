@@ -0,0 +1,438 @@
+#include "stdafx.h"
+#include "Transcoder.h"
+#include <emmintrin.h>
+#include <bit>
+
+namespace
+{
+	constexpr uint32_t ReplacementCharacter = 0xFFFD;
+
+	bool IsSurrogate(uint32_t c) noexcept
+	{
+		return c >= 0xD800 && c <= 0xDFFF;
+	}
+	bool IsHighSurrogate(uint32_t c) noexcept
+	{
+		return c >= 0xD800 && c <= 0xDBFF;
+	}
+	bool IsLowSurrogate(uint32_t c) noexcept
+	{
+		return c >= 0xDC00 && c <= 0xDFFF;
+	}
+
+	template<class T>
+	T LoadUnit(const uint8_t* data, bool swap) noexcept
+	{
+		T value = 0;
+		std::memcpy(&value, data, sizeof(value));
+		return swap ? std::byteswap(value) : value;
+	}
+	template<class T>
+	uint8_t* StoreUnit(uint8_t* data, T value, bool swap) noexcept
+	{
+		value = swap ? std::byteswap(value) : value;
+		std::memcpy(data, &value, sizeof(value));
+		return data + sizeof(value);
+	}
+
+	wchar_t* StoreUTF16(wchar_t* out, uint32_t c) noexcept
+	{
+		if (c < 0x10000)
+		{
+			*out++ = static_cast<wchar_t>(c);
+		}
+		else
+		{
+			c -= 0x10000;
+			*out++ = static_cast<wchar_t>(0xD800 + (c >> 10));
+			*out++ = static_cast<wchar_t>(0xDC00 + (c & 0x3FF));
+		}
+		return out;
+	}
+	uint8_t* StoreUTF8(uint8_t* out, uint32_t c) noexcept
+	{
+		if (c < 0x80)
+		{
+			*out++ = static_cast<uint8_t>(c);
+		}
+		else if (c < 0x800)
+		{
+			*out++ = static_cast<uint8_t>(0xC0 | (c >> 6));
+			*out++ = static_cast<uint8_t>(0x80 | (c & 0x3F));
+		}
+		else if (c < 0x10000)
+		{
+			*out++ = static_cast<uint8_t>(0xE0 | (c >> 12));
+			*out++ = static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3F));
+			*out++ = static_cast<uint8_t>(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			*out++ = static_cast<uint8_t>(0xF0 | (c >> 18));
+			*out++ = static_cast<uint8_t>(0x80 | ((c >> 12) & 0x3F));
+			*out++ = static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3F));
+			*out++ = static_cast<uint8_t>(0x80 | (c & 0x3F));
+		}
+		return out;
+	}
+
+	void WarnIncompleteUnit(std::span<const uint8_t> data, size_t unitSize, const char* name)
+	{
+		if (const size_t trailingBytes = data.size() % unitSize; trailingBytes != 0)
+		{
+			kxf::Log::WarningCategory("Transcoder", "The {} text ends with an incomplete code unit, dropping {} trailing bytes", name, trailingBytes);
+		}
+	}
+
+	// Reads one code point from the wide text, pairing the surrogates. Unpaired ones become U+FFFD.
+	uint32_t ReadCodePoint(kxf::StringView text, size_t& i) noexcept
+	{
+		uint32_t c = text[i++];
+		if (IsHighSurrogate(c) && i < text.length() && IsLowSurrogate(text[i]))
+		{
+			return 0x10000 + ((c - 0xD800) << 10) + (text[i++] - 0xDC00);
+		}
+		return IsSurrogate(c) ? ReplacementCharacter : c;
+	}
+
+	// SSE2 helpers
+	__m128i Load128(const void* data) noexcept
+	{
+		return _mm_loadu_si128(static_cast<const __m128i*>(data));
+	}
+	void Store128(void* data, __m128i value) noexcept
+	{
+		_mm_storeu_si128(static_cast<__m128i*>(data), value);
+	}
+	__m128i ByteSwap16(__m128i value) noexcept
+	{
+		return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+	}
+	__m128i ByteSwap32(__m128i value) noexcept
+	{
+		value = ByteSwap16(value);
+		return _mm_shufflehi_epi16(_mm_shufflelo_epi16(value, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+	}
+	bool HasSurrogates16(__m128i value) noexcept
+	{
+		const __m128i masked = _mm_and_si128(value, _mm_set1_epi16(static_cast<short>(0xF800)));
+		return _mm_movemask_epi8(_mm_cmpeq_epi16(masked, _mm_set1_epi16(static_cast<short>(0xD800)))) != 0;
+	}
+	__m128i Pack32To16(__m128i low, __m128i high) noexcept
+	{
+		// SSE2 only has the signed saturating pack, the values are biased into its range and back
+		const __m128i bias32 = _mm_set1_epi32(0x8000);
+		const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(low, bias32), _mm_sub_epi32(high, bias32));
+		return _mm_add_epi16(packed, _mm_set1_epi16(static_cast<short>(0x8000)));
+	}
+}
+
+namespace
+{
+	bool DecodeUTF8(std::span<const uint8_t> data, std::wstring& text)
+	{
+		// Every byte produces at most one UTF-16 code unit
+		const size_t size = data.size();
+		text.resize(size);
+		wchar_t* out = text.data();
+
+		size_t i = 0;
+		while (i < size)
+		{
+			for (; i + 16 <= size; i += 16, out += 16)
+			{
+				const __m128i bytes = Load128(data.data() + i);
+				if (_mm_movemask_epi8(bytes) != 0)
+				{
+					break;
+				}
+
+				const __m128i zero = _mm_setzero_si128();
+				Store128(out, _mm_unpacklo_epi8(bytes, zero));
+				Store128(out + 8, _mm_unpackhi_epi8(bytes, zero));
+			}
+
+			// The block with non-ASCII bytes, a sequence can run past its end
+			const size_t blockEnd = std::min(i + 16, size);
+			while (i < blockEnd)
+			{
+				const uint8_t lead = data[i];
+				if (lead < 0x80)
+				{
+					*out++ = lead;
+					i++;
+					continue;
+				}
+
+				uint32_t c = 0;
+				size_t length = 0;
+				if (lead >= 0xC2 && lead <= 0xDF)
+				{
+					c = lead & 0x1F;
+					length = 2;
+				}
+				else if (lead >= 0xE0 && lead <= 0xEF)
+				{
+					c = lead & 0x0F;
+					length = 3;
+				}
+				else if (lead >= 0xF0 && lead <= 0xF4)
+				{
+					c = lead & 0x07;
+					length = 4;
+				}
+				else
+				{
+					return false;
+				}
+
+				if (length > size - i)
+				{
+					return false;
+				}
+				for (size_t j = 1; j < length; j++)
+				{
+					const uint8_t next = data[i + j];
+					if ((next & 0xC0) != 0x80)
+					{
+						return false;
+					}
+					c = (c << 6) | (next & 0x3F);
+				}
+
+				// Overlong forms, encoded surrogates and values past U+10FFFF
+				if ((length == 3 && (c < 0x800 || IsSurrogate(c))) || (length == 4 && (c < 0x10000 || c > 0x10FFFF)))
+				{
+					return false;
+				}
+
+				out = StoreUTF16(out, c);
+				i += length;
+			}
+		}
+
+		text.resize(out - text.data());
+		return true;
+	}
+
+	bool DecodeUTF16(std::span<const uint8_t> data, bool swap, std::wstring& text)
+	{
+		WarnIncompleteUnit(data, sizeof(uint16_t), swap ? "UTF-16BE" : "UTF-16LE");
+		const size_t count = data.size() / sizeof(uint16_t);
+		text.resize(count);
+		wchar_t* out = text.data();
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i units = Load128(data.data() + i * sizeof(uint16_t));
+			Store128(out + i, swap ? ByteSwap16(units) : units);
+		}
+		for (; i < count; i++)
+		{
+			out[i] = LoadUnit<uint16_t>(data.data() + i * sizeof(uint16_t), swap);
+		}
+		return true;
+	}
+
+	bool DecodeUTF32(std::span<const uint8_t> data, bool swap, std::wstring& text)
+	{
+		// Code points outside of the BMP take two code units
+		WarnIncompleteUnit(data, sizeof(uint32_t), swap ? "UTF-32BE" : "UTF-32LE");
+		const size_t count = data.size() / sizeof(uint32_t);
+		text.resize(count * 2);
+		wchar_t* out = text.data();
+
+		size_t i = 0;
+		while (i < count)
+		{
+			for (; i + 8 <= count; i += 8, out += 8)
+			{
+				__m128i low = Load128(data.data() + i * sizeof(uint32_t));
+				__m128i high = Load128(data.data() + (i + 4) * sizeof(uint32_t));
+				if (swap)
+				{
+					low = ByteSwap32(low);
+					high = ByteSwap32(high);
+				}
+
+				// BMP characters other than the surrogates only
+				const __m128i upperHalves = _mm_or_si128(_mm_srli_epi32(low, 16), _mm_srli_epi32(high, 16));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(upperHalves, _mm_setzero_si128())) != 0xFFFF)
+				{
+					break;
+				}
+
+				const __m128i units = Pack32To16(low, high);
+				if (HasSurrogates16(units))
+				{
+					break;
+				}
+				Store128(out, units);
+			}
+
+			const size_t blockEnd = std::min(i + 8, count);
+			for (; i < blockEnd; i++)
+			{
+				const uint32_t c = LoadUnit<uint32_t>(data.data() + i * sizeof(uint32_t), swap);
+				if (c > 0x10FFFF || IsSurrogate(c))
+				{
+					return false;
+				}
+				out = StoreUTF16(out, c);
+			}
+		}
+
+		text.resize(out - text.data());
+		return true;
+	}
+
+	void EncodeUTF8(kxf::StringView text, std::vector<uint8_t>& data)
+	{
+		// A code unit takes at most three bytes, a surrogate pair takes four
+		const size_t count = text.length();
+		const size_t offset = data.size();
+		data.resize(offset + count * 3);
+		uint8_t* out = data.data() + offset;
+
+		size_t i = 0;
+		while (i < count)
+		{
+			for (; i + 16 <= count; i += 16, out += 16)
+			{
+				const __m128i low = Load128(text.data() + i);
+				const __m128i high = Load128(text.data() + i + 8);
+
+				const __m128i nonASCII = _mm_and_si128(_mm_or_si128(low, high), _mm_set1_epi16(static_cast<short>(0xFF80)));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonASCII, _mm_setzero_si128())) != 0xFFFF)
+				{
+					break;
+				}
+				Store128(out, _mm_packus_epi16(low, high));
+			}
+
+			const size_t blockEnd = std::min(i + 16, count);
+			while (i < blockEnd)
+			{
+				out = StoreUTF8(out, ReadCodePoint(text, i));
+			}
+		}
+
+		data.resize(out - data.data());
+	}
+
+	void EncodeUTF16(kxf::StringView text, bool swap, std::vector<uint8_t>& data)
+	{
+		const size_t count = text.length();
+		const size_t offset = data.size();
+		data.resize(offset + count * sizeof(uint16_t));
+		uint8_t* out = data.data() + offset;
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i units = Load128(text.data() + i);
+			Store128(out + i * sizeof(uint16_t), swap ? ByteSwap16(units) : units);
+		}
+		for (; i < count; i++)
+		{
+			StoreUnit<uint16_t>(out + i * sizeof(uint16_t), text[i], swap);
+		}
+	}
+
+	void EncodeUTF32(kxf::StringView text, bool swap, std::vector<uint8_t>& data)
+	{
+		const size_t count = text.length();
+		const size_t offset = data.size();
+		data.resize(offset + count * sizeof(uint32_t));
+		uint8_t* out = data.data() + offset;
+
+		size_t i = 0;
+		while (i < count)
+		{
+			for (; i + 8 <= count; i += 8, out += 8 * sizeof(uint32_t))
+			{
+				const __m128i units = Load128(text.data() + i);
+				if (HasSurrogates16(units))
+				{
+					break;
+				}
+
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i low = _mm_unpacklo_epi16(units, zero);
+				const __m128i high = _mm_unpackhi_epi16(units, zero);
+				Store128(out, swap ? ByteSwap32(low) : low);
+				Store128(out + 16, swap ? ByteSwap32(high) : high);
+			}
+
+			const size_t blockEnd = std::min(i + 8, count);
+			while (i < blockEnd)
+			{
+				out = StoreUnit<uint32_t>(out, ReadCodePoint(text, i), swap);
+			}
+		}
+
+		data.resize(out - data.data());
+	}
+}
+
+namespace PPR
+{
+	static_assert(sizeof(wchar_t) == sizeof(uint16_t));
+
+	bool Transcoder::Decode(std::span<const uint8_t> data, Format format, std::wstring& text)
+	{
+		switch (format)
+		{
+			case Format::UTF8:
+			{
+				return DecodeUTF8(data, text);
+			}
+			case Format::UTF16LE:
+			case Format::UTF16BE:
+			{
+				return DecodeUTF16(data, format == Format::UTF16BE, text);
+			}
+			case Format::UTF32LE:
+			case Format::UTF32BE:
+			{
+				return DecodeUTF32(data, format == Format::UTF32BE, text);
+			}
+		};
+		return false;
+	}
+	void Transcoder::Encode(kxf::StringView text, Format format, std::vector<uint8_t>& data)
+	{
+		switch (format)
+		{
+			case Format::UTF8:
+			{
+				EncodeUTF8(text, data);
+				break;
+			}
+			case Format::UTF16LE:
+			case Format::UTF16BE:
+			{
+				EncodeUTF16(text, format == Format::UTF16BE, data);
+				break;
+			}
+			case Format::UTF32LE:
+			case Format::UTF32BE:
+			{
+				EncodeUTF32(text, format == Format::UTF32BE, data);
+				break;
+			}
+		};
+	}
+
+	size_t Transcoder::GetChunkLength(kxf::StringView text, size_t maxLength) noexcept
+	{
+		if (text.length() <= maxLength)
+		{
+			return text.length();
+		}
+
+		// The high surrogate goes to the next chunk along with its pair
+		return maxLength > 1 && IsHighSurrogate(text[maxLength - 1]) ? maxLength - 1 : maxLength;
+	}
+}
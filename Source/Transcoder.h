@@ -0,0 +1,34 @@
+#pragma once
+#include "stdafx.h"
+
+namespace PPR
+{
+	// Converts the text of the files between their encodings and the UTF-16 the documents work with. The input is
+	// validated in the same pass it's converted in. SSE2 kernels take the runs of ASCII characters (UTF-8) and the runs
+	// without surrogates (UTF-16, UTF-32) 16 bytes at a time, byte-swapping the big-endian forms in the registers.
+	// Only the blocks which don't fit the fast path go through the scalar code.
+	class Transcoder final
+	{
+		public:
+			enum class Format
+			{
+				UTF8,
+				UTF16LE,
+				UTF16BE,
+				UTF32LE,
+				UTF32BE
+			};
+
+		public:
+			// Returns false if the input is malformed: invalid, overlong or truncated UTF-8 sequences, encoded surrogates
+			// and the UTF-32 values outside of the Unicode range. Unpaired UTF-16 surrogates are kept as they are, wide
+			// strings can hold them. An incomplete UTF-16 or UTF-32 code unit at the end is dropped with a warning.
+			static bool Decode(std::span<const uint8_t> data, Format format, std::wstring& text);
+
+			// Appends the encoded text to the buffer. Unpaired surrogates are written as U+FFFD to UTF-8 and UTF-32.
+			static void Encode(kxf::StringView text, Format format, std::vector<uint8_t>& data);
+
+			// Length of the next piece of the text to encode when it's encoded in chunks, a surrogate pair is never split
+			static size_t GetChunkLength(kxf::StringView text, size_t maxLength) noexcept;
+	};
+}
@@ -0,0 +1,72 @@
+#include "stdafx.h"
+#include "ValuePool.h"
+
+namespace PPR
+{
+	ValuePool& ValuePool::GetInstance() noexcept
+	{
+		static ValuePool instance;
+		return instance;
+	}
+
+	std::optional<IndexValue> ValuePool::Intern(std::string_view value, bool add)
+	{
+		if (value.length() > MaxLength)
+		{
+			return {};
+		}
+
+		if (kxf::ReadLockGuard lock(m_Lock); !m_Lookup.empty())
+		{
+			if (auto it = m_Lookup.find(value); it != m_Lookup.end())
+			{
+				return *it;
+			}
+		}
+
+		if (add)
+		{
+			kxf::WriteLockGuard lock(m_Lock);
+
+			// Someone could have added the same value while the lock was released
+			if (auto it = m_Lookup.find(value); it != m_Lookup.end())
+			{
+				return *it;
+			}
+			if (m_StoredBytes + value.length() + 1 <= MaxStoredBytes)
+			{
+				auto data = static_cast<char*>(m_Arena.allocate(value.length() + 1, alignof(char)));
+				std::copy_n(value.data(), value.length(), data);
+				data[value.length()] = 0;
+				m_StoredBytes += value.length() + 1;
+
+				return *m_Lookup.emplace(data, value.length()).first;
+			}
+		}
+		return {};
+	}
+	std::optional<IndexValue> ValuePool::Intern(kxf::StringView value, bool add)
+	{
+		if (value.length() > MaxLength || !IndexValue::IsASCII(value))
+		{
+			return {};
+		}
+
+		char buffer[MaxLength + 1] = {};
+		std::transform(value.begin(), value.end(), buffer, [](wchar_t c)
+		{
+			return static_cast<char>(c);
+		});
+		return Intern(std::string_view(buffer, value.length()), add);
+	}
+	ValuePool::Stats ValuePool::GetStats() const noexcept
+	{
+		kxf::ReadLockGuard lock(m_Lock);
+
+		Stats stats;
+		stats.Entries = m_Lookup.size();
+		stats.StoredBytes = m_StoredBytes;
+
+		return stats;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "stdafx.h"
+#include "IndexValue.h"
+#include <kxf/Threading/ReadWriteLock.h>
+#include <kxf/Threading/LockGuard.h>
+#include <unordered_set>
+#include <memory_resource>
+
+namespace PPR
+{
+	// Process-wide pool of the short ASCII values shared by the indexes of all the loaded files. Entries are immutable
+	// and never released, so the views returned by the pool stay valid for the lifetime of the process. The text
+	// is stored null-terminated in a monotonic arena, each entry takes exactly its length plus the terminator.
+	class ValuePool final
+	{
+		public:
+			// Values longer than that are stored in the index arenas as before
+			static constexpr size_t MaxLength = 31;
+
+			// The pool can't shrink, so it stops growing after that many bytes of text
+			static constexpr size_t MaxStoredBytes = 1024 * 1024;
+
+			struct Stats final
+			{
+				size_t Entries = 0;
+				size_t StoredBytes = 0;
+			};
+
+			static ValuePool& GetInstance() noexcept;
+			static size_t GetStorageSize(const IndexValue& value) noexcept
+			{
+				return (value.GetLength() + 1) * (value.IsASCII() ? sizeof(char) : sizeof(wchar_t));
+			}
+
+		private:
+			mutable kxf::ReadWriteLock m_Lock;
+			std::pmr::monotonic_buffer_resource m_Arena;
+			std::unordered_set<std::string_view> m_Lookup;
+			size_t m_StoredBytes = 0;
+
+		private:
+			ValuePool() = default;
+
+		public:
+			ValuePool(const ValuePool&) = delete;
+
+		public:
+			// Returns the pooled copy of the value, adding it if 'add' is true and the pool isn't full.
+			// Values which aren't ASCII-only are never pooled.
+			std::optional<IndexValue> Intern(std::string_view value, bool add);
+			std::optional<IndexValue> Intern(kxf::StringView value, bool add);
+
+			bool Contains(const IndexValue& value) const noexcept
+			{
+				if (value.IsASCII() && value.GetLength() <= MaxLength)
+				{
+					kxf::ReadLockGuard lock(m_Lock);
+					if (auto it = m_Lookup.find(value.GetASCII()); it != m_Lookup.end())
+					{
+						return it->data() == value.GetData();
+					}
+				}
+				return false;
+			}
+
+			Stats GetStats() const noexcept;
+
+		public:
+			ValuePool& operator=(const ValuePool&) = delete;
+	};
+}
@@ -24,7 +24,7 @@ bool xSE_PRELOADFUNCTION(const xSE_Interface* xSE)
 	{
 		xSE_LOG("Preloaded by xSE PluginPreloader");
 	}
-	PPR::Redirector::GetInstance().DllMain(nullptr, DLL_PROCESS_ATTACH);
+	PPR::Redirector::GetInstance().DllMain(nullptr, DLL_PROCESS_ATTACH, nullptr);
 
 	return true;
 }
@@ -226,6 +226,13 @@ namespace PPR
 			if (m_ConsoleCommandOverrider)
 			{
 				m_ConsoleCommandOverrider->OverrideCommand("RefreshINI", kxf::Format("[{}] Reloads INI files content from disk and calls the original 'RefreshINI' afterwards", kxf::StringViewOf(PPR::ProjectName)));
+
+				// There's no way to add a new command, so the caller statistics take over the one chosen in the config
+				const kxf::String& statisticsCommand = GetRedirector().GetCallerStatisticsCommand();
+				if (GetRedirector().GetCallerStatistics() && !statisticsCommand.IsEmpty() && statisticsCommand != "RefreshINI")
+				{
+					m_ConsoleCommandOverrider->OverrideCommand(statisticsCommand, kxf::Format("[{}] Prints the modules which spent the most time in the INI functions and calls the original '{}' afterwards", kxf::StringViewOf(PPR::ProjectName), statisticsCommand));
+				}
 			}
 		}
 	}
@@ -331,6 +338,14 @@ namespace PPR
 			const size_t reloadedCount = Redirector::GetInstance().RefreshINI();
 			PrintConsole("Executing '{}' done, {} files reloaded.", commandName, reloadedCount);
 		}
+		else if (auto statistics = Redirector::GetInstance().GetCallerStatistics(); statistics && commandName == Redirector::GetInstance().GetCallerStatisticsCommand())
+		{
+			PrintConsole("Caller statistics, top 10 modules:");
+			for (const kxf::String& line: statistics->GetReport(10, false))
+			{
+				PrintConsole("{}", line);
+			}
+		}
 		else
 		{
 			PrintConsole("Unknown command '{}'", commandName);
@@ -345,6 +360,7 @@ namespace PPR
 
 		xSE_LOG("Saving game: {}", saveFile);
 		GetRedirector().SaveChangedFiles(L"On game save");
+		GetRedirector().GetSubscriptions().Deliver();
 	}
 
 	// IEvtHandler
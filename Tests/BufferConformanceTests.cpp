@@ -0,0 +1,142 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include <format>
+
+// Output buffer handling of the reading functions: truncation, the double terminator of the lists and the smallest
+// buffer sizes. The buffers are filled with a marker first and only the part the function is allowed to write
+// (the result plus the terminators, within the buffer size) is recorded, the rest is unspecified.
+namespace
+{
+	using namespace PPR;
+
+	constexpr wchar_t Marker = 0xCCCC;
+	constexpr DWORD BufferSizes[] = {0, 1, 2, 3, 4, 5, 8, 64};
+
+	constexpr char BufferTestFile[] =
+		"[General]\r\n"
+		"sName=Hello\r\n"
+		"bb=2\r\n"
+		"ccc=3\r\n"
+		"[Display]\r\n"
+		"iSize=1080\r\n"
+		"[Audio]\r\n";
+
+	std::wstring Describe(const wchar_t* what, DWORD size, DWORD result, const std::vector<wchar_t>& buffer)
+	{
+		std::wstring text = std::format(L"{} nSize={}: result={} [", what, size, result);
+
+		const size_t length = std::min<size_t>(size, static_cast<size_t>(result) + 2);
+		for (size_t i = 0; i < length; i++)
+		{
+			text += std::format(L"{}{:04x}", i != 0 ? L" " : L"", static_cast<uint16_t>(buffer[i]));
+		}
+		return text + L"]";
+	}
+
+	template<class TFunc>
+	void RecordAllSizes(std::vector<std::wstring>& record, const wchar_t* what, TFunc&& func)
+	{
+		for (DWORD size: BufferSizes)
+		{
+			// Never zero-sized, the function gets a valid pointer even with 'nSize' of zero
+			std::vector<wchar_t> buffer(size + 8, Marker);
+			const DWORD result = std::invoke(func, buffer.data(), size);
+			record.push_back(Describe(what, size, result, buffer));
+		}
+	}
+}
+
+PPR_CONFORMANCE_TEST(GetPrivateProfileString_BufferSizes)
+{
+	Tests::TempFile file(BufferTestFile);
+	const wchar_t* path = file.GetPath().c_str();
+
+	RecordAllSizes(record, L"value", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileStringW(L"General", L"sName", L"", buffer, size, path);
+	});
+	RecordAllSizes(record, L"empty value", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileStringW(L"Audio", L"Missing", L"", buffer, size, path);
+	});
+	RecordAllSizes(record, L"default value", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileStringW(L"General", L"Missing", L"Default", buffer, size, path);
+	});
+}
+
+PPR_CONFORMANCE_TEST(GetPrivateProfileString_ListBufferSizes)
+{
+	Tests::TempFile file(BufferTestFile);
+	const wchar_t* path = file.GetPath().c_str();
+
+	RecordAllSizes(record, L"key names", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileStringW(L"General", nullptr, L"", buffer, size, path);
+	});
+	RecordAllSizes(record, L"key names of an empty section", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileStringW(L"Audio", nullptr, L"", buffer, size, path);
+	});
+	RecordAllSizes(record, L"section names", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileStringW(nullptr, nullptr, L"", buffer, size, path);
+	});
+}
+
+PPR_CONFORMANCE_TEST(GetPrivateProfileSectionNames_BufferSizes)
+{
+	Tests::TempFile file(BufferTestFile);
+	const wchar_t* path = file.GetPath().c_str();
+
+	RecordAllSizes(record, L"section names", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileSectionNamesW(buffer, size, path);
+	});
+}
+
+PPR_CONFORMANCE_TEST(GetPrivateProfileSection_BufferSizes)
+{
+	Tests::TempFile file(BufferTestFile);
+	const wchar_t* path = file.GetPath().c_str();
+
+	RecordAllSizes(record, L"section", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileSectionW(L"General", buffer, size, path);
+	});
+	RecordAllSizes(record, L"empty section", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileSectionW(L"Audio", buffer, size, path);
+	});
+	RecordAllSizes(record, L"missing section", [&](wchar_t* buffer, DWORD size)
+	{
+		return ::GetPrivateProfileSectionW(L"Missing", buffer, size, path);
+	});
+}
+
+PPR_PROFILE_BENCHMARK(GetPrivateProfileString_Read)
+{
+	Tests::TempFile file(BufferTestFile);
+	const wchar_t* path = file.GetPath().c_str();
+
+	// Games read short values into large buffers, the untouched part of the buffer shouldn't cost anything
+	std::vector<wchar_t> largeBuffer(32768);
+	wchar_t smallBuffer[64] = {};
+
+	Tests::Measure("Short value, 64 character buffer", 0, [&]()
+	{
+		Tests::Consume(::GetPrivateProfileStringW(L"General", L"sName", L"", smallBuffer, static_cast<DWORD>(std::size(smallBuffer)), path));
+	});
+	Tests::Measure("Short value, 32K character buffer", 0, [&]()
+	{
+		Tests::Consume(::GetPrivateProfileStringW(L"General", L"sName", L"", largeBuffer.data(), static_cast<DWORD>(largeBuffer.size()), path));
+	});
+	Tests::Measure("Key names, 32K character buffer", 0, [&]()
+	{
+		Tests::Consume(::GetPrivateProfileStringW(L"General", nullptr, L"", largeBuffer.data(), static_cast<DWORD>(largeBuffer.size()), path));
+	});
+	Tests::Measure("Section, 32K character buffer", 0, [&]()
+	{
+		Tests::Consume(::GetPrivateProfileSectionW(L"General", largeBuffer.data(), static_cast<DWORD>(largeBuffer.size()), path));
+	});
+}
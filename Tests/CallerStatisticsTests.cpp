@@ -0,0 +1,128 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "CallTracking.h"
+#include <kxf/Core/EncodingConverter/NativeEncodingConverter.h>
+#include <intrin.h>
+#include <thread>
+
+namespace
+{
+	using namespace PPR;
+
+	__declspec(noinline) DWORD ReadValue(const char* filePath)
+	{
+		Tests::Consume(filePath);
+		return 4;
+	}
+
+	size_t GetThreadCount()
+	{
+		return std::clamp<size_t>(std::thread::hardware_concurrency(), 2, 16);
+	}
+}
+
+PPR_TEST(CallerStatistics_MergesCallSites)
+{
+	kxf::NativeEncodingConverter converter(CP_ACP);
+	CallerStatistics statistics(converter);
+
+	// Different spellings of the same file from a few threads, each thread counts into its own stripe
+	const void* returnAddress = reinterpret_cast<const void*>(&ReadValue);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < 4; i++)
+	{
+		threads.emplace_back([&, i]()
+		{
+			if (i % 2 == 0)
+			{
+				statistics.Record(returnAddress, "C:\\Game\\Skyrim.ini", 10, 8);
+			}
+			else
+			{
+				statistics.Record(returnAddress, L"c:\\game\\SKYRIM.INI", 10, 8);
+			}
+		});
+	}
+	for (std::thread& thread: threads)
+	{
+		thread.join();
+	}
+	statistics.Record(returnAddress, static_cast<const wchar_t*>(nullptr), 10, 0);
+
+	// One module line with all the calls, one line for the file and one for the calls without a file
+	auto lines = statistics.GetReport();
+	PPR_CHECK_EQUAL(lines.size(), 3);
+	if (lines.size() == 3)
+	{
+		PPR_CHECK(lines[0].Contains("calls: 5,"));
+		PPR_CHECK(lines[0].Contains("bytes returned: 32"));
+	}
+
+	// Code outside of any module is grouped together
+	statistics.Record(reinterpret_cast<const void*>(0x10), "Other.ini", 1, 0);
+	lines = statistics.GetReport(0, false);
+	PPR_CHECK_EQUAL(lines.size(), 2);
+	if (lines.size() == 2)
+	{
+		PPR_CHECK(lines[1].Contains("<unknown>"));
+	}
+}
+
+PPR_BENCHMARK(CallerStatistics_TrackCall)
+{
+	// With the statistics off the tracking should cost nothing next to the direct call
+	kxf::NativeEncodingConverter converter(CP_ACP);
+	CallerStatistics statistics(converter);
+	const char* filePath = "C:\\Game\\Skyrim.ini";
+	size_t pathRequests = 0;
+
+	auto Call = [&](CallerStatistics* statistics)
+	{
+		return TrackCall(statistics, nullptr, "ReadValue", _ReturnAddress(), [&]()
+		{
+			pathRequests++;
+			return filePath;
+		}, [&]()
+		{
+			return ReadValue(filePath);
+		});
+	};
+
+	Tests::Measure("Direct call", 0, [&]()
+	{
+		Tests::Consume(ReadValue(filePath));
+	});
+	Tests::Measure("TrackCall, statistics off", 0, [&]()
+	{
+		Tests::Consume(Call(nullptr));
+	});
+	PPR_CHECK_EQUAL(pathRequests, 0);
+
+	Tests::Measure("TrackCall, statistics on, one thread", 0, [&]()
+	{
+		Tests::Consume(Call(&statistics));
+	});
+
+	// Every thread records the same call site, the stripes keep them from sharing a lock
+	constexpr size_t iterationCount = 100000;
+	const size_t threadCount = GetThreadCount();
+	const auto result = Tests::Measure("TrackCall, statistics on, all threads", 0, [&]()
+	{
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < threadCount; i++)
+		{
+			threads.emplace_back([&]()
+			{
+				for (size_t j = 0; j < iterationCount; j++)
+				{
+					statistics.Record(_ReturnAddress(), filePath, 1, 4);
+				}
+			});
+		}
+		for (std::thread& thread: threads)
+		{
+			thread.join();
+		}
+	});
+	std::printf("  %zu threads, %.2f ns per call\n", threadCount, result.NanosecondsPerCall / (iterationCount * threadCount));
+}
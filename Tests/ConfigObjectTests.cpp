@@ -0,0 +1,44 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "ConfigObject.h"
+
+PPR_TEST(ConfigObject_AbandonedSectionLockOnTermination)
+{
+	using namespace PPR;
+
+	// Nothing holds the locks, the file can be saved
+	ConfigObject config(kxf::FSPath(L"C:\\Game\\Game.ini"));
+	{
+		ReaderBiasedLock::WriteGuard lock(config.GetLock());
+		PPR_CHECK(!lock.IsAbandoned());
+		PPR_CHECK(!config.HasAbandonedSectionLock());
+	}
+
+	// A value writer terminated in the middle of its write, it held the file lock for reading and its section lock
+	FoldedName section(L"Display");
+	std::optional<ReaderBiasedLock::ReadGuard> fileLock;
+	std::optional<ReaderBiasedLock::WriteGuard> sectionLock;
+	fileLock.emplace(config.GetLock());
+	sectionLock.emplace(config.GetSectionLock(section));
+
+	ReaderBiasedLock::SetProcessTerminating();
+	{
+		ReaderBiasedLock::WriteGuard lock(config.GetLock());
+		PPR_CHECK(lock.IsAbandoned());
+	}
+
+	// The section lock alone is enough to tell
+	fileLock.reset();
+	{
+		ReaderBiasedLock::WriteGuard lock(config.GetLock());
+		PPR_CHECK(!lock.IsAbandoned());
+		PPR_CHECK(config.HasAbandonedSectionLock());
+	}
+
+	sectionLock.reset();
+	{
+		ReaderBiasedLock::WriteGuard lock(config.GetLock());
+		PPR_CHECK(!config.HasAbandonedSectionLock());
+	}
+	ReaderBiasedLock::SetProcessTerminating(false);
+}
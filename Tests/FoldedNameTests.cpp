@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "FoldedName.h"
+#include <format>
+#include <unordered_map>
+
+namespace
+{
+	// One character at a time, what the SSE2 loop of 'FoldedName::Fold' replaced for the ASCII names
+	void FoldScalar(const wchar_t* source, wchar_t* destination, size_t length) noexcept
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			const wchar_t c = source[i];
+			destination[i] = c >= L'a' && c <= L'z' ? c - 0x20 : c;
+		}
+	}
+}
+
+PPR_TEST(FoldedName_FoldsNonASCII)
+{
+	using namespace PPR;
+
+	auto IsSameName = [](const wchar_t* left, const wchar_t* right)
+	{
+		FoldedName leftName(left);
+		FoldedName rightName(right);
+		return FoldedName::IsSame(leftName.GetFolded(), rightName.GetFolded()) && leftName.GetHash() == rightName.GetHash();
+	};
+
+	PPR_CHECK(IsSameName(L"sLanguage", L"SLANGUAGE"));
+	PPR_CHECK(IsSameName(L"\x00E4nderung", L"\x00C4NDERUNG"));
+	PPR_CHECK(IsSameName(L"\x043A\x043B\x044E\x0447", L"\x041A\x041B\x042E\x0427"));
+
+	// The non-ASCII character in the middle of the second block and in the scalar tail
+	PPR_CHECK(IsSameName(L"fSettingVal\x00E9ue", L"FSETTINGVAL\x00C9UE"));
+	PPR_CHECK(IsSameName(L"fSettingValue\x00E9", L"FSETTINGVALUE\x00C9"));
+	PPR_CHECK(!IsSameName(L"fSettingValue\x00E9", L"FSETTINGVALUEE"));
+
+	// A surrogate pair is kept as is
+	FoldedName emoji(L"key\U0001F600");
+	PPR_CHECK(emoji.GetFolded() == L"KEY\U0001F600");
+}
+
+PPR_BENCHMARK(FoldedName_Lookup)
+{
+	using namespace PPR;
+
+	// Thousands of keys of the usual shape, looked up by names in a different case than the file has them
+	constexpr size_t keyCount = 4096;
+	const wchar_t* prefixes[] = {L"fSettingValue", L"bEnableFeature", L"iMaxCount", L"sDisplayName", L"uGridsToLoad", L"fLODFadeOutMultActors"};
+
+	std::vector<std::wstring> keys;
+	std::vector<std::wstring> lookupKeys;
+	std::unordered_map<std::wstring, size_t, FoldedName::Hash, FoldedName::Equal> index;
+	size_t characterCount = 0;
+	for (size_t i = 0; i < keyCount; i++)
+	{
+		std::wstring& key = keys.emplace_back(std::format(L"{}{}", prefixes[i % std::size(prefixes)], i));
+		index.emplace(FoldedName(kxf::StringView(key.data(), key.size())).GetFolded(), i);
+
+		// Flip the case of every third letter
+		std::wstring& lookupKey = lookupKeys.emplace_back(key);
+		for (size_t j = i % 3; j < lookupKey.size(); j += 3)
+		{
+			if (lookupKey[j] >= L'a' && lookupKey[j] <= L'z')
+			{
+				lookupKey[j] -= 0x20;
+			}
+			else if (lookupKey[j] >= L'A' && lookupKey[j] <= L'Z')
+			{
+				lookupKey[j] += 0x20;
+			}
+		}
+		characterCount += key.size();
+	}
+
+	const auto sse2 = Tests::Measure(std::format("SSE2 fold, hash and lookup, {} keys", keyCount), characterCount * sizeof(wchar_t), [&]()
+	{
+		for (const std::wstring& key: lookupKeys)
+		{
+			FoldedName name(kxf::StringView(key.data(), key.size()));
+			Tests::Consume(index.find(name.GetFolded()));
+		}
+	});
+	const auto scalar = Tests::Measure(std::format("Scalar fold, hash and lookup, {} keys", keyCount), characterCount * sizeof(wchar_t), [&]()
+	{
+		wchar_t buffer[FoldedName::InlineCapacity];
+		for (const std::wstring& key: lookupKeys)
+		{
+			FoldScalar(key.data(), buffer, key.size());
+			Tests::Consume(index.find(kxf::StringView(buffer, key.size())));
+		}
+	});
+	std::printf("  %.1f ns per lookup, scalar %.1f ns, %.2fx faster\n", sse2.NanosecondsPerCall / keyCount, scalar.NanosecondsPerCall / keyCount, scalar.NanosecondsPerCall / sse2.NanosecondsPerCall);
+
+	// The fold alone, without the hash and the lookup
+	std::vector<wchar_t> buffer(characterCount);
+	const auto sse2Fold = Tests::Measure("SSE2 fold only", characterCount * sizeof(wchar_t), [&]()
+	{
+		wchar_t* destination = buffer.data();
+		for (const std::wstring& key: lookupKeys)
+		{
+			FoldedName::Fold(key.data(), destination, key.size());
+			destination += key.size();
+		}
+		Tests::Consume(buffer);
+	});
+	const auto scalarFold = Tests::Measure("Scalar fold only", characterCount * sizeof(wchar_t), [&]()
+	{
+		wchar_t* destination = buffer.data();
+		for (const std::wstring& key: lookupKeys)
+		{
+			FoldScalar(key.data(), destination, key.size());
+			destination += key.size();
+		}
+		Tests::Consume(buffer);
+	});
+	std::printf("  fold only is %.2fx faster\n", scalarFold.NanosecondsPerCall / sse2Fold.NanosecondsPerCall);
+}
@@ -0,0 +1,488 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "INIWrapper.h"
+#include <kxf/Core/EncodingConverter/NativeEncodingConverter.h>
+#include <deque>
+
+namespace
+{
+	using namespace PPR;
+
+	kxf::FlagSet<kxf::INIDocumentOption> GetLoadOptions()
+	{
+		kxf::FlagSet<kxf::INIDocumentOption> options;
+		options.Add(kxf::INIDocumentOption::Quotes);
+		options.Add(kxf::INIDocumentOption::IgnoreCase);
+		return options;
+	}
+
+	// Typical game configuration shape: a few dozen sections with a few dozen short keys each
+	std::string GenerateINI(size_t sectionCount, size_t keyCount, std::string_view valueSuffix = {})
+	{
+		std::string text;
+		for (size_t i = 0; i < sectionCount; i++)
+		{
+			text += std::format("[Section{}]\r\n", i);
+			for (size_t j = 0; j < keyCount; j++)
+			{
+				text += std::format("fSettingValue{}={}.{}{}\r\n", j, i, j, valueSuffix);
+			}
+		}
+		return text;
+	}
+
+	bool BuildPerfectHash(INIWrapper& ini)
+	{
+		const size_t indexVersion = ini.GetIndexVersion();
+		auto perfectHash = ini.CreatePerfectHash([](size_t)
+		{
+			return 0;
+		});
+		return perfectHash->Build() && ini.SetPerfectHash(std::move(perfectHash), indexVersion);
+	}
+}
+
+PPR_TEST(INIWrapper_SetValueCreatesSection)
+{
+	Tests::TempFile file("[General]\r\nsName=Value\r\n");
+
+	INIWrapper ini;
+	PPR_CHECK(ini.Load(kxf::String(file.GetPath()), GetLoadOptions()));
+	PPR_CHECK(ini.HasSection(FoldedName(L"general")));
+	PPR_CHECK(!ini.HasSection(FoldedName(L"Display")));
+
+	bool sameData = true;
+	PPR_CHECK(ini.SetValue(FoldedName(L"Display"), FoldedName(L"iSize H"), L"1080", &sameData));
+	PPR_CHECK(!sameData);
+	PPR_CHECK(ini.HasSection(FoldedName(L"Display")));
+	PPR_CHECK(ini.GetValue(FoldedName(L"DISPLAY"), FoldedName(L"isize h")) == L"1080");
+
+	// Writing the same data again doesn't touch the document
+	PPR_CHECK(ini.SetValue(FoldedName(L"Display"), FoldedName(L"iSize H"), L"1080", &sameData));
+	PPR_CHECK(sameData);
+
+	auto sections = ini.GetSectionNames();
+	PPR_CHECK_EQUAL(sections.size(), 2);
+}
+
+PPR_TEST(INIWrapper_InternedBytesFollowWrites)
+{
+	Tests::TempFile file("[General]\r\nsName=Value\r\niSize=1\r\n");
+
+	INIWrapper ini;
+	PPR_CHECK(ini.Load(kxf::String(file.GetPath()), GetLoadOptions()));
+	PPR_CHECK_EQUAL(ini.GetMemoryStats().InternedBytes, 8);
+
+	// A value too long for the pool replaces the pooled one
+	PPR_CHECK(ini.SetValue(FoldedName(L"General"), FoldedName(L"sName"), L"A value longer than the pooled values can be"));
+	PPR_CHECK_EQUAL(ini.GetMemoryStats().InternedBytes, 2);
+	PPR_CHECK(ini.GetValue(FoldedName(L"General"), FoldedName(L"sName")) == L"A value longer than the pooled values can be");
+
+	PPR_CHECK(ini.DeleteKey(FoldedName(L"General"), FoldedName(L"iSize")));
+	PPR_CHECK_EQUAL(ini.GetMemoryStats().InternedBytes, 0);
+}
+
+PPR_TEST(INIWrapper_PerfectHashFollowsWrites)
+{
+	Tests::TempFile file(GenerateINI(4, 8));
+
+	INIWrapper ini;
+	PPR_CHECK(ini.Load(kxf::String(file.GetPath()), GetLoadOptions()));
+	PPR_CHECK(BuildPerfectHash(ini));
+	PPR_CHECK(ini.GetValue(FoldedName(L"section1"), FoldedName(L"FSETTINGVALUE2")) == L"1.2");
+	PPR_CHECK(!ini.FindValue(FoldedName(L"Section1"), FoldedName(L"Missing")));
+
+	// Overwritten, removed and written again, and added after the table was built
+	PPR_CHECK(ini.SetValue(FoldedName(L"Section1"), FoldedName(L"fSettingValue2"), L"Changed"));
+	PPR_CHECK(ini.GetValue(FoldedName(L"Section1"), FoldedName(L"fSettingValue2")) == L"Changed");
+
+	PPR_CHECK(ini.DeleteKey(FoldedName(L"Section1"), FoldedName(L"fSettingValue3")));
+	PPR_CHECK(!ini.FindValue(FoldedName(L"Section1"), FoldedName(L"fSettingValue3")));
+	PPR_CHECK(ini.SetValue(FoldedName(L"Section1"), FoldedName(L"fSettingValue3"), L"Again"));
+	PPR_CHECK(ini.GetValue(FoldedName(L"Section1"), FoldedName(L"fSettingValue3")) == L"Again");
+
+	PPR_CHECK(ini.SetValue(FoldedName(L"Section2"), FoldedName(L"sNew"), L"New"));
+	PPR_CHECK(ini.GetValue(FoldedName(L"Section2"), FoldedName(L"sNew")) == L"New");
+}
+
+PPR_BENCHMARK(INIWrapper_PerfectHash)
+{
+	// What the table buys for the hits and the misses and what it costs in memory on top of the index
+	constexpr size_t sectionCount = 64;
+	constexpr size_t keyCount = 48;
+	Tests::TempFile file(GenerateINI(sectionCount, keyCount));
+
+	INIWrapper ini;
+	ini.Load(kxf::String(file.GetPath()), GetLoadOptions());
+
+	std::vector<std::pair<kxf::String, kxf::String>> rawNames;
+	for (size_t i = 0; i < sectionCount; i++)
+	{
+		for (size_t j = 0; j < keyCount; j += 7)
+		{
+			rawNames.emplace_back(kxf::Format("Section{}", (i * 13) % sectionCount), kxf::Format("fSettingValue{}", j));
+			rawNames.emplace_back(kxf::Format("Section{}", i), kxf::Format("fMissingValue{}", j));
+		}
+	}
+
+	std::deque<FoldedName> hits;
+	std::deque<FoldedName> misses;
+	for (size_t i = 0; i < rawNames.size(); i++)
+	{
+		std::deque<FoldedName>& names = i % 2 == 0 ? hits : misses;
+		names.emplace_back(rawNames[i].first);
+		names.emplace_back(rawNames[i].second);
+	}
+
+	auto MeasureLookups = [&](std::string_view name, const std::deque<FoldedName>& names)
+	{
+		return Tests::Measure(name, 0, [&]()
+		{
+			for (size_t i = 0; i < names.size(); i += 2)
+			{
+				Tests::Consume(ini.FindValue(names[i], names[i + 1]));
+			}
+		});
+	};
+
+	const auto indexHits = MeasureLookups("Index, hits", hits);
+	const auto indexMisses = MeasureLookups("Index, misses", misses);
+
+	PPR_CHECK(BuildPerfectHash(ini));
+	const size_t tableMemory = ini.GetPerfectHash() ? ini.GetPerfectHash()->GetMemorySize() : 0;
+	const auto tableHits = MeasureLookups("Perfect hash, hits", hits);
+	const auto tableMisses = MeasureLookups("Perfect hash, misses", misses);
+
+	// A key added after the build makes the misses fall back to the index again
+	ini.SetValue(FoldedName(L"Section0"), FoldedName(L"sAdded"), L"1");
+	const auto staleMisses = MeasureLookups("Perfect hash with an added key, misses", misses);
+
+	std::printf("  %zu lookups per call, hits %.2fx, misses %.2fx (%.2fx with an added key), table %zu bytes\n",
+				hits.size() / 2,
+				indexHits.NanosecondsPerCall / tableHits.NanosecondsPerCall,
+				indexMisses.NanosecondsPerCall / tableMisses.NanosecondsPerCall,
+				indexMisses.NanosecondsPerCall / staleMisses.NanosecondsPerCall,
+				tableMemory
+	);
+}
+
+PPR_BENCHMARK(INIWrapper_IndexVersusDocument)
+{
+	// The index duplicates the values of the document, this shows what it buys for the reads and what it costs in memory
+	constexpr size_t sectionCount = 64;
+	constexpr size_t keyCount = 48;
+	const std::string text = GenerateINI(sectionCount, keyCount);
+	Tests::TempFile file(text);
+
+	INIWrapper ini;
+	Tests::Measure("INIWrapper::Load", text.size(), [&]()
+	{
+		ini.Load(kxf::String(file.GetPath()), GetLoadOptions());
+	});
+
+	kxf::INIDocument document;
+	document.SetOptions(GetLoadOptions());
+	Tests::Measure("kxf::INIDocument::Load", text.size(), [&]()
+	{
+		document.Load(std::span{reinterpret_cast<const char8_t*>(text.data()), text.size()});
+	});
+
+	// Same lookup order for both, names are folded once outside of the measured loop like the redirected functions do.
+	// Folded names only view the original ones and can't be moved, hence the deque.
+	std::vector<std::pair<kxf::String, kxf::String>> rawNames;
+	for (size_t i = 0; i < sectionCount; i++)
+	{
+		for (size_t j = 0; j < keyCount; j += 7)
+		{
+			rawNames.emplace_back(kxf::Format("Section{}", (i * 13) % sectionCount), kxf::Format("fSettingValue{}", j));
+		}
+	}
+
+	std::deque<FoldedName> names;
+	for (const auto& [section, key]: rawNames)
+	{
+		names.emplace_back(section);
+		names.emplace_back(key);
+	}
+
+	const auto index = Tests::Measure("Index lookup, all keys", 0, [&]()
+	{
+		for (size_t i = 0; i < names.size(); i += 2)
+		{
+			Tests::Consume(ini.FindValue(names[i], names[i + 1]));
+		}
+	});
+	const auto documentLookup = Tests::Measure("Document lookup, all keys", 0, [&]()
+	{
+		for (const auto& [section, key]: rawNames)
+		{
+			Tests::Consume(document.IniQueryValue(section, key));
+		}
+	});
+	std::printf("  %zu lookups per call, index is %.1fx faster\n", rawNames.size(), documentLookup.NanosecondsPerCall / index.NanosecondsPerCall);
+
+	const MemoryStats stats = ini.GetMemoryStats();
+	std::printf("  File %zu bytes, index %zu bytes, whole file estimate %zu bytes\n", text.size(), stats.AllocatedBytes, ini.GetMemoryUsage());
+}
+
+PPR_BENCHMARK(INIWrapper_ArenaAllocations)
+{
+	// Same maps as the index built, looked up and released with one heap allocation per node and with the nodes
+	// carved out of a monotonic arena, the way the index gets a fresh one on every load
+	constexpr size_t sectionCount = 64;
+	constexpr size_t keyCount = 48;
+	using ValueMap = std::pmr::unordered_map<std::pmr::wstring, std::pmr::wstring>;
+	using SectionMap = std::pmr::unordered_map<std::pmr::wstring, ValueMap>;
+
+	struct Entry final
+	{
+		std::pmr::wstring Section;
+		std::pmr::wstring Key;
+		std::pmr::wstring Value;
+	};
+	std::vector<Entry> entries;
+	for (size_t i = 0; i < sectionCount; i++)
+	{
+		for (size_t j = 0; j < keyCount; j++)
+		{
+			entries.emplace_back(Entry{std::pmr::wstring(std::format(L"Section{}", i)), std::pmr::wstring(std::format(L"fSettingValue{}", j)), std::pmr::wstring(std::format(L"Value of the setting {}.{}", i, j))});
+		}
+	}
+
+	auto Build = [&](SectionMap& sections)
+	{
+		for (const Entry& entry: entries)
+		{
+			sections[entry.Section][entry.Key] = entry.Value;
+		}
+	};
+	auto MeasureLookups = [&](std::string_view name, const SectionMap& sections)
+	{
+		return Tests::Measure(name, 0, [&]()
+		{
+			for (size_t i = 0; i < entries.size(); i += 7)
+			{
+				if (auto it = sections.find(entries[i].Section); it != sections.end())
+				{
+					Tests::Consume(it->second.find(entries[i].Key));
+				}
+			}
+		});
+	};
+
+	CountingMemoryResource heap;
+	const auto heapBuild = Tests::Measure("Heap nodes, build and release", 0, [&]()
+	{
+		SectionMap sections(&heap);
+		Build(sections);
+		Tests::Consume(sections);
+	});
+	const auto arenaBuild = Tests::Measure("Arena, build and release", 0, [&]()
+	{
+		std::pmr::monotonic_buffer_resource arena(4096, &heap);
+		SectionMap sections(&arena);
+		Build(sections);
+		Tests::Consume(sections);
+	});
+
+	// One more build of each to count what they take from the heap and to look up in
+	CountingMemoryResource heapNodes;
+	SectionMap heapSections(&heapNodes);
+	Build(heapSections);
+
+	CountingMemoryResource arenaBlocks;
+	std::pmr::monotonic_buffer_resource arena(4096, &arenaBlocks);
+	SectionMap arenaSections(&arena);
+	Build(arenaSections);
+
+	MeasureLookups("Heap nodes, lookup", heapSections);
+	MeasureLookups("Arena, lookup", arenaSections);
+
+	const MemoryStats heapStats = heapNodes.GetStats();
+	const MemoryStats arenaStats = arenaBlocks.GetStats();
+	std::printf("  %zu values, heap: %zu allocations (%zu bytes), arena: %zu blocks (%zu bytes), build and release %.2fx faster\n",
+				entries.size(),
+				heapStats.Allocations,
+				heapStats.AllocatedBytes,
+				arenaStats.Allocations,
+				arenaStats.AllocatedBytes,
+				heapBuild.NanosecondsPerCall / arenaBuild.NanosecondsPerCall
+	);
+
+	// What the index of a loaded file reports
+	Tests::TempFile file(GenerateINI(sectionCount, keyCount));
+	INIWrapper ini;
+	ini.Load(kxf::String(file.GetPath()), GetLoadOptions());
+
+	const MemoryStats stats = ini.GetMemoryStats();
+	std::printf("  INIWrapper index: %zu allocations in %zu blocks (%zu bytes)\n", stats.IndexAllocations, stats.Allocations, stats.AllocatedBytes);
+}
+
+PPR_BENCHMARK(INIWrapper_WriteBurst)
+{
+	// Closing a settings menu writes every setting back, about 500 writes of which most don't change anything.
+	// The index answers the same-data check with one probe, the document path has to query the value first.
+	constexpr size_t sectionCount = 16;
+	constexpr size_t keyCount = 32;
+	const std::string text = GenerateINI(sectionCount, keyCount);
+	Tests::TempFile file(text);
+
+	INIWrapper ini;
+	ini.Load(kxf::String(file.GetPath()), GetLoadOptions());
+
+	kxf::INIDocument document;
+	document.SetOptions(GetLoadOptions());
+	document.Load(std::span{reinterpret_cast<const char8_t*>(text.data()), text.size()});
+
+	struct Write final
+	{
+		kxf::String Section;
+		kxf::String Key;
+		kxf::String Value;
+		kxf::String ChangedValue;
+	};
+	std::vector<Write> writes;
+	for (size_t i = 0; i < sectionCount; i++)
+	{
+		for (size_t j = 0; j < keyCount; j++)
+		{
+			writes.emplace_back(Write{kxf::Format("Section{}", i), kxf::Format("fSettingValue{}", j), kxf::Format("{}.{}", i, j), kxf::Format("{}.{}5", i, j)});
+		}
+	}
+
+	std::deque<FoldedName> names;
+	for (const Write& write: writes)
+	{
+		names.emplace_back(write.Section);
+		names.emplace_back(write.Key);
+	}
+
+	// Every call of the changing burst writes the other value, so all of its writes change the data
+	auto WriteIndex = [&](bool changed, bool& toggle)
+	{
+		toggle = changed && !toggle;
+		for (size_t i = 0; i < writes.size(); i++)
+		{
+			Tests::Consume(ini.SetValue(names[i * 2], names[i * 2 + 1], toggle ? writes[i].ChangedValue : writes[i].Value));
+		}
+	};
+	auto WriteDocument = [&](bool changed, bool& toggle)
+	{
+		toggle = changed && !toggle;
+		for (const Write& write: writes)
+		{
+			const kxf::String& value = toggle ? write.ChangedValue : write.Value;
+			if (auto current = document.IniQueryValue(write.Section, write.Key); !current || *current != value)
+			{
+				Tests::Consume(document.IniSetValue(write.Section, write.Key, value));
+			}
+		}
+	};
+
+	bool indexToggle = false;
+	bool documentToggle = false;
+	const auto indexSame = Tests::Measure(std::format("Index, {} writes, same data", writes.size()), 0, [&]()
+	{
+		WriteIndex(false, indexToggle);
+	});
+	const auto documentSame = Tests::Measure(std::format("Document, {} writes, same data", writes.size()), 0, [&]()
+	{
+		WriteDocument(false, documentToggle);
+	});
+	const auto indexChanged = Tests::Measure(std::format("Index, {} writes, changed data", writes.size()), 0, [&]()
+	{
+		WriteIndex(true, indexToggle);
+	});
+	const auto documentChanged = Tests::Measure(std::format("Document, {} writes, changed data", writes.size()), 0, [&]()
+	{
+		WriteDocument(true, documentToggle);
+	});
+
+	std::printf("  index is %.1fx faster for the same data, %.2fx for the changed data (the index writes the document as well)\n",
+				documentSame.NanosecondsPerCall / indexSame.NanosecondsPerCall,
+				documentChanged.NanosecondsPerCall / indexChanged.NanosecondsPerCall
+	);
+}
+
+PPR_BENCHMARK(INIWrapper_ValueStorage)
+{
+	// The same file once with ASCII values, stored one byte per character and mostly pooled, and once with a non-ASCII
+	// character in every value, stored as wide characters. Both are read the way the 'A' and 'W' functions read them.
+	constexpr size_t sectionCount = 64;
+	constexpr size_t keyCount = 48;
+	kxf::NativeEncodingConverter converter(CP_ACP);
+
+	std::vector<std::pair<kxf::String, kxf::String>> rawNames;
+	for (size_t i = 0; i < sectionCount; i++)
+	{
+		for (size_t j = 0; j < keyCount; j++)
+		{
+			rawNames.emplace_back(kxf::Format("Section{}", i), kxf::Format("fSettingValue{}", j));
+		}
+	}
+	std::deque<FoldedName> names;
+	for (const auto& [section, key]: rawNames)
+	{
+		names.emplace_back(section);
+		names.emplace_back(key);
+	}
+
+	for (std::string_view valueSuffix: {"", " \xC3\xA9"})
+	{
+		const std::string kind = valueSuffix.empty() ? "ASCII" : "non-ASCII";
+		Tests::TempFile file(GenerateINI(sectionCount, keyCount, valueSuffix));
+
+		INIWrapper ini;
+		ini.Load(kxf::String(file.GetPath()), GetLoadOptions());
+
+		size_t valueCount = 0;
+		size_t storedBytes = 0;
+		size_t wideBytes = 0;
+		size_t pooledCount = 0;
+		for (size_t i = 0; i < names.size(); i += 2)
+		{
+			if (auto value = ini.FindValue(names[i], names[i + 1]))
+			{
+				valueCount++;
+				storedBytes += ValuePool::GetStorageSize(*value);
+				wideBytes += (value->GetLength() + 1) * sizeof(wchar_t);
+				pooledCount += ValuePool::GetInstance().Contains(*value) ? 1 : 0;
+			}
+		}
+
+		const MemoryStats stats = ini.GetMemoryStats();
+		std::printf("  %s values: %zu, %.2f bytes per value, %.2f as wide characters, %zu pooled, index %zu bytes\n",
+					kind.c_str(),
+					valueCount,
+					static_cast<double>(storedBytes) / valueCount,
+					static_cast<double>(wideBytes) / valueCount,
+					pooledCount,
+					stats.AllocatedBytes
+		);
+
+		std::string narrowBuffer;
+		const auto narrow = Tests::Measure(std::format("{} values, lookup for the 'A' functions", kind), 0, [&]()
+		{
+			for (size_t i = 0; i < names.size(); i += 2)
+			{
+				if (auto value = ini.FindValue(names[i], names[i + 1]))
+				{
+					Tests::Consume(value->GetView(narrowBuffer, converter));
+				}
+			}
+		});
+
+		std::wstring wideBuffer;
+		const auto wide = Tests::Measure(std::format("{} values, lookup for the 'W' functions", kind), 0, [&]()
+		{
+			for (size_t i = 0; i < names.size(); i += 2)
+			{
+				if (auto value = ini.FindValue(names[i], names[i + 1]))
+				{
+					Tests::Consume(value->GetView(wideBuffer));
+				}
+			}
+		});
+		std::printf("  %.1f ns per 'A' lookup, %.1f ns per 'W' lookup\n", narrow.NanosecondsPerCall / valueCount, wide.NanosecondsPerCall / valueCount);
+	}
+}
@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+//	PrivateProfileRedirector.Tests [--benchmarks] [--redirector <path to the DLL>] [name filter]
+//
+// Exits with the number of failed tests. The redirector DLL attaches its hooks when it's loaded, so the native
+// pass of the conformance tests runs before that and the DLL is never unloaded.
+
+namespace PPR::Tests
+{
+	namespace
+	{
+		size_t g_FailureCount = 0;
+		const char* g_CurrentTest = nullptr;
+		HMODULE g_RedirectorModule = nullptr;
+	}
+
+	std::vector<Registry::Entry>& Registry::GetEntries()
+	{
+		static std::vector<Entry> entries;
+		return entries;
+	}
+
+	HMODULE GetRedirectorModule() noexcept
+	{
+		return g_RedirectorModule;
+	}
+
+	void ReportFailure(const char* expression, const char* file, int line)
+	{
+		ReportFailure(std::string(expression), file, line);
+	}
+	void ReportFailure(const std::string& message, const char* file, int line)
+	{
+		std::printf("  FAILED %s: %s (%s:%d)\n", g_CurrentTest ? g_CurrentTest : "", message.c_str(), file, line);
+		g_FailureCount++;
+	}
+
+	TempFile::TempFile(std::string_view content)
+		:TempFile(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(content.data()), content.size()))
+	{
+	}
+	TempFile::TempFile(std::span<const uint8_t> content)
+	{
+		wchar_t directory[MAX_PATH] = {};
+		wchar_t path[MAX_PATH] = {};
+		::GetTempPathW(static_cast<DWORD>(std::size(directory)), directory);
+		::GetTempFileNameW(directory, L"PPR", 0, path);
+		m_Path = path;
+
+		std::ofstream stream(std::filesystem::path(m_Path), std::ios::binary|std::ios::trunc);
+		stream.write(reinterpret_cast<const char*>(content.data()), content.size());
+	}
+	TempFile::~TempFile()
+	{
+		::DeleteFileW(m_Path.c_str());
+	}
+
+	std::vector<uint8_t> TempFile::ReadBytes() const
+	{
+		std::ifstream stream(std::filesystem::path(m_Path), std::ios::binary);
+		return {std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+	}
+	std::string TempFile::ReadText() const
+	{
+		std::ifstream stream(std::filesystem::path(m_Path), std::ios::binary);
+		return {std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+	}
+
+	BenchmarkResult Measure(std::string_view name, size_t bytesPerCall, const std::function<void()>& func, std::chrono::milliseconds minTime)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		// Warm up the caches and the branch predictors first
+		func();
+
+		size_t calls = 0;
+		size_t batch = 1;
+		const auto start = Clock::now();
+		auto elapsed = Clock::duration::zero();
+		while (elapsed < minTime)
+		{
+			for (size_t i = 0; i < batch; i++)
+			{
+				func();
+			}
+			calls += batch;
+			batch *= 2;
+			elapsed = Clock::now() - start;
+		}
+
+		BenchmarkResult result;
+		const double nanoseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+		result.NanosecondsPerCall = nanoseconds / calls;
+		if (bytesPerCall != 0)
+		{
+			result.GigabytesPerSecond = (static_cast<double>(bytesPerCall) * calls) / nanoseconds;
+			std::printf("  %-48.*s %12.1f ns %8.2f GB/s\n", static_cast<int>(name.length()), name.data(), result.NanosecondsPerCall, result.GigabytesPerSecond);
+		}
+		else
+		{
+			std::printf("  %-48.*s %12.1f ns\n", static_cast<int>(name.length()), name.data(), result.NanosecondsPerCall);
+		}
+		return result;
+	}
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+	using namespace PPR::Tests;
+
+	bool runBenchmarks = false;
+	std::wstring redirectorPath;
+	std::string filter;
+	for (int i = 1; i < argc; i++)
+	{
+		std::wstring_view arg = argv[i];
+		if (arg == L"--benchmarks")
+		{
+			runBenchmarks = true;
+		}
+		else if (arg == L"--redirector" && i + 1 < argc)
+		{
+			redirectorPath = argv[++i];
+		}
+		else
+		{
+			filter.assign(arg.begin(), arg.end());
+		}
+	}
+
+	auto IsSelected = [&](const Registry::Entry& entry)
+	{
+		return filter.empty() || std::string_view(entry.Name).find(filter) != std::string_view::npos;
+	};
+
+	size_t testCount = 0;
+	for (const Registry::Entry& entry: Registry::GetEntries())
+	{
+		const bool isSelected = entry.Type == Registry::Kind::Test || (entry.Type == Registry::Kind::Benchmark && runBenchmarks);
+		if (isSelected && IsSelected(entry))
+		{
+			std::printf("%s %s\n", entry.Type == Registry::Kind::Test ? "[test]" : "[benchmark]", entry.Name);
+
+			g_CurrentTest = entry.Name;
+			entry.Run();
+			testCount++;
+		}
+	}
+
+	auto RunProfileBenchmarks = [&](const char* pass)
+	{
+		for (const Registry::Entry& entry: Registry::GetEntries())
+		{
+			if (runBenchmarks && entry.Type == Registry::Kind::ProfileBenchmark && IsSelected(entry))
+			{
+				std::printf("[benchmark, %s] %s\n", pass, entry.Name);
+
+				g_CurrentTest = entry.Name;
+				entry.Run();
+				testCount++;
+			}
+		}
+	};
+
+	// Native pass first, the hooks stay in place once the DLL is loaded
+	std::vector<std::pair<const Registry::Entry*, std::vector<std::wstring>>> nativeResults;
+	for (const Registry::Entry& entry: Registry::GetEntries())
+	{
+		if (entry.Type == Registry::Kind::Conformance && IsSelected(entry))
+		{
+			auto& [nativeEntry, record] = nativeResults.emplace_back(&entry, std::vector<std::wstring>{});
+			entry.Record(record);
+		}
+	}
+	RunProfileBenchmarks("native");
+
+	if (!nativeResults.empty() || runBenchmarks)
+	{
+		if (redirectorPath.empty())
+		{
+			std::printf("[conformance] skipped, no '--redirector' given\n");
+		}
+		else if (g_RedirectorModule = ::LoadLibraryW(redirectorPath.c_str()); !g_RedirectorModule)
+		{
+			std::printf("[conformance] can't load the redirector, error %lu\n", ::GetLastError());
+			g_FailureCount++;
+		}
+		else
+		{
+			for (const auto& [entry, nativeRecord]: nativeResults)
+			{
+				std::printf("[conformance] %s\n", entry->Name);
+				g_CurrentTest = entry->Name;
+
+				std::vector<std::wstring> redirectedRecord;
+				entry->Record(redirectedRecord);
+				testCount++;
+
+				const size_t count = std::max(nativeRecord.size(), redirectedRecord.size());
+				for (size_t i = 0; i < count; i++)
+				{
+					const std::wstring* native = i < nativeRecord.size() ? &nativeRecord[i] : nullptr;
+					const std::wstring* redirected = i < redirectedRecord.size() ? &redirectedRecord[i] : nullptr;
+					if (!native || !redirected || *native != *redirected)
+					{
+						std::printf("  FAILED %s: observation %zu differs\n", entry->Name, i);
+						std::wprintf(L"    native:     %s\n    redirected: %s\n", native ? native->c_str() : L"<none>", redirected ? redirected->c_str() : L"<none>");
+						g_FailureCount++;
+					}
+				}
+			}
+			RunProfileBenchmarks("redirected");
+		}
+	}
+
+	std::printf("%zu run, %zu failed\n", testCount, g_FailureCount);
+	return static_cast<int>(std::min<size_t>(g_FailureCount, 255));
+}
@@ -0,0 +1,197 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "OptimisticValueCache.h"
+#include "ReaderBiasedLock.h"
+#include <format>
+#include <thread>
+
+namespace
+{
+	using namespace PPR;
+
+	size_t GetReaderThreadCount()
+	{
+		return std::clamp<size_t>(std::thread::hardware_concurrency(), 2, 16);
+	}
+
+	// Runs the function on the given number of threads at once, each one gets its own index
+	template<class TFunc>
+	void RunOnThreads(size_t threadCount, TFunc&& func)
+	{
+		std::atomic<size_t> readyCount = 0;
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < threadCount; i++)
+		{
+			threads.emplace_back([&, i]()
+			{
+				readyCount++;
+				while (readyCount.load() != threadCount)
+				{
+					::YieldProcessor();
+				}
+				func(i);
+			});
+		}
+		for (std::thread& thread: threads)
+		{
+			thread.join();
+		}
+	}
+}
+
+PPR_TEST(OptimisticValueCache_AllocatedByFirstRead)
+{
+	using namespace PPR;
+
+	OptimisticValueCache cache;
+	OptimisticValueCache::Value value;
+	PPR_CHECK_EQUAL(cache.GetMemoryUsage(), 0);
+	PPR_CHECK(!cache.Load(1, L"SECTION", L"KEY", value));
+
+	// A writer has nothing to update yet
+	PPR_CHECK(!cache.Store(1, L"SECTION", L"KEY", L"Value", true));
+	cache.Invalidate(1);
+	cache.InvalidateAll();
+	PPR_CHECK_EQUAL(cache.GetMemoryUsage(), 0);
+
+	// The reader fill allocates it, the writers keep it up to date from then on
+	PPR_CHECK(cache.Store(1, L"SECTION", L"KEY", L"Value", false));
+	PPR_CHECK(cache.GetMemoryUsage() != 0);
+	PPR_CHECK(cache.Load(1, L"SECTION", L"KEY", value) && value.GetView() == L"Value");
+
+	PPR_CHECK(cache.Store(1, L"SECTION", L"KEY", L"Changed", true));
+	PPR_CHECK(cache.Load(1, L"SECTION", L"KEY", value) && value.GetView() == L"Changed");
+
+	cache.Invalidate(1);
+	PPR_CHECK(!cache.Load(1, L"SECTION", L"KEY", value));
+
+	// An evicted file frees it, the next reader fill allocates it again
+	cache.Free();
+	PPR_CHECK_EQUAL(cache.GetMemoryUsage(), 0);
+	PPR_CHECK(!cache.Store(1, L"SECTION", L"KEY", L"Value", true));
+	PPR_CHECK(cache.Store(1, L"SECTION", L"KEY", L"Value", false));
+	PPR_CHECK(cache.Load(1, L"SECTION", L"KEY", value) && value.GetView() == L"Value");
+}
+
+PPR_TEST(OptimisticValueCache_KeepsParsedValue)
+{
+	using namespace PPR;
+	using ParsedKind = OptimisticValueCache::ParsedKind;
+
+	OptimisticValueCache cache;
+	uint64_t parsed = 0;
+	PPR_CHECK(cache.Store(1, L"SECTION", L"FVALUE", L"1.5", false, ParsedKind::Float, 42));
+	PPR_CHECK(cache.Load(1, L"SECTION", L"FVALUE", ParsedKind::Float, parsed) && parsed == 42);
+	PPR_CHECK(!cache.Load(1, L"SECTION", L"FVALUE", ParsedKind::Integer, parsed));
+
+	// A string fill of the same text keeps the parsed value, a write of the same text as well
+	PPR_CHECK(cache.Store(1, L"SECTION", L"FVALUE", L"1.5", false));
+	PPR_CHECK(cache.Load(1, L"SECTION", L"FVALUE", ParsedKind::Float, parsed) && parsed == 42);
+	PPR_CHECK(cache.Store(1, L"SECTION", L"FVALUE", L"1.5", true));
+	PPR_CHECK(cache.Load(1, L"SECTION", L"FVALUE", ParsedKind::Float, parsed) && parsed == 42);
+
+	// Different text drops it
+	PPR_CHECK(cache.Store(1, L"SECTION", L"FVALUE", L"2.5", true));
+	PPR_CHECK(!cache.Load(1, L"SECTION", L"FVALUE", ParsedKind::Float, parsed));
+
+	OptimisticValueCache::Value value;
+	PPR_CHECK(cache.Load(1, L"SECTION", L"FVALUE", value) && value.GetView() == L"2.5");
+}
+
+PPR_BENCHMARK(OptimisticValueCache_ReadContention)
+{
+	// All threads read the same section while some of them write to it. The cached readers never take the section lock,
+	// the locked ones take it for reading the same way the uncached lookup does. The writers take it in both cases.
+	constexpr size_t keyCount = 32;
+	constexpr size_t iterationCount = 100000;
+	const size_t threadCount = GetReaderThreadCount();
+	const kxf::StringView section = L"DISPLAY";
+
+	std::vector<std::wstring> keys;
+	std::vector<OptimisticValueCache::Value> values[2];
+	for (size_t i = 0; i < keyCount; i++)
+	{
+		keys.push_back(std::format(L"IVALUE{}", i));
+		for (size_t j = 0; j < 2; j++)
+		{
+			const std::wstring text = std::format(L"{}", i * 1000 + j);
+			OptimisticValueCache::Value& value = values[j].emplace_back();
+			value.Length = text.copy(value.Data, std::size(value.Data));
+		}
+	}
+
+	for (size_t writeInterval: {0u, 100u, 10u})
+	{
+		const std::string writeRatio = writeInterval != 0 ? std::format("{}% writes", 100 / writeInterval) : "no writes";
+		auto IsWrite = [&](size_t index, size_t i)
+		{
+			return writeInterval != 0 && (i + index) % writeInterval == 0;
+		};
+
+		ReaderBiasedLock sectionLock;
+		std::vector<OptimisticValueCache::Value> lockedValues = values[0];
+		const auto locked = Tests::Measure(std::format("Section lock, {}", writeRatio), 0, [&]()
+		{
+			RunOnThreads(threadCount, [&](size_t index)
+			{
+				for (size_t i = 0; i < iterationCount; i++)
+				{
+					const size_t key = (i + index) % keyCount;
+					if (IsWrite(index, i))
+					{
+						ReaderBiasedLock::WriteGuard guard(sectionLock);
+						lockedValues[key] = values[i % 2][key];
+					}
+					else
+					{
+						ReaderBiasedLock::ReadGuard guard(sectionLock);
+						OptimisticValueCache::Value value = lockedValues[key];
+						Tests::Consume(value);
+					}
+				}
+			});
+		});
+
+		OptimisticValueCache cache;
+		for (size_t i = 0; i < keyCount; i++)
+		{
+			cache.Store(i, section, keys[i], values[0][i].GetView(), false);
+		}
+		std::atomic<size_t> missCount = 0;
+		const auto cached = Tests::Measure(std::format("Sequence counters, {}", writeRatio), 0, [&]()
+		{
+			missCount = 0;
+			RunOnThreads(threadCount, [&](size_t index)
+			{
+				for (size_t i = 0; i < iterationCount; i++)
+				{
+					const size_t key = (i + index) % keyCount;
+					if (IsWrite(index, i))
+					{
+						ReaderBiasedLock::WriteGuard guard(sectionLock);
+						cache.Store(key, section, keys[key], values[i % 2][key].GetView(), true);
+					}
+					else if (OptimisticValueCache::Value value; cache.Load(key, section, keys[key], value))
+					{
+						Tests::Consume(value);
+					}
+					else
+					{
+						// A slot kept busy by the writers, the real reader goes the locked path then
+						ReaderBiasedLock::ReadGuard guard(sectionLock);
+						missCount.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+			});
+		});
+
+		const double operationCount = static_cast<double>(iterationCount * threadCount);
+		std::printf("  %zu threads, %.2f ns per operation, section lock %.2f ns, %.2fx faster, %.3f%% of the reads missed\n",
+					threadCount,
+					cached.NanosecondsPerCall / operationCount,
+					locked.NanosecondsPerCall / operationCount,
+					locked.NanosecondsPerCall / cached.NanosecondsPerCall,
+					missCount.load() * 100.0 / operationCount
+		);
+	}
+}
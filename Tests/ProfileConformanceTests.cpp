@@ -0,0 +1,210 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+
+// Both passes see the same calls, these tests record what the functions return and 'Main.cpp' compares the records.
+// A file written in the redirected pass is never read from the disk, the record has to come from the functions.
+namespace
+{
+	using namespace PPR;
+
+	// 'a\0b\0\0' -> 'a|b'
+	std::wstring JoinList(const wchar_t* buffer, size_t length)
+	{
+		std::wstring result;
+		for (size_t i = 0; i < length && buffer[i]; i += std::wcslen(buffer + i) + 1)
+		{
+			if (!result.empty())
+			{
+				result += L'|';
+			}
+			result += buffer + i;
+		}
+		return result;
+	}
+
+	std::wstring ReadSectionNames(const std::wstring& path)
+	{
+		wchar_t buffer[4096] = {};
+		DWORD length = ::GetPrivateProfileSectionNamesW(buffer, static_cast<DWORD>(std::size(buffer)), path.c_str());
+		return L"sections: " + JoinList(buffer, length);
+	}
+	std::wstring ReadKeyNames(const wchar_t* section, const std::wstring& path)
+	{
+		wchar_t buffer[4096] = {};
+		DWORD length = ::GetPrivateProfileStringW(section, nullptr, nullptr, buffer, static_cast<DWORD>(std::size(buffer)), path.c_str());
+		return std::wstring(L"keys of ") + section + L": " + JoinList(buffer, length);
+	}
+	std::wstring ReadValue(const wchar_t* section, const wchar_t* key, const std::wstring& path)
+	{
+		wchar_t buffer[256] = {};
+		DWORD length = ::GetPrivateProfileStringW(section, key, L"<default>", buffer, static_cast<DWORD>(std::size(buffer)), path.c_str());
+		return std::wstring(section) + L"/" + key + L" = '" + std::wstring(buffer, length) + L"'";
+	}
+	std::string ToANSI(const std::wstring& text)
+	{
+		std::string result(text.length() * 2 + 1, '\0');
+		const int length = ::WideCharToMultiByte(CP_ACP, 0, text.c_str(), static_cast<int>(text.length()), result.data(), static_cast<int>(result.size()), nullptr, nullptr);
+		result.resize(std::max(length, 0));
+		return result;
+	}
+	std::wstring ToString(BOOL result)
+	{
+		return result ? L"TRUE" : L"FALSE";
+	}
+
+	// Reads the struct into a buffer filled with a marker, only a successful read is required to write into it
+	std::wstring ReadStruct(const wchar_t* section, const wchar_t* key, UINT size, const std::wstring& path)
+	{
+		std::vector<uint8_t> buffer(size + 4, 0xCC);
+		const BOOL result = ::GetPrivateProfileStructW(section, key, buffer.data(), size, path.c_str());
+
+		std::wstring text = std::wstring(L"struct ") + section + L"/" + key + L" of " + std::to_wstring(size) + L" bytes: " + ToString(result);
+		if (result)
+		{
+			text += L" [";
+			for (size_t i = 0; i < buffer.size(); i++)
+			{
+				constexpr wchar_t digits[] = L"0123456789ABCDEF";
+				text += i != 0 ? L" " : L"";
+				text += digits[buffer[i] >> 4];
+				text += digits[buffer[i] & 0x0F];
+			}
+			text += L"]";
+		}
+		return text;
+	}
+
+	constexpr char SectionTestFile[] =
+		"[First]\r\n"
+		"a=1\r\n"
+		"[Second]\r\n"
+		"b=2\r\n"
+		"c=3\r\n"
+		"[Third]\r\n"
+		"d=4\r\n";
+}
+
+PPR_CONFORMANCE_TEST(WritePrivateProfileSection_KeepsSectionPosition)
+{
+	Tests::TempFile file(SectionTestFile);
+
+	record.push_back(ToString(::WritePrivateProfileSectionW(L"Second", L"c=30\0e=5\0", file.GetPath().c_str())));
+	record.push_back(ReadSectionNames(file.GetPath()));
+	record.push_back(ReadKeyNames(L"Second", file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"b", file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"c", file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"e", file.GetPath()));
+	record.push_back(ReadValue(L"Third", L"d", file.GetPath()));
+}
+
+PPR_CONFORMANCE_TEST(WritePrivateProfileSection_ReplacesAllKeys)
+{
+	Tests::TempFile file(SectionTestFile);
+
+	record.push_back(ToString(::WritePrivateProfileSectionW(L"second", L"b=20\0", file.GetPath().c_str())));
+	record.push_back(ReadSectionNames(file.GetPath()));
+	record.push_back(ReadKeyNames(L"Second", file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"b", file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"c", file.GetPath()));
+}
+
+PPR_CONFORMANCE_TEST(WritePrivateProfileSection_LinesWithoutValue)
+{
+	Tests::TempFile file(SectionTestFile);
+
+	record.push_back(ToString(::WritePrivateProfileSectionW(L"Second", L"b=2\0verbatim line\0c=3\0", file.GetPath().c_str())));
+	record.push_back(ReadKeyNames(L"Second", file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"b", file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"c", file.GetPath()));
+}
+
+PPR_CONFORMANCE_TEST(WritePrivateProfileSection_NewSection)
+{
+	Tests::TempFile file(SectionTestFile);
+
+	record.push_back(ToString(::WritePrivateProfileSectionW(L"Fourth", L"f=6\0g=7\0", file.GetPath().c_str())));
+	record.push_back(ReadSectionNames(file.GetPath()));
+	record.push_back(ReadKeyNames(L"Fourth", file.GetPath()));
+	record.push_back(ReadValue(L"Fourth", L"g", file.GetPath()));
+}
+
+PPR_CONFORMANCE_TEST(WritePrivateProfileSection_NullDeletesSection)
+{
+	Tests::TempFile file(SectionTestFile);
+
+	record.push_back(ToString(::WritePrivateProfileSectionW(L"Second", nullptr, file.GetPath().c_str())));
+	record.push_back(ReadSectionNames(file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"b", file.GetPath()));
+}
+
+PPR_CONFORMANCE_TEST(WritePrivateProfileSectionA_KeepsSectionPosition)
+{
+	Tests::TempFile file(SectionTestFile);
+	const std::string path = ToANSI(file.GetPath());
+
+	record.push_back(ToString(::WritePrivateProfileSectionA("Second", "c=30\0e=5\0", path.c_str())));
+	record.push_back(ReadSectionNames(file.GetPath()));
+	record.push_back(ReadKeyNames(L"Second", file.GetPath()));
+	record.push_back(ReadValue(L"Second", L"e", file.GetPath()));
+}
+
+PPR_CONFORMANCE_TEST(PrivateProfileStruct_RoundTrip)
+{
+	Tests::TempFile file(SectionTestFile);
+
+	// Stored as hex digits and a checksum byte, the bytes past the struct are left alone
+	const uint8_t data[] = {0x01, 0x7F, 0x80, 0xFF, 0x00, 0xAB};
+	record.push_back(ToString(::WritePrivateProfileStructW(L"Second", L"Struct", const_cast<uint8_t*>(data), static_cast<UINT>(std::size(data)), file.GetPath().c_str())));
+	record.push_back(ReadValue(L"Second", L"Struct", file.GetPath()));
+	record.push_back(ReadStruct(L"Second", L"Struct", static_cast<UINT>(std::size(data)), file.GetPath()));
+	record.push_back(ReadStruct(L"second", L"STRUCT", static_cast<UINT>(std::size(data)), file.GetPath()));
+
+	// Empty struct, only the checksum
+	record.push_back(ToString(::WritePrivateProfileStructW(L"Second", L"Empty", const_cast<uint8_t*>(data), 0, file.GetPath().c_str())));
+	record.push_back(ReadValue(L"Second", L"Empty", file.GetPath()));
+	record.push_back(ReadStruct(L"Second", L"Empty", 0, file.GetPath()));
+
+	// The ANSI functions store the same text
+	const std::string path = ToANSI(file.GetPath());
+	record.push_back(ToString(::WritePrivateProfileStructA("Third", "Struct", const_cast<uint8_t*>(data), 3, path.c_str())));
+	record.push_back(ReadValue(L"Third", L"Struct", file.GetPath()));
+	record.push_back(ReadStruct(L"Third", L"Struct", 3, file.GetPath()));
+
+	// Null data deletes the key
+	record.push_back(ToString(::WritePrivateProfileStructW(L"Second", L"Struct", nullptr, 0, file.GetPath().c_str())));
+	record.push_back(ReadValue(L"Second", L"Struct", file.GetPath()));
+	record.push_back(ReadKeyNames(L"Second", file.GetPath()));
+}
+
+PPR_CONFORMANCE_TEST(PrivateProfileStruct_InvalidData)
+{
+	Tests::TempFile file(
+		"[Structs]\r\n"
+		"Valid=01020306\r\n"
+		"Lower=0a0b15\r\n"
+		"BadChecksum=01020307\r\n"
+		"BadDigit=01G203\r\n"
+		"OddLength=0102F03\r\n"
+		"Short=01\r\n"
+		"Empty=\r\n"
+	);
+	const std::wstring& path = file.GetPath();
+
+	// Lengths other than the stored one fail
+	record.push_back(ReadStruct(L"Structs", L"Valid", 3, path));
+	record.push_back(ReadStruct(L"Structs", L"Valid", 2, path));
+	record.push_back(ReadStruct(L"Structs", L"Valid", 4, path));
+
+	record.push_back(ReadStruct(L"Structs", L"Lower", 2, path));
+	record.push_back(ReadStruct(L"Structs", L"BadChecksum", 3, path));
+	record.push_back(ReadStruct(L"Structs", L"BadDigit", 2, path));
+	record.push_back(ReadStruct(L"Structs", L"OddLength", 3, path));
+	record.push_back(ReadStruct(L"Structs", L"OddLength", 2, path));
+	record.push_back(ReadStruct(L"Structs", L"Short", 0, path));
+	record.push_back(ReadStruct(L"Structs", L"Empty", 0, path));
+
+	// Missing key, section and file
+	record.push_back(ReadStruct(L"Structs", L"Missing", 3, path));
+	record.push_back(ReadStruct(L"Missing", L"Valid", 3, path));
+	record.push_back(ReadStruct(L"Structs", L"Valid", 3, path + L".missing"));
+}
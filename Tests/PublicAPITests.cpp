@@ -0,0 +1,167 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "API/PrivateProfileRedirectorAPI.h"
+#include <format>
+
+// The batched read of the redirector is recorded in the redirected pass and the same reads made one key at a time with
+// 'GetPrivateProfileString' in the native pass, following the 'PPR_QueryResult' contract. Both have to agree.
+namespace
+{
+	using namespace PPR;
+
+	constexpr char QueryTestFile[] =
+		"[General]\r\n"
+		"sName=Hello\r\n"
+		"sEmpty=\r\n"
+		"iValue=42\r\n"
+		"[Display]\r\n"
+		"iSize H=1080\r\n"
+		"sLongValue=A value longer than the small buffers\r\n";
+
+	PPR_QueryValuesW_t GetQueryValues() noexcept
+	{
+		if (HMODULE module = Tests::GetRedirectorModule())
+		{
+			return reinterpret_cast<PPR_QueryValuesW_t>(::GetProcAddress(module, "PPR_QueryValuesW"));
+		}
+		return nullptr;
+	}
+
+	uint32_t QueryValuesNative(const wchar_t* fileName, const wchar_t* section, const wchar_t* const* keys, uint32_t count, PPR_QueryResultW* results)
+	{
+		// Nothing the file can contain, so it tells a missing key from an empty value
+		constexpr wchar_t missing[] = L"<\x1\x2 missing \x2\x1>";
+
+		uint32_t foundCount = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			PPR_QueryResultW& result = results[i];
+
+			wchar_t value[4096] = {};
+			const DWORD length = keys[i] ? ::GetPrivateProfileStringW(section, keys[i], missing, value, static_cast<DWORD>(std::size(value)), fileName) : 0;
+			const bool found = keys[i] && std::wstring_view(value, length) != missing;
+
+			result.Length = found ? length : 0;
+			result.Found = found ? 1 : 0;
+			foundCount += found ? 1 : 0;
+			if (result.Buffer && result.BufferSize != 0)
+			{
+				const size_t copySize = std::min<size_t>(result.Length, result.BufferSize - 1);
+				std::copy_n(value, copySize, result.Buffer);
+				result.Buffer[copySize] = 0;
+			}
+		}
+		return foundCount;
+	}
+
+	void RecordQuery(std::vector<std::wstring>& record, const std::wstring& path, const wchar_t* section, std::initializer_list<const wchar_t*> keys, uint32_t bufferSize)
+	{
+		std::vector<const wchar_t*> keyList(keys);
+		std::vector<std::vector<wchar_t>> buffers(keyList.size(), std::vector<wchar_t>(bufferSize + 1, L'#'));
+		std::vector<PPR_QueryResultW> results(keyList.size());
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			results[i].Buffer = bufferSize != 0 ? buffers[i].data() : nullptr;
+			results[i].BufferSize = bufferSize;
+			results[i].Length = 0xFFFFFFFF;
+			results[i].Found = -1;
+		}
+
+		const uint32_t count = static_cast<uint32_t>(keyList.size());
+		auto queryValues = GetQueryValues();
+		const uint32_t foundCount = queryValues ? queryValues(path.c_str(), section, keyList.data(), count, results.data()) : QueryValuesNative(path.c_str(), section, keyList.data(), count, results.data());
+
+		record.push_back(std::format(L"[{}] buffer {}: {} found", section, bufferSize, foundCount));
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const PPR_QueryResultW& result = results[i];
+			std::wstring text = std::format(L"  {}: found {}, length {}", keyList[i] ? keyList[i] : L"<null>", result.Found, result.Length);
+			if (result.Buffer)
+			{
+				text += std::format(L", buffer '{}'", result.Buffer);
+			}
+			record.push_back(std::move(text));
+		}
+	}
+}
+
+PPR_CONFORMANCE_TEST(PPR_QueryValues_MissingKeys)
+{
+	Tests::TempFile file(QueryTestFile);
+
+	// Found, empty, missing and null keys in one call, the names in a different case
+	RecordQuery(record, file.GetPath(), L"General", {L"sName", L"Missing", L"sEmpty", nullptr, L"IVALUE"}, 64);
+	RecordQuery(record, file.GetPath(), L"general", {L"snAME"}, 64);
+	RecordQuery(record, file.GetPath(), L"Missing", {L"sName", L"iValue"}, 64);
+}
+
+PPR_CONFORMANCE_TEST(PPR_QueryValues_Sections)
+{
+	Tests::TempFile file(QueryTestFile);
+
+	// One call per section of the same file, each one sees only the keys of its own section
+	RecordQuery(record, file.GetPath(), L"General", {L"sName", L"iSize H", L"iValue"}, 64);
+	RecordQuery(record, file.GetPath(), L"Display", {L"sName", L"iSize H", L"sLongValue"}, 64);
+	RecordQuery(record, file.GetPath(), L"General", {L"sLongValue"}, 64);
+}
+
+PPR_CONFORMANCE_TEST(PPR_QueryValues_BufferSizes)
+{
+	Tests::TempFile file(QueryTestFile);
+
+	// No buffer reports only the lengths, the rest truncates and always terminates
+	for (uint32_t bufferSize: {0u, 1u, 2u, 5u, 6u, 64u})
+	{
+		RecordQuery(record, file.GetPath(), L"Display", {L"iSize H", L"sLongValue", L"Missing"}, bufferSize);
+	}
+}
+
+PPR_PROFILE_BENCHMARK(PPR_QueryValues_Batched)
+{
+	// A plugin reading all of its settings: one 'GetPrivateProfileString' call per key against one batched call
+	constexpr size_t keyCount = 48;
+	std::string text = "[Settings]\r\n";
+	for (size_t i = 0; i < keyCount; i++)
+	{
+		text += std::format("fSettingValue{}={}.5\r\n", i, i);
+	}
+	Tests::TempFile file(text);
+	const wchar_t* path = file.GetPath().c_str();
+
+	std::vector<std::wstring> keyNames;
+	for (size_t i = 0; i < keyCount; i++)
+	{
+		keyNames.push_back(std::format(L"fSettingValue{}", i));
+	}
+	std::vector<const wchar_t*> keys;
+	for (const std::wstring& key: keyNames)
+	{
+		keys.push_back(key.c_str());
+	}
+
+	std::vector<std::array<wchar_t, 64>> buffers(keyCount);
+	const auto separate = Tests::Measure(std::format("{} keys, one call per key", keyCount), 0, [&]()
+	{
+		for (size_t i = 0; i < keyCount; i++)
+		{
+			Tests::Consume(::GetPrivateProfileStringW(L"Settings", keys[i], L"", buffers[i].data(), static_cast<DWORD>(buffers[i].size()), path));
+		}
+	});
+
+	// Only the redirector exports it
+	if (auto queryValues = GetQueryValues())
+	{
+		std::vector<PPR_QueryResultW> results(keyCount);
+		for (size_t i = 0; i < keyCount; i++)
+		{
+			results[i].Buffer = buffers[i].data();
+			results[i].BufferSize = static_cast<uint32_t>(buffers[i].size());
+		}
+
+		const auto batched = Tests::Measure(std::format("{} keys, PPR_QueryValuesW", keyCount), 0, [&]()
+		{
+			Tests::Consume(queryValues(path, L"Settings", keys.data(), static_cast<uint32_t>(keyCount), results.data()));
+		});
+		std::printf("  batched read is %.2fx faster, %.1f ns per key\n", separate.NanosecondsPerCall / batched.NanosecondsPerCall, batched.NanosecondsPerCall / keyCount);
+	}
+}
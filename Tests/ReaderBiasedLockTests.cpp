@@ -0,0 +1,290 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "ReaderBiasedLock.h"
+#include <shared_mutex>
+#include <thread>
+
+namespace
+{
+	using namespace PPR;
+
+	size_t GetReaderThreadCount()
+	{
+		return std::clamp<size_t>(std::thread::hardware_concurrency(), 2, 16);
+	}
+
+	// Runs the function on the given number of threads at once, each one gets its own index
+	template<class TFunc>
+	void RunOnThreads(size_t threadCount, TFunc&& func)
+	{
+		std::atomic<size_t> readyCount = 0;
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < threadCount; i++)
+		{
+			threads.emplace_back([&, i]()
+			{
+				// Start together, so the threads actually contend
+				readyCount++;
+				while (readyCount.load() != threadCount)
+				{
+					::YieldProcessor();
+				}
+				func(i);
+			});
+		}
+		for (std::thread& thread: threads)
+		{
+			thread.join();
+		}
+	}
+}
+
+PPR_TEST(ReaderBiasedLock_ExcludesReadersAndWriters)
+{
+	ReaderBiasedLock lock;
+	std::atomic<size_t> tornReads = 0;
+	uint64_t first = 0;
+	uint64_t second = 0;
+
+	// Half of the threads write both values, the other half checks that they never see them differ
+	constexpr size_t iterationCount = 20000;
+	RunOnThreads(GetReaderThreadCount(), [&](size_t index)
+	{
+		for (size_t i = 0; i < iterationCount; i++)
+		{
+			if (index % 2 == 0)
+			{
+				ReaderBiasedLock::WriteGuard guard(lock);
+				first++;
+				Tests::Consume(first);
+				second++;
+			}
+			else
+			{
+				ReaderBiasedLock::ReadGuard guard(lock);
+				if (first != second)
+				{
+					tornReads++;
+				}
+			}
+		}
+	});
+
+	const size_t writerCount = (GetReaderThreadCount() + 1) / 2;
+	PPR_CHECK_EQUAL(tornReads.load(), 0);
+	PPR_CHECK_EQUAL(first, writerCount * iterationCount);
+	PPR_CHECK_EQUAL(second, writerCount * iterationCount);
+}
+
+PPR_TEST(ReaderBiasedLock_WritersAreNotStarved)
+{
+	// The readers take the lock back to back without any pause, the bias is turned back on by them whenever it's allowed.
+	// Every exclusive acquisition of the writer still has to get through in bounded time.
+	ReaderBiasedLock lock;
+	std::atomic<bool> stop = false;
+	std::atomic<size_t> readCount = 0;
+	std::atomic<size_t> tornReads = 0;
+	uint64_t first = 0;
+	uint64_t second = 0;
+
+	std::vector<std::thread> readers;
+	for (size_t i = 0; i < GetReaderThreadCount(); i++)
+	{
+		readers.emplace_back([&]()
+		{
+			size_t count = 0;
+			while (!stop.load(std::memory_order_relaxed))
+			{
+				ReaderBiasedLock::ReadGuard guard(lock);
+				if (first != second)
+				{
+					tornReads++;
+				}
+				count++;
+			}
+			readCount += count;
+		});
+	}
+
+	// Give the readers time to start and the bias to settle
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	using Clock = std::chrono::steady_clock;
+	constexpr size_t writeCount = 2000;
+	auto maxWait = Clock::duration::zero();
+	auto totalWait = Clock::duration::zero();
+	for (size_t i = 0; i < writeCount; i++)
+	{
+		const auto start = Clock::now();
+		{
+			ReaderBiasedLock::WriteGuard guard(lock);
+			const auto wait = Clock::now() - start;
+			maxWait = std::max(maxWait, wait);
+			totalWait += wait;
+
+			first++;
+			second++;
+		}
+
+		// Let the readers turn the bias back on now and then
+		if (i % 64 == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	stop = true;
+	for (std::thread& thread: readers)
+	{
+		thread.join();
+	}
+
+	PPR_CHECK_EQUAL(tornReads.load(), 0);
+	PPR_CHECK_EQUAL(first, writeCount);
+	PPR_CHECK(maxWait < std::chrono::seconds(1));
+	PPR_CHECK(readCount.load() != 0);
+
+	std::printf("  %zu readers, %zu reads, writer wait: average %.1f us, max %.1f us\n",
+				readers.size(),
+				readCount.load(),
+				std::chrono::duration<double, std::micro>(totalWait).count() / writeCount,
+				std::chrono::duration<double, std::micro>(maxWait).count()
+	);
+}
+
+PPR_TEST(ReaderBiasedLock_PublishedReaderIsAbandonedOnTermination)
+{
+	// A reader that took a fresh lock through the bias holds only its table slot, not the underlying lock.
+	// Once the process is terminating the writer can't wait for it anymore and has to report the lock as abandoned.
+	ReaderBiasedLock lock;
+	std::optional<ReaderBiasedLock::ReadGuard> reader;
+	reader.emplace(lock);
+	PPR_CHECK(!reader->IsAbandoned());
+
+	ReaderBiasedLock::SetProcessTerminating();
+	{
+		ReaderBiasedLock::WriteGuard writer(lock);
+		PPR_CHECK(writer.IsAbandoned());
+	}
+
+	// The underlying lock wasn't left taken by the failed attempt, the lock is free once the reader leaves
+	reader.reset();
+	{
+		ReaderBiasedLock::WriteGuard writer(lock);
+		PPR_CHECK(!writer.IsAbandoned());
+	}
+	ReaderBiasedLock::SetProcessTerminating(false);
+}
+
+PPR_BENCHMARK(ReaderBiasedLock_Read)
+{
+	// Uncontended read lock and unlock, what a single-threaded game pays per redirected call
+	ReaderBiasedLock biasedLock;
+	SRWLOCK srwLock = SRWLOCK_INIT;
+	std::shared_mutex sharedMutex;
+
+	Tests::Measure("ReaderBiasedLock, one thread", 0, [&]()
+	{
+		ReaderBiasedLock::ReadGuard guard(biasedLock);
+		Tests::Consume(guard);
+	});
+	Tests::Measure("SRWLOCK, one thread", 0, [&]()
+	{
+		::AcquireSRWLockShared(&srwLock);
+		::ReleaseSRWLockShared(&srwLock);
+	});
+	Tests::Measure("std::shared_mutex, one thread", 0, [&]()
+	{
+		std::shared_lock guard(sharedMutex);
+		Tests::Consume(guard);
+	});
+
+	// Every thread takes the same lock for reading, a plain reader-writer lock bounces its cache line between them
+	constexpr size_t iterationCount = 200000;
+	const size_t threadCount = GetReaderThreadCount();
+	auto MeasureThreads = [&](std::string_view name, auto&& readOnce)
+	{
+		const auto result = Tests::Measure(name, 0, [&]()
+		{
+			RunOnThreads(threadCount, [&](size_t)
+			{
+				for (size_t i = 0; i < iterationCount; i++)
+				{
+					readOnce();
+				}
+			});
+		});
+		std::printf("  %zu threads, %.2f ns per read\n", threadCount, result.NanosecondsPerCall / (iterationCount * threadCount));
+	};
+
+	MeasureThreads("ReaderBiasedLock, all threads", [&]()
+	{
+		ReaderBiasedLock::ReadGuard guard(biasedLock);
+		Tests::Consume(guard);
+	});
+	MeasureThreads("SRWLOCK, all threads", [&]()
+	{
+		::AcquireSRWLockShared(&srwLock);
+		::ReleaseSRWLockShared(&srwLock);
+	});
+	MeasureThreads("std::shared_mutex, all threads", [&]()
+	{
+		std::shared_lock guard(sharedMutex);
+		Tests::Consume(guard);
+	});
+}
+
+PPR_BENCHMARK(ReaderBiasedLock_MixedReadWrite)
+{
+	// One write in a thousand operations, the bias is revoked on every write and has to pay off in between
+	ReaderBiasedLock biasedLock;
+	SRWLOCK srwLock = SRWLOCK_INIT;
+
+	constexpr size_t iterationCount = 100000;
+	constexpr size_t writeInterval = 1000;
+	const size_t threadCount = GetReaderThreadCount();
+
+	const auto biased = Tests::Measure("ReaderBiasedLock, 0.1% writes", 0, [&]()
+	{
+		RunOnThreads(threadCount, [&](size_t index)
+		{
+			for (size_t i = 0; i < iterationCount; i++)
+			{
+				if ((i + index) % writeInterval == 0)
+				{
+					ReaderBiasedLock::WriteGuard guard(biasedLock);
+					Tests::Consume(guard);
+				}
+				else
+				{
+					ReaderBiasedLock::ReadGuard guard(biasedLock);
+					Tests::Consume(guard);
+				}
+			}
+		});
+	});
+	const auto srw = Tests::Measure("SRWLOCK, 0.1% writes", 0, [&]()
+	{
+		RunOnThreads(threadCount, [&](size_t index)
+		{
+			for (size_t i = 0; i < iterationCount; i++)
+			{
+				if ((i + index) % writeInterval == 0)
+				{
+					::AcquireSRWLockExclusive(&srwLock);
+					::ReleaseSRWLockExclusive(&srwLock);
+				}
+				else
+				{
+					::AcquireSRWLockShared(&srwLock);
+					::ReleaseSRWLockShared(&srwLock);
+				}
+			}
+		});
+	});
+	std::printf("  %zu threads, %.2f ns per operation, SRWLOCK %.2f ns\n",
+				threadCount,
+				biased.NanosecondsPerCall / (iterationCount * threadCount),
+				srw.NanosecondsPerCall / (iterationCount * threadCount)
+	);
+}
@@ -0,0 +1,58 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include <deque>
+#include <format>
+#include <thread>
+
+// The redirector saves the changed files on 'DLL_THREAD_DETACH' only when 'SaveOnThreadDetach' is enabled in the
+// 'PrivateProfileRedirector.ini' next to the DLL, without it the redirected pass measures the writes alone.
+PPR_PROFILE_BENCHMARK(ThreadDetach_DirtyFiles)
+{
+	// A game with many loaded files and short-lived worker threads, only a few of the files are written between them
+	constexpr size_t fileCount = 500;
+	std::deque<Tests::TempFile> files;
+	for (size_t i = 0; i < fileCount; i++)
+	{
+		const wchar_t* path = files.emplace_back("[General]\r\nsValue=0\r\niCount=1\r\n").GetPath().c_str();
+
+		wchar_t buffer[64] = {};
+		::GetPrivateProfileStringW(L"General", L"sValue", L"", buffer, static_cast<DWORD>(std::size(buffer)), path);
+	}
+
+	// Every write changes the value, so each of the written files has something to save
+	size_t writeIndex = 0;
+	auto WriteFiles = [&](size_t dirtyCount)
+	{
+		const wchar_t* value = (writeIndex++ % 2) ? L"1" : L"2";
+		for (size_t i = 0; i < dirtyCount; i++)
+		{
+			Tests::Consume(::WritePrivateProfileStringW(L"General", L"sValue", value, files[i].GetPath().c_str()));
+		}
+	};
+	auto RunThread = []()
+	{
+		std::thread([]()
+		{
+		}).join();
+	};
+
+	const auto emptyThread = Tests::Measure(std::format("Thread start and exit, {} files loaded, 0 dirty", fileCount), 0, [&]()
+	{
+		RunThread();
+	});
+	for (size_t dirtyCount: {1u, 50u})
+	{
+		const auto writes = Tests::Measure(std::format("{} writes", dirtyCount), 0, [&]()
+		{
+			WriteFiles(dirtyCount);
+		});
+		const auto detach = Tests::Measure(std::format("{} writes, thread start and exit, {} files loaded, {} dirty", dirtyCount, fileCount, dirtyCount), 0, [&]()
+		{
+			WriteFiles(dirtyCount);
+			RunThread();
+		});
+
+		const double detachCost = detach.NanosecondsPerCall - writes.NanosecondsPerCall - emptyThread.NanosecondsPerCall;
+		std::printf("  saving %zu dirty files on the thread detach costs %.1f us, %.1f us per file\n", dirtyCount, detachCost / 1000.0, detachCost / 1000.0 / dirtyCount);
+	}
+}
@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "SettingParser.h"
+
+// The expected values are what 'atof', 'atoi' and 'strtoul' of the C runtime return for the same text
+
+PPR_TEST(SettingParser_Float)
+{
+	using namespace PPR;
+
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("1.5"), 1.5f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat(" \t-2.25"), -2.25f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("+3"), 3.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat(".5"), 0.5f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("1e3"), 1000.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("2.5E-1"), 0.25f);
+
+	// Stops at the first unexpected character, a decimal comma included
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("1.5f"), 1.5f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("1,5"), 1.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("7e"), 7.0f);
+
+	// Not a number
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat(""), 0.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("abc"), 0.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("--1"), 0.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("+-1"), 0.0f);
+
+	// Hexadecimal floats
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("0x10"), 16.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("0x1p3"), 8.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("-0X1.8p1"), -3.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("0x"), 0.0f);
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("0x-1"), 0.0f);
+
+	// Out of range
+	PPR_CHECK(std::isinf(SettingParser::ParseFloat("1e999")));
+	PPR_CHECK(SettingParser::ParseFloat("-1e999") < 0 && std::isinf(SettingParser::ParseFloat("-1e999")));
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("1e-999"), 0.0f);
+	PPR_CHECK(std::isinf(SettingParser::ParseFloat("0x1p99999")));
+	PPR_CHECK_EQUAL(SettingParser::ParseFloat("0x1p-99999"), 0.0f);
+
+	PPR_CHECK(std::isinf(SettingParser::ParseFloat("inf")));
+	PPR_CHECK(std::isnan(SettingParser::ParseFloat("nan")));
+}
+
+PPR_TEST(SettingParser_Bool)
+{
+	using namespace PPR;
+
+	// The words are matched by their prefix in any case
+	PPR_CHECK(SettingParser::ParseBool("true"));
+	PPR_CHECK(SettingParser::ParseBool(" TRUE"));
+	PPR_CHECK(SettingParser::ParseBool("Trueish"));
+	PPR_CHECK(!SettingParser::ParseBool("false"));
+	PPR_CHECK(!SettingParser::ParseBool("FALSEhood"));
+
+	// Anything else is an integer, non-zero is true
+	PPR_CHECK(SettingParser::ParseBool("1"));
+	PPR_CHECK(SettingParser::ParseBool("2"));
+	PPR_CHECK(SettingParser::ParseBool(" -1"));
+	PPR_CHECK(SettingParser::ParseBool("99999999999999999999"));
+	PPR_CHECK(!SettingParser::ParseBool("0"));
+	PPR_CHECK(!SettingParser::ParseBool("tru"));
+	PPR_CHECK(!SettingParser::ParseBool("yes"));
+	PPR_CHECK(!SettingParser::ParseBool(""));
+}
+
+PPR_TEST(SettingParser_Integer)
+{
+	using namespace PPR;
+
+	// 'i' is a 32-bit 'atoi', saturated on overflow
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("42", L"iValue"), 42);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("  -42", L"iValue"), -42);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("+7", L"IValue"), 7);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("12abc", L"iValue"), 12);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("1.9", L"iValue"), 1);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("0x10", L"iValue"), 0);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("abc", L"iValue"), 0);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("- 1", L"iValue"), 0);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("2147483647", L"iValue"), 2147483647);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("2147483648", L"iValue"), 2147483647);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-2147483648", L"iValue"), -2147483647 - 1);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-2147483649", L"iValue"), -2147483647 - 1);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("99999999999999999999", L"iValue"), 2147483647);
+
+	// 'u' is a 32-bit 'strtoul': a negative value is negated in the unsigned type, the magnitude saturates
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("4294967295", L"uValue"), 4294967295);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("4294967296", L"uValue"), 4294967295);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-1", L"uValue"), 4294967295);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-5", L"UValue"), 4294967291);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-4294967295", L"uValue"), 1);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-4294967296", L"uValue"), 4294967295);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-0", L"uValue"), 0);
+
+	// Other keys take the full 64-bit range
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("4294967296", L"sValue"), 4294967296);
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("9223372036854775807", L"sValue"), std::numeric_limits<int64_t>::max());
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("9223372036854775808", L"sValue"), std::numeric_limits<int64_t>::max());
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-9223372036854775808", L"sValue"), std::numeric_limits<int64_t>::min());
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("-99999999999999999999", L"sValue"), std::numeric_limits<int64_t>::min());
+	PPR_CHECK_EQUAL(SettingParser::ParseInteger("5", L""), 5);
+}
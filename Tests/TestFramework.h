@@ -0,0 +1,128 @@
+#pragma once
+#include "stdafx.h"
+#include <chrono>
+#include <functional>
+
+namespace PPR::Tests
+{
+	// Minimal self-registering test runner, see 'Main.cpp'. Tests check the behavior, benchmarks only print their
+	// numbers and run with '--benchmarks'. Conformance tests run twice, first against the native functions and then
+	// with the redirector loaded ('--redirector <path>'), and compare what they've recorded in both runs.
+	// Profile benchmarks run in both of these passes as well.
+	class Registry final
+	{
+		public:
+			enum class Kind
+			{
+				Test,
+				Benchmark,
+				Conformance,
+				ProfileBenchmark
+			};
+			struct Entry final
+			{
+				Kind Type = Kind::Test;
+				const char* Name = nullptr;
+				std::function<void()> Run;
+				std::function<void(std::vector<std::wstring>&)> Record;
+			};
+
+		public:
+			static std::vector<Entry>& GetEntries();
+
+			static bool Add(const char* name, Kind kind, std::function<void()> func)
+			{
+				GetEntries().emplace_back(Entry{kind, name, std::move(func), {}});
+				return true;
+			}
+			static bool Add(const char* name, std::function<void(std::vector<std::wstring>&)> func)
+			{
+				GetEntries().emplace_back(Entry{Kind::Conformance, name, {}, std::move(func)});
+				return true;
+			}
+	};
+
+	void ReportFailure(const char* expression, const char* file, int line);
+	void ReportFailure(const std::string& message, const char* file, int line);
+
+	// The redirector DLL once it's loaded for the redirected pass, null before that and without '--redirector'
+	HMODULE GetRedirectorModule() noexcept;
+
+	// Creates a uniquely named file in the temporary directory and deletes it when destroyed
+	class TempFile final
+	{
+		private:
+			std::wstring m_Path;
+
+		public:
+			TempFile(std::string_view content = {});
+			TempFile(std::span<const uint8_t> content);
+			TempFile(const TempFile&) = delete;
+			~TempFile();
+
+		public:
+			const std::wstring& GetPath() const noexcept
+			{
+				return m_Path;
+			}
+			std::vector<uint8_t> ReadBytes() const;
+			std::string ReadText() const;
+
+		public:
+			TempFile& operator=(const TempFile&) = delete;
+	};
+
+	// Runs the function in a loop until it takes at least 'minTime' and prints the time per call,
+	// and the throughput if the number of bytes processed by one call is known.
+	struct BenchmarkResult final
+	{
+		double NanosecondsPerCall = 0;
+		double GigabytesPerSecond = 0;
+	};
+	BenchmarkResult Measure(std::string_view name, size_t bytesPerCall, const std::function<void()>& func, std::chrono::milliseconds minTime = std::chrono::milliseconds(300));
+
+	// Keeps the compiler from optimizing away the measured work
+	template<class T>
+	void Consume(const T& value) noexcept
+	{
+		static volatile const void* sink = nullptr;
+		sink = &value;
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+	}
+}
+
+#define PPR_TEST_CONCAT2(a, b) a##b
+#define PPR_TEST_CONCAT(a, b) PPR_TEST_CONCAT2(a, b)
+
+#define PPR_TEST_DEFINE(kind, name)	\
+	static void PPR_TEST_CONCAT(TestFunc_, name)();	\
+	static const bool PPR_TEST_CONCAT(TestReg_, name) = PPR::Tests::Registry::Add(#name, kind, &PPR_TEST_CONCAT(TestFunc_, name));	\
+	static void PPR_TEST_CONCAT(TestFunc_, name)()
+
+#define PPR_TEST(name) PPR_TEST_DEFINE(PPR::Tests::Registry::Kind::Test, name)
+#define PPR_BENCHMARK(name) PPR_TEST_DEFINE(PPR::Tests::Registry::Kind::Benchmark, name)
+#define PPR_PROFILE_BENCHMARK(name) PPR_TEST_DEFINE(PPR::Tests::Registry::Kind::ProfileBenchmark, name)
+
+// The body gets 'std::vector<std::wstring>& record' to append its observations to
+#define PPR_CONFORMANCE_TEST(name)	\
+	static void PPR_TEST_CONCAT(TestFunc_, name)(std::vector<std::wstring>& record);	\
+	static const bool PPR_TEST_CONCAT(TestReg_, name) = PPR::Tests::Registry::Add(#name, &PPR_TEST_CONCAT(TestFunc_, name));	\
+	static void PPR_TEST_CONCAT(TestFunc_, name)(std::vector<std::wstring>& record)
+
+#define PPR_CHECK(expression)	\
+	do	\
+	{	\
+		if (!(expression))	\
+		{	\
+			PPR::Tests::ReportFailure(#expression, __FILE__, __LINE__);	\
+		}	\
+	} while (false)
+
+#define PPR_CHECK_EQUAL(left, right)	\
+	do	\
+	{	\
+		if (!((left) == (right)))	\
+		{	\
+			PPR::Tests::ReportFailure(#left " == " #right, __FILE__, __LINE__);	\
+		}	\
+	} while (false)
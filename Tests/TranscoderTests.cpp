@@ -0,0 +1,277 @@
+#include "stdafx.h"
+#include "TestFramework.h"
+#include "Transcoder.h"
+#include "INIWrapper.h"
+
+namespace
+{
+	using namespace PPR;
+	using Format = Transcoder::Format;
+
+	constexpr Format Formats[] = {Format::UTF8, Format::UTF16LE, Format::UTF16BE, Format::UTF32LE, Format::UTF32BE};
+
+	const char* GetFormatName(Format format) noexcept
+	{
+		switch (format)
+		{
+			case Format::UTF8:
+			{
+				return "UTF-8";
+			}
+			case Format::UTF16LE:
+			{
+				return "UTF-16LE";
+			}
+			case Format::UTF16BE:
+			{
+				return "UTF-16BE";
+			}
+			case Format::UTF32LE:
+			{
+				return "UTF-32LE";
+			}
+			case Format::UTF32BE:
+			{
+				return "UTF-32BE";
+			}
+		};
+		return "";
+	}
+
+	std::vector<uint8_t> Encode(std::wstring_view text, Format format)
+	{
+		std::vector<uint8_t> data;
+		Transcoder::Encode(text, format, data);
+		return data;
+	}
+	std::optional<std::wstring> Decode(std::span<const uint8_t> data, Format format)
+	{
+		std::wstring text;
+		if (Transcoder::Decode(data, format, text))
+		{
+			return text;
+		}
+		return {};
+	}
+	std::optional<std::wstring> Decode(std::string_view data, Format format)
+	{
+		return Decode(std::span(reinterpret_cast<const uint8_t*>(data.data()), data.size()), format);
+	}
+
+	// 'count' lines of the typical shape, 'nonASCII' puts Cyrillic and CJK text and a surrogate pair into every value
+	std::wstring GenerateText(size_t count, bool nonASCII)
+	{
+		std::wstring text;
+		for (size_t i = 0; i < count; i++)
+		{
+			text += std::format(L"fSettingValue{}=", i);
+			text += nonASCII ? L"\x0417\x043D\x0430\x0447\x0435\x043D\x0438\x0435 \x65E5\x672C \xD83D\xDE00" : L"Value of the setting";
+			text += L"\r\n";
+		}
+		return text;
+	}
+}
+
+PPR_TEST(Transcoder_RoundTrip)
+{
+	// A surrogate pair at every position around the 16-byte blocks of all the kernels
+	for (Format format: Formats)
+	{
+		for (size_t offset = 0; offset < 40; offset++)
+		{
+			std::wstring text(offset, L'a');
+			text += L"\xD83D\xDE00";
+			text += std::wstring(40 - offset, L'b');
+			text += L"\x0416\x65E5";
+
+			auto decoded = Decode(Encode(text, format), format);
+			if (!decoded || *decoded != text)
+			{
+				Tests::ReportFailure(std::format("{} round trip failed at offset {}", GetFormatName(format), offset), __FILE__, __LINE__);
+			}
+		}
+	}
+
+	// Big-endian forms are the byte-swapped little-endian ones, in the vector path as well
+	const std::wstring text = std::wstring(20, L'A') + L"\x0416\xD83D\xDE00";
+	const auto utf16LE = Encode(text, Format::UTF16LE);
+	const auto utf16BE = Encode(text, Format::UTF16BE);
+	const auto utf32LE = Encode(text, Format::UTF32LE);
+	const auto utf32BE = Encode(text, Format::UTF32BE);
+	PPR_CHECK_EQUAL(utf16LE.size(), 23 * 2);
+	PPR_CHECK_EQUAL(utf32LE.size(), 22 * 4);
+	PPR_CHECK_EQUAL(utf16BE.size(), utf16LE.size());
+	PPR_CHECK_EQUAL(utf32BE.size(), utf32LE.size());
+	if (utf16LE.size() == utf16BE.size() && utf32LE.size() == utf32BE.size())
+	{
+		bool isSwapped = true;
+		for (size_t i = 0; i < utf16LE.size(); i += 2)
+		{
+			isSwapped = isSwapped && utf16LE[i] == utf16BE[i + 1] && utf16LE[i + 1] == utf16BE[i];
+		}
+		for (size_t i = 0; i < utf32LE.size(); i += 4)
+		{
+			isSwapped = isSwapped && utf32LE[i] == utf32BE[i + 3] && utf32LE[i + 1] == utf32BE[i + 2] && utf32LE[i + 2] == utf32BE[i + 1] && utf32LE[i + 3] == utf32BE[i];
+		}
+		PPR_CHECK(isSwapped);
+	}
+	PPR_CHECK(utf32BE.size() >= 4 * 22 && utf32BE[4 * 21 + 1] == 0x01 && utf32BE[4 * 21 + 2] == 0xF6 && utf32BE[4 * 21 + 3] == 0x00);
+
+	// Encoding in chunks gives the same bytes as encoding at once, the pairs on the chunk boundaries aren't split
+	const std::wstring longText = GenerateText(100, true);
+	for (Format format: Formats)
+	{
+		std::vector<uint8_t> chunked;
+		for (std::wstring_view rest = longText; !rest.empty();)
+		{
+			const size_t length = Transcoder::GetChunkLength(rest, 7);
+			Transcoder::Encode(rest.substr(0, length), format, chunked);
+			rest.remove_prefix(length);
+		}
+		PPR_CHECK(chunked == Encode(longText, format));
+	}
+}
+
+PPR_TEST(Transcoder_UnpairedSurrogates)
+{
+	// Written as U+FFFD to UTF-8 and UTF-32, both in the scalar tail and inside the vector blocks
+	for (size_t offset: {0, 7, 15, 16, 31})
+	{
+		const std::wstring prefix(offset, L'a');
+		const std::wstring text = prefix + L"\xD800" L"b" L"\xDC00" + std::wstring(20, L'c');
+		const std::wstring expected = prefix + L"\xFFFD" L"b" L"\xFFFD" + std::wstring(20, L'c');
+
+		PPR_CHECK(Decode(Encode(text, Format::UTF8), Format::UTF8) == expected);
+		PPR_CHECK(Decode(Encode(text, Format::UTF32LE), Format::UTF32LE) == expected);
+		PPR_CHECK(Decode(Encode(text, Format::UTF32BE), Format::UTF32BE) == expected);
+
+		// UTF-16 carries them as they are
+		PPR_CHECK(Decode(Encode(text, Format::UTF16LE), Format::UTF16LE) == text);
+		PPR_CHECK(Decode(Encode(text, Format::UTF16BE), Format::UTF16BE) == text);
+	}
+	PPR_CHECK(Encode(L"\xD800", Format::UTF8) == (std::vector<uint8_t>{0xEF, 0xBF, 0xBD}));
+}
+
+PPR_TEST(Transcoder_RejectsMalformedInput)
+{
+	const std::string_view malformed[] =
+	{
+		"\xC0\xAF", // Overlong '/'
+		"\xE0\x80\xAF",
+		"\xF0\x80\x80\xAF",
+		"\xED\xA0\x80", // Encoded surrogate
+		"\xF4\x90\x80\x80", // Past U+10FFFF
+		"\x80", // Stray continuation byte
+		"\xE2\x82", // Truncated at the end
+		"\xE2\x82" "A" // Truncated in the middle
+	};
+
+	// Right at the start, in the scalar tail and after a vector block of ASCII
+	for (size_t offset: {0, 5, 16, 30})
+	{
+		for (std::string_view sequence: malformed)
+		{
+			std::string data(offset, 'a');
+			data += sequence;
+			data += "tail";
+			PPR_CHECK(!Decode(data, Format::UTF8));
+		}
+	}
+	PPR_CHECK(Decode(std::string_view("\xE2\x82\xAC"), Format::UTF8) == L"\x20AC");
+	PPR_CHECK(Decode(std::string_view("\xF0\x9F\x98\x80"), Format::UTF8) == L"\xD83D\xDE00");
+
+	// UTF-32 values outside of the Unicode range and the surrogates
+	PPR_CHECK(!Decode(std::string_view("\x00\x00\x11\x00", 4), Format::UTF32LE));
+	PPR_CHECK(!Decode(std::string_view("\x00\xD8\x00\x00", 4), Format::UTF32LE));
+	PPR_CHECK(!Decode(std::string_view("\x00\x00\xD8\x00", 4), Format::UTF32BE));
+
+	// An incomplete code unit at the end is dropped
+	PPR_CHECK(Decode(std::string_view("a\0b\0c", 5), Format::UTF16LE) == L"ab");
+	PPR_CHECK(Decode(std::string_view("a\0\0\0b\0\0", 7), Format::UTF32LE) == L"a");
+}
+
+PPR_TEST(Transcoder_FileRoundTrip)
+{
+	// Every BOM is detected on load and written back on save, the document is longer than a save chunk
+	// and has a surrogate pair in every line, so some of them end up on the chunk boundaries.
+	const std::wstring text = L"[General]\r\n" + GenerateText(2000, true);
+	const std::pair<Format, std::vector<uint8_t>> files[] =
+	{
+		{Format::UTF8, {0xEF, 0xBB, 0xBF}},
+		{Format::UTF16LE, {0xFF, 0xFE}},
+		{Format::UTF16BE, {0xFE, 0xFF}},
+		{Format::UTF32LE, {0xFF, 0xFE, 0x00, 0x00}},
+		{Format::UTF32BE, {0x00, 0x00, 0xFE, 0xFF}}
+	};
+
+	kxf::FlagSet<kxf::INIDocumentOption> options;
+	options.Add(kxf::INIDocumentOption::IgnoreCase);
+	for (const auto& [format, bom]: files)
+	{
+		std::vector<uint8_t> data = bom;
+		Transcoder::Encode(text, format, data);
+		Tests::TempFile file(data);
+
+		INIWrapper ini;
+		PPR_CHECK(ini.Load(kxf::String(file.GetPath()), options));
+		PPR_CHECK(ini.GetValue(FoldedName(L"General"), FoldedName(L"fSettingValue1999")).Contains(L"\xD83D\xDE00"));
+
+		Tests::TempFile savedFile;
+		PPR_CHECK(ini.Save(kxf::String(savedFile.GetPath())));
+
+		const auto saved = savedFile.ReadBytes();
+		PPR_CHECK(saved.size() > bom.size() && std::equal(bom.begin(), bom.end(), saved.begin()));
+
+		INIWrapper savedINI;
+		PPR_CHECK(savedINI.Load(kxf::String(savedFile.GetPath()), options));
+		PPR_CHECK(savedINI.GetEncoding() == ini.GetEncoding());
+		PPR_CHECK(savedINI.GetValue(FoldedName(L"General"), FoldedName(L"fSettingValue1999")) == ini.GetValue(FoldedName(L"General"), FoldedName(L"fSettingValue1999")));
+	}
+}
+
+PPR_TEST(Transcoder_ANSIFallback)
+{
+	// A file without a BOM which isn't valid UTF-8 is most likely ANSI, it's still loaded as is
+	Tests::TempFile file("[General]\r\nsName=Caf\xE9\r\niSize=1\r\n");
+
+	kxf::FlagSet<kxf::INIDocumentOption> options;
+	options.Add(kxf::INIDocumentOption::IgnoreCase);
+
+	INIWrapper ini;
+	PPR_CHECK(ini.Load(kxf::String(file.GetPath()), options));
+	PPR_CHECK(ini.GetEncoding() == INIWrapper::Encoding::UTF8);
+	PPR_CHECK(ini.GetValue(FoldedName(L"General"), FoldedName(L"iSize")) == L"1");
+
+	auto value = ini.QueryValue(FoldedName(L"General"), FoldedName(L"sName"));
+	PPR_CHECK(value && value->Contains(L"Caf"));
+}
+
+PPR_BENCHMARK(Transcoder_Throughput)
+{
+	// Both directions for every encoding, the throughput is given for the encoded size
+	for (bool nonASCII: {false, true})
+	{
+		const std::wstring text = GenerateText(20000, nonASCII);
+		for (Format format: Formats)
+		{
+			const std::vector<uint8_t> data = Encode(text, format);
+			std::vector<uint8_t> encoded;
+			encoded.reserve(text.length() * 4);
+			std::wstring decoded;
+			decoded.reserve(text.length());
+
+			const char* textKind = nonASCII ? "non-ASCII" : "ASCII";
+			Tests::Measure(std::format("Decode {}, {}", GetFormatName(format), textKind), data.size(), [&]()
+			{
+				Transcoder::Decode(data, format, decoded);
+				Tests::Consume(decoded);
+			});
+			Tests::Measure(std::format("Encode {}, {}", GetFormatName(format), textKind), data.size(), [&]()
+			{
+				encoded.clear();
+				Transcoder::Encode(text, format, encoded);
+				Tests::Consume(encoded);
+			});
+		}
+	}
+}
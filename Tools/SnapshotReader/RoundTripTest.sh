@@ -0,0 +1,43 @@
+#!/bin/sh
+# Publishes 'RoundTripTest.txt' with the POSIX test writer and checks that the reader prints it back unchanged,
+# then publishes it again into the same region and checks the generation. Run it from this directory:
+#
+#	sh RoundTripTest.sh
+
+set -e
+
+CC=${CC:-cc}
+BUILD=$(mktemp -d)
+ID=$$
+trap '"$BUILD/SnapshotWriter" $ID -r 2>/dev/null; rm -rf "$BUILD"' EXIT
+
+"$CC" -O2 -std=c11 -Wall -I ../../Source/API SnapshotReader.c -o "$BUILD/SnapshotReader" || "$CC" -O2 -std=c11 -Wall -I ../../Source/API SnapshotReader.c -o "$BUILD/SnapshotReader" -lrt
+"$CC" -O2 -std=c11 -Wall -I ../../Source/API SnapshotWriter.c -o "$BUILD/SnapshotWriter" || "$CC" -O2 -std=c11 -Wall -I ../../Source/API SnapshotWriter.c -o "$BUILD/SnapshotWriter" -lrt
+
+for generation in 1 2
+do
+	"$BUILD/SnapshotWriter" $ID < RoundTripTest.txt
+	"$BUILD/SnapshotReader" $ID > "$BUILD/output.txt"
+
+	if ! head -n 1 "$BUILD/output.txt" | grep -q "^; Generation $generation, 3 files, "
+	then
+		echo "Unexpected header: $(head -n 1 "$BUILD/output.txt")"
+		exit 1
+	fi
+	if ! tail -n +2 "$BUILD/output.txt" | cmp -s - RoundTripTest.txt
+	then
+		echo "The snapshot differs from the input:"
+		tail -n +2 "$BUILD/output.txt" | diff RoundTripTest.txt - || true
+		exit 1
+	fi
+done
+
+# The path filter only prints the matching files
+"$BUILD/SnapshotReader" $ID "\\data\\" > "$BUILD/output.txt"
+if [ "$(grep -c '^; C:' "$BUILD/output.txt")" != 1 ]
+then
+	echo "The path filter didn't apply"
+	exit 1
+fi
+
+echo "Round trip passed"
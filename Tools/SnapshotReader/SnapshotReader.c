@@ -0,0 +1,285 @@
+// Sample reader of the shared snapshot published by PrivateProfileRedirector ('SharedSnapshot' option).
+// Prints the content of every file in the snapshot as UTF-8, optionally only the files whose path contains a filter.
+//
+//	SnapshotReader <process ID> [path filter]
+//
+// On Windows it opens the 'Local\PrivateProfileRedirector.Snapshot.<pid>' file mapping. Elsewhere it opens
+// the POSIX shared memory object '/PrivateProfileRedirector.Snapshot.<pid>' with the same layout, which is
+// useful to check a snapshot writer without the game, see 'SnapshotWriter.c'.
+//
+// The header fields are read with C11 atomics. Build it as a 64-bit program, the view is read-only
+// and a 32-bit build could use a locked instruction for the 64-bit loads.
+//
+//	cl /O2 /std:c11 /experimental:c11atomics /I ..\..\Source\API SnapshotReader.c
+//	cc -O2 -std=c11 -I ../../Source/API SnapshotReader.c -o SnapshotReader (add -lrt on older glibc)
+
+#include "PrivateProfileRedirectorSnapshot.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+
+#define YieldReader() Sleep(0)
+#else
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define YieldReader() sched_yield()
+#endif
+
+#define LoadAcquire32(ptr) atomic_load_explicit((const _Atomic uint32_t*)(ptr), memory_order_acquire)
+#define LoadAcquire64(ptr) atomic_load_explicit((const _Atomic uint64_t*)(ptr), memory_order_acquire)
+#define LoadRelaxed64(ptr) atomic_load_explicit((const _Atomic uint64_t*)(ptr), memory_order_relaxed)
+#define FenceAcquire() atomic_thread_fence(memory_order_acquire)
+
+enum
+{
+	MaxReadAttempts = 1000
+};
+
+static const PPR_SnapshotHeader* OpenSnapshot(unsigned long processID)
+{
+	char name[128];
+#ifdef _WIN32
+	snprintf(name, sizeof(name), "Local\\" PPR_SNAPSHOT_NAME_PREFIX "%lu", processID);
+
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+	if (!mapping)
+	{
+		fprintf(stderr, "Can't open '%s', error %lu\n", name, GetLastError());
+		return NULL;
+	}
+
+	// The view keeps the mapping alive
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view)
+	{
+		fprintf(stderr, "Can't map '%s', error %lu\n", name, GetLastError());
+		return NULL;
+	}
+	return (const PPR_SnapshotHeader*)view;
+#else
+	snprintf(name, sizeof(name), "/" PPR_SNAPSHOT_NAME_PREFIX "%lu", processID);
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(PPR_SnapshotHeader))
+	{
+		fprintf(stderr, "Can't open '%s'\n", name);
+		return NULL;
+	}
+
+	const void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+	{
+		fprintf(stderr, "Can't map '%s'\n", name);
+		return NULL;
+	}
+	return (const PPR_SnapshotHeader*)view;
+#endif
+}
+
+// Copies a consistent snapshot of the data, returns NULL if the writer kept changing it
+static uint8_t* CopySnapshot(const PPR_SnapshotHeader* header, PPR_SnapshotHeader* copy)
+{
+	// The magic is stored last when the region is created, the rest of the fixed fields are valid after it
+	const uint32_t magic = LoadAcquire32(&header->Magic);
+	if (magic != PPR_SNAPSHOT_MAGIC || header->LayoutVersion != PPR_SNAPSHOT_LAYOUT_VERSION || header->HeaderSize < sizeof(PPR_SnapshotHeader))
+	{
+		fprintf(stderr, "Unknown snapshot layout, magic 0x%08x, version %u\n", magic, header->LayoutVersion);
+		return NULL;
+	}
+
+	const size_t capacity = header->RegionSize - header->HeaderSize;
+	uint8_t* data = (uint8_t*)malloc(capacity != 0 ? capacity : 1);
+	if (!data)
+	{
+		return NULL;
+	}
+
+	for (int attempt = 0; attempt < MaxReadAttempts; attempt++)
+	{
+		const uint64_t sequence = LoadAcquire64(&header->Sequence);
+		if (sequence & 1)
+		{
+			YieldReader();
+			continue;
+		}
+
+		memcpy(copy, header, sizeof(*copy));
+		if (copy->DataSize <= capacity)
+		{
+			memcpy(data, (const uint8_t*)header + header->HeaderSize, copy->DataSize);
+		}
+
+		// Orders the copy before the second load, which is what a matching sequence vouches for
+		FenceAcquire();
+		if (LoadRelaxed64(&header->Sequence) == sequence && copy->DataSize <= capacity)
+		{
+			return data;
+		}
+	}
+
+	free(data);
+	fprintf(stderr, "The snapshot is being updated too often, giving up\n");
+	return NULL;
+}
+
+static void PrintUTF16(const uint8_t* text, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; i++)
+	{
+		uint32_t c = (uint32_t)text[i * 2] | ((uint32_t)text[i * 2 + 1] << 8);
+		if (c >= 0xD800 && c <= 0xDBFF && i + 1 < length)
+		{
+			const uint32_t low = (uint32_t)text[(i + 1) * 2] | ((uint32_t)text[(i + 1) * 2 + 1] << 8);
+			if (low >= 0xDC00 && low <= 0xDFFF)
+			{
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				i++;
+			}
+		}
+
+		if (c < 0x80)
+		{
+			putchar((int)c);
+		}
+		else if (c < 0x800)
+		{
+			putchar((int)(0xC0 | (c >> 6)));
+			putchar((int)(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x10000)
+		{
+			putchar((int)(0xE0 | (c >> 12)));
+			putchar((int)(0x80 | ((c >> 6) & 0x3F)));
+			putchar((int)(0x80 | (c & 0x3F)));
+		}
+		else
+		{
+			putchar((int)(0xF0 | (c >> 18)));
+			putchar((int)(0x80 | ((c >> 12) & 0x3F)));
+			putchar((int)(0x80 | ((c >> 6) & 0x3F)));
+			putchar((int)(0x80 | (c & 0x3F)));
+		}
+	}
+}
+
+static int PathContains(const uint8_t* text, uint32_t length, const char* filter)
+{
+	// ASCII-only case-insensitive search, good enough for the path filter
+	const size_t filterLength = strlen(filter);
+	for (size_t start = 0; start + filterLength <= length; start++)
+	{
+		size_t i = 0;
+		for (; i < filterLength; i++)
+		{
+			const uint16_t c = (uint16_t)(text[(start + i) * 2] | (text[(start + i) * 2 + 1] << 8));
+			if (c > 0x7F || tolower(c) != tolower((unsigned char)filter[i]))
+			{
+				break;
+			}
+		}
+		if (i == filterLength)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <process ID> [path filter]\n", argv[0]);
+		return 2;
+	}
+	const char* filter = argc > 2 ? argv[2] : NULL;
+
+	const PPR_SnapshotHeader* header = OpenSnapshot(strtoul(argv[1], NULL, 10));
+	if (!header)
+	{
+		return 1;
+	}
+
+	PPR_SnapshotHeader copy;
+	uint8_t* data = CopySnapshot(header, &copy);
+	if (!data)
+	{
+		return 1;
+	}
+
+	printf("; Generation %llu, %u files, %u bytes%s\n", (unsigned long long)copy.Generation, copy.FileCount, copy.DataSize, (copy.Flags & PPR_SNAPSHOT_FLAG_TRUNCATED) ? ", truncated" : "");
+
+	int isPrinting = 1;
+	for (size_t offset = 0; offset + sizeof(PPR_SnapshotRecord) <= copy.DataSize;)
+	{
+		PPR_SnapshotRecord record;
+		memcpy(&record, data + offset, sizeof(record));
+
+		const size_t textSize = (size_t)record.Length * 2;
+		const uint8_t* text = data + offset + sizeof(record);
+		if (textSize > copy.DataSize - offset - sizeof(record))
+		{
+			fprintf(stderr, "Malformed record at offset %zu\n", offset);
+			break;
+		}
+
+		switch (record.Type)
+		{
+			case PPR_SNAPSHOT_RECORD_FILE:
+			{
+				isPrinting = !filter || PathContains(text, record.Length, filter);
+				if (isPrinting)
+				{
+					printf("\n; ");
+					PrintUTF16(text, record.Length);
+					putchar('\n');
+				}
+				break;
+			}
+			case PPR_SNAPSHOT_RECORD_SECTION:
+			{
+				if (isPrinting)
+				{
+					putchar('[');
+					PrintUTF16(text, record.Length);
+					printf("]\n");
+				}
+				break;
+			}
+			case PPR_SNAPSHOT_RECORD_KEY:
+			{
+				if (isPrinting)
+				{
+					PrintUTF16(text, record.Length);
+					putchar('=');
+				}
+				break;
+			}
+			case PPR_SNAPSHOT_RECORD_VALUE:
+			{
+				if (isPrinting)
+				{
+					PrintUTF16(text, record.Length);
+					putchar('\n');
+				}
+				break;
+			}
+		};
+		offset += sizeof(record) + ((textSize + 3) & ~(size_t)3);
+	}
+
+	free(data);
+	return 0;
+}
@@ -0,0 +1,289 @@
+// Test writer of the shared snapshot layout for the platforms without the game. Reads a snapshot in the text form
+// printed by 'SnapshotReader' from the standard input and publishes it into the POSIX shared memory object
+// '/PrivateProfileRedirector.Snapshot.<pid>' the same way the plugin publishes its mapping, so the reader
+// can be checked against it. See 'RoundTripTest.sh'.
+//
+//	SnapshotWriter <process ID> < snapshot.txt
+//	SnapshotWriter <process ID> -r (removes the object)
+//
+// A line starting with "; " right after an empty line is a file path, the other lines starting with ';' are comments.
+// Section lines are enclosed in brackets and the rest are 'key=value' pairs, split at the first '='. The text is UTF-8.
+//
+//	cc -O2 -std=c11 -I ../../Source/API SnapshotWriter.c -o SnapshotWriter (add -lrt on older glibc)
+
+#define _POSIX_C_SOURCE 200809L
+#include "PrivateProfileRedirectorSnapshot.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct Buffer
+{
+	uint8_t* Data;
+	size_t Size;
+	size_t Capacity;
+} Buffer;
+
+static uint8_t* Reserve(Buffer* buffer, size_t size)
+{
+	if (buffer->Size + size > buffer->Capacity)
+	{
+		size_t capacity = buffer->Capacity != 0 ? buffer->Capacity * 2 : 4096;
+		while (capacity < buffer->Size + size)
+		{
+			capacity *= 2;
+		}
+
+		uint8_t* data = (uint8_t*)realloc(buffer->Data, capacity);
+		if (!data)
+		{
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		buffer->Data = data;
+		buffer->Capacity = capacity;
+	}
+
+	uint8_t* data = buffer->Data + buffer->Size;
+	buffer->Size += size;
+	return data;
+}
+
+// Decodes the next UTF-8 sequence, invalid ones are replaced with U+FFFD one byte at a time
+static uint32_t DecodeUTF8(const uint8_t** text, const uint8_t* end)
+{
+	const uint8_t* p = *text;
+	const uint32_t lead = *p++;
+
+	uint32_t c = 0xFFFD;
+	size_t length = 0;
+	uint32_t min = 0;
+	if (lead < 0x80)
+	{
+		c = lead;
+	}
+	else if (lead >= 0xC2 && lead <= 0xDF)
+	{
+		c = lead & 0x1F;
+		length = 1;
+		min = 0x80;
+	}
+	else if (lead >= 0xE0 && lead <= 0xEF)
+	{
+		c = lead & 0x0F;
+		length = 2;
+		min = 0x800;
+	}
+	else if (lead >= 0xF0 && lead <= 0xF4)
+	{
+		c = lead & 0x07;
+		length = 3;
+		min = 0x10000;
+	}
+
+	if (length != 0)
+	{
+		if ((size_t)(end - p) < length)
+		{
+			c = 0xFFFD;
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i++)
+			{
+				if ((p[i] & 0xC0) != 0x80)
+				{
+					c = 0xFFFD;
+					break;
+				}
+				c = (c << 6) | (p[i] & 0x3F);
+			}
+			if (c != 0xFFFD && (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)))
+			{
+				c = 0xFFFD;
+			}
+			if (c != 0xFFFD)
+			{
+				p += length;
+			}
+		}
+	}
+
+	*text = p;
+	return c;
+}
+
+static void PutUnit(uint8_t** out, uint32_t unit)
+{
+	(*out)[0] = (uint8_t)(unit & 0xFF);
+	(*out)[1] = (uint8_t)(unit >> 8);
+	*out += 2;
+}
+
+// Appends a record with the text converted to UTF-16LE and padded to a multiple of 4 bytes
+static void AddRecord(Buffer* data, PPR_SnapshotRecordType type, const char* text, size_t length)
+{
+	const uint8_t* p = (const uint8_t*)text;
+	const uint8_t* end = p + length;
+
+	// Every UTF-8 byte becomes at most one UTF-16 unit
+	const size_t offset = data->Size;
+	uint8_t* out = Reserve(data, sizeof(PPR_SnapshotRecord) + length * 2 + 4) + sizeof(PPR_SnapshotRecord);
+	uint8_t* start = out;
+	while (p != end)
+	{
+		const uint32_t c = DecodeUTF8(&p, end);
+		if (c >= 0x10000)
+		{
+			PutUnit(&out, 0xD800 + ((c - 0x10000) >> 10));
+			PutUnit(&out, 0xDC00 + ((c - 0x10000) & 0x3FF));
+		}
+		else
+		{
+			PutUnit(&out, c);
+		}
+	}
+
+	PPR_SnapshotRecord record;
+	memset(&record, 0, sizeof(record));
+	record.Type = (uint16_t)type;
+	record.Length = (uint32_t)((out - start) / 2);
+	memcpy(data->Data + offset, &record, sizeof(record));
+
+	const size_t textSize = ((size_t)(out - start) + 3) & ~(size_t)3;
+	memset(out, 0, textSize - (size_t)(out - start));
+	data->Size = offset + sizeof(record) + textSize;
+}
+
+static uint32_t ParseSnapshot(FILE* stream, Buffer* data)
+{
+	uint32_t fileCount = 0;
+	int isAfterEmptyLine = 0;
+
+	char* line = NULL;
+	size_t lineCapacity = 0;
+	ssize_t lineLength = 0;
+	while ((lineLength = getline(&line, &lineCapacity, stream)) >= 0)
+	{
+		size_t length = (size_t)lineLength;
+		while (length != 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+		{
+			length--;
+		}
+
+		if (length == 0)
+		{
+			isAfterEmptyLine = 1;
+			continue;
+		}
+		if (line[0] == ';')
+		{
+			if (isAfterEmptyLine && length >= 2 && line[1] == ' ')
+			{
+				AddRecord(data, PPR_SNAPSHOT_RECORD_FILE, line + 2, length - 2);
+				fileCount++;
+			}
+		}
+		else if (line[0] == '[' && line[length - 1] == ']')
+		{
+			AddRecord(data, PPR_SNAPSHOT_RECORD_SECTION, line + 1, length - 2);
+		}
+		else
+		{
+			const char* separator = memchr(line, '=', length);
+			const size_t keyLength = separator ? (size_t)(separator - line) : length;
+
+			AddRecord(data, PPR_SNAPSHOT_RECORD_KEY, line, keyLength);
+			AddRecord(data, PPR_SNAPSHOT_RECORD_VALUE, separator ? separator + 1 : "", separator ? length - keyLength - 1 : 0);
+		}
+		isAfterEmptyLine = 0;
+	}
+
+	free(line);
+	return fileCount;
+}
+
+static PPR_SnapshotHeader* CreateSnapshot(const char* name, size_t regionSize)
+{
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || ftruncate(fd, (off_t)regionSize) != 0)
+	{
+		fprintf(stderr, "Can't create '%s'\n", name);
+		return NULL;
+	}
+
+	void* view = mmap(NULL, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+	{
+		fprintf(stderr, "Can't map '%s'\n", name);
+		return NULL;
+	}
+
+	// A region left by the previous run keeps its sequence, so the readers which have it open see the change
+	PPR_SnapshotHeader* header = (PPR_SnapshotHeader*)view;
+	header->LayoutVersion = PPR_SNAPSHOT_LAYOUT_VERSION;
+	header->HeaderSize = sizeof(PPR_SnapshotHeader);
+	header->RegionSize = (uint32_t)regionSize;
+	atomic_store_explicit((_Atomic uint32_t*)&header->Magic, PPR_SNAPSHOT_MAGIC, memory_order_release);
+
+	return header;
+}
+
+// Same steps as 'SnapshotPublisher::Publish'
+static void Publish(PPR_SnapshotHeader* header, const Buffer* data, uint32_t fileCount)
+{
+	_Atomic uint64_t* sequence = (_Atomic uint64_t*)&header->Sequence;
+	const uint64_t value = atomic_load_explicit(sequence, memory_order_relaxed);
+
+	atomic_store_explicit(sequence, value + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy((uint8_t*)header + header->HeaderSize, data->Data, data->Size);
+	header->Flags = 0;
+	header->Generation++;
+	header->DataSize = (uint32_t)data->Size;
+	header->FileCount = fileCount;
+
+	atomic_store_explicit(sequence, value + 2, memory_order_release);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <process ID> [-r] < snapshot.txt\n", argv[0]);
+		return 2;
+	}
+
+	char name[128];
+	snprintf(name, sizeof(name), "/" PPR_SNAPSHOT_NAME_PREFIX "%lu", strtoul(argv[1], NULL, 10));
+	if (argc > 2 && strcmp(argv[2], "-r") == 0)
+	{
+		return shm_unlink(name) == 0 ? 0 : 1;
+	}
+
+	Buffer data;
+	memset(&data, 0, sizeof(data));
+	const uint32_t fileCount = ParseSnapshot(stdin, &data);
+
+	// Rounded up to whole pages, a region left by the previous run is resized to fit
+	const size_t regionSize = (sizeof(PPR_SnapshotHeader) + data.Size + 4095) & ~(size_t)4095;
+	PPR_SnapshotHeader* header = CreateSnapshot(name, regionSize);
+	if (!header)
+	{
+		free(data.Data);
+		return 1;
+	}
+
+	Publish(header, &data, fileCount);
+	munmap(header, regionSize);
+	free(data.Data);
+
+	return 0;
+}